@@ -0,0 +1,103 @@
+#ifndef FLEET_METRICS_HPP_
+#define FLEET_METRICS_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "packaging_machine_definition.hpp"
+
+namespace metrics
+{
+
+enum class Activity : uint8_t
+{
+  IDLE,
+  BUSY,
+  OTHER, // error or unknown, counted neither as busy nor as idle
+};
+
+struct HourSlot
+{
+  int64_t hour; // hours since epoch, -1 if the slot is unused
+  uint32_t completed;
+  uint32_t failed;
+  double cycle_time_sum;
+  double cycle_time_max;
+  double queue_wait_sum;
+  uint32_t queue_waits;
+  double busy_sec;
+  double idle_sec;
+};
+
+struct Summary
+{
+  uint32_t completed;
+  uint32_t failed;
+  double orders_per_hour;
+  double cycle_time_p50;
+  double cycle_time_p95;
+  double cycle_time_p99;
+  double queue_wait_mean;
+  double queue_wait_p95;
+  std::vector<double> utilization; // index is packaging_machine_id - 1
+};
+
+// Order throughput, cycle time, queue wait and machine utilization of the fleet
+// over a rolling window of METRICS_WINDOW_SEC, with an hourly history of
+// METRICS_HISTORY_HOURS slots. Times are in seconds of the node clock.
+// It is not thread-safe, the manager guards it.
+class FleetMetrics
+{
+public:
+  explicit FleetMetrics(size_t no_of_machines);
+
+  void on_dispatched(uint32_t order_id, double queue_wait, double now);
+  void on_result(uint32_t order_id, bool success, double now);
+  void on_machine_state(uint8_t machine_id, Activity activity, double now);
+
+  Summary summarize(double now);
+  // the used slots, the oldest first
+  std::vector<HourSlot> history(void) const;
+
+private:
+  struct Sample
+  {
+    double time;
+    double value;
+  };
+
+  struct MinuteBucket
+  {
+    int64_t minute;
+    double busy_sec;
+    double idle_sec;
+  };
+
+  struct MachineClock
+  {
+    Activity activity;
+    double since; // < 0 until the first state
+    std::array<MinuteBucket, 60> minutes;
+  };
+
+  std::unordered_map<uint32_t, double> dispatched_at_;
+  std::deque<Sample> cycle_times_;
+  std::deque<double> failures_;
+  std::deque<Sample> queue_waits_;
+  std::vector<MachineClock> machines_;
+  std::array<HourSlot, METRICS_HISTORY_HOURS> hours_;
+
+  HourSlot &hour_slot(double time);
+  void accrue(MachineClock &machine, double now);
+  void prune(double now);
+
+  static double percentile(std::vector<double> &values, double p);
+};
+
+} // namespace metrics
+
+#endif  // FLEET_METRICS_HPP_
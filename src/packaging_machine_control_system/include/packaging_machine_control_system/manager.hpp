@@ -2,6 +2,7 @@
 #define MANAGER_HPP_
 
 #include <map>
+#include <unordered_map>
 #include <functional>
 #include <memory>
 #include <thread>
@@ -9,25 +10,25 @@
 
 #include "rclcpp/rclcpp.hpp"
 #include "rclcpp_action/rclcpp_action.hpp"
-#include "rclcpp_components/component_manager.hpp"
 #include "rclcpp_components/register_node_macro.hpp"
 
-#include "rcl_interfaces/msg/parameter.hpp"
-#include "rcl_interfaces/msg/parameter_value.hpp"
-
-#include "composition_interfaces/srv/load_node.hpp"
-#include "composition_interfaces/srv/unload_node.hpp"
-#include "composition_interfaces/srv/list_nodes.hpp"
-
 #include "std_srvs/srv/set_bool.hpp"
 
+#include "smdps_msgs/msg/packaging_machine_info.hpp"
 #include "smdps_msgs/msg/packaging_machine_status.hpp"
 #include "smdps_msgs/msg/packaging_result.hpp"
+#include "smdps_msgs/msg/packaging_status.hpp"
 #include "smdps_msgs/msg/unbind_request.hpp"
 
 #include "smdps_msgs/srv/packaging_order.hpp"
 
-#define CELLS 28
+#include "packaging_machine_control_system/msg/fleet_metrics.hpp"
+#include "packaging_machine_control_system/msg/scheduler_status.hpp"
+
+#include "packaging_machine_action_client.hpp"
+#include "fleet_metrics.hpp"
+#include "order_scheduler.hpp"
+#include "smdps_common/status_table.hpp"
 
 using namespace std::chrono_literals;
 using std::placeholders::_1;
@@ -39,21 +40,21 @@ class PackagingMachineManager : public rclcpp::Node
 public:
   using SetBool = std_srvs::srv::SetBool;
   
+  using PackagingMachineInfo = smdps_msgs::msg::PackagingMachineInfo;
   using PackagingMachineStatus = smdps_msgs::msg::PackagingMachineStatus;
   using PackagingResult = smdps_msgs::msg::PackagingResult;
+  using PackagingStatus = smdps_msgs::msg::PackagingStatus;
   using UnbindRequest = smdps_msgs::msg::UnbindRequest;
 
   using PackagingOrderSrv = smdps_msgs::srv::PackagingOrder;
 
-  using LoadNode = composition_interfaces::srv::LoadNode;
-  using UnloadNode = composition_interfaces::srv::UnloadNode;
-  using ListNodes = composition_interfaces::srv::ListNodes;
+  using SchedulerStatus = packaging_machine_control_system::msg::SchedulerStatus;
+  using FleetMetrics = packaging_machine_control_system::msg::FleetMetrics;
+  using HourlyMetrics = packaging_machine_control_system::msg::HourlyMetrics;
 
-  explicit PackagingMachineManager(
-    std::weak_ptr<rclcpp::Executor> executor,
-    const std::string & node_name,
-    const std::string & node_namespace,
-    const rclcpp::NodeOptions & options);
+  using PackagingMachineActionClient = action_client::PackagingMachineActionClient;
+
+  explicit PackagingMachineManager(const rclcpp::NodeOptions & options);
   ~PackagingMachineManager() = default;
 
   void packaging_order_handle(
@@ -64,43 +65,87 @@ private:
   std::mutex mutex_;
   size_t no_of_pkg_mac;
 
-  // order_id, unique_id
-  std::vector<std::pair<uint32_t, uint64_t>> curr_client_;
+  enum class OrderState : uint8_t
+  {
+    QUEUED,     // waiting in the scheduler
+    DISPATCHED, // sent to a worker, waiting for the result
+  };
+
+  struct OrderRecord
+  {
+    OrderState state;
+    uint8_t packaging_machine_id; // 0 while queued
+    size_t worker;                // index in action_clients_ once dispatched
+  };
+
+  // order_id, record from the request until the result of the order
+  std::unordered_map<uint32_t, OrderRecord> orders_;
+  // dispatched orders of each machine, index is packaging_machine_id - 1
+  std::vector<size_t> machine_orders_;
+
+  // long-lived action clients, one per packaging machine
+  std::vector<std::unique_ptr<PackagingMachineActionClient>> action_clients_;
 
   rclcpp::CallbackGroup::SharedPtr srv_cli_cbg_;
 
   rclcpp::Service<PackagingOrderSrv>::SharedPtr service_;
 
   rclcpp::Subscription<PackagingMachineStatus>::SharedPtr status_sub_;
-  rclcpp::Subscription<PackagingResult>::SharedPtr packaging_result_sub_;
+  std::vector<rclcpp::Subscription<PackagingMachineInfo>::SharedPtr> info_sub_;
+  std::vector<rclcpp::Subscription<PackagingResult>::SharedPtr> recovered_order_sub_;
 
   rclcpp::Publisher<UnbindRequest>::SharedPtr unbind_order_id_pub_;
-  
-  rclcpp::Client<LoadNode>::SharedPtr load_node_client_;
-  rclcpp::Client<UnloadNode>::SharedPtr unload_node_client_;
-  rclcpp::Client<ListNodes>::SharedPtr list_node_client_;
-  std::vector<std::pair<rclcpp::Client<SetBool>::SharedPtr, rclcpp::Client<SetBool>::SharedPtr>> conveyor_stopper_client_;
+  rclcpp::Publisher<SchedulerStatus>::SharedPtr scheduler_status_pub_;
+  rclcpp::Publisher<FleetMetrics>::SharedPtr fleet_metrics_pub_;
+  // shared by all action clients
+  rclcpp::Publisher<PackagingStatus>::SharedPtr packaging_status_pub_;
+  rclcpp::Publisher<PackagingResult>::SharedPtr packaging_result_pub_;
+
+  struct ConveyorStopperClient
+  {
+    rclcpp::Client<SetBool>::SharedPtr conveyor;
+    rclcpp::Client<SetBool>::SharedPtr stopper;
+    bool ready;     // both services were ready at the last check
+    size_t pending; // requests waiting for a response
+    std::chrono::steady_clock::time_point sent_at;
+  };
+
+  // index is packaging_machine_id - 1
+  std::vector<ConveyorStopperClient> conveyor_stopper_client_;
   
   rclcpp::TimerBase::SharedPtr conveyor_stopper_timer_;
+  rclcpp::TimerBase::SharedPtr packaging_status_timer_;
+  rclcpp::TimerBase::SharedPtr scheduler_status_timer_;
+  rclcpp::TimerBase::SharedPtr fleet_metrics_timer_;
 
-  // packaging_machine_id, PackagingMachineStatus
-  std::map<uint8_t, PackagingMachineStatus> packaging_machine_status_;
-  
-  const std::string action_client_manager_node_name = "action_client_manager";
-  const std::string load_node_service_name = action_client_manager_node_name + "/_container/load_node";
-  const std::string unload_node_service_name = action_client_manager_node_name + "/_container/unload_node";
-  const std::string list_nodes_service_name = action_client_manager_node_name + "/_container/list_nodes";
+  // indexed by packaging_machine_id, written and read without mutex_
+  StatusTable<PackagingMachineStatus> packaging_machine_status_;
+  StatusTable<PackagingMachineInfo> packaging_machine_info_;
+
+  // orders wait here until a packaging machine can take them
+  std::unique_ptr<scheduler::OrderScheduler> scheduler_;
+
+  std::unique_ptr<metrics::FleetMetrics> metrics_;
 
   const std::string packaging_order_service_name = "packaging_order";
 
   void conveyor_stopper_cb(void);
+  // claims the clients of the machine for a release, mutex_ must be held
+  bool claim_conveyor_stopper(size_t index);
+  // runs the conveyor and sinks the stopper, mutex_ must not be held
+  void release_conveyor_stopper(size_t index);
 
   void status_cb(const PackagingMachineStatus::SharedPtr msg);
-  void packaging_result_cb(const PackagingResult::SharedPtr msg);
-
-protected:
-  std::shared_ptr<rclcpp::Executor> executor_;
-  std::shared_ptr<rclcpp_components::ComponentManager> action_client_manager_;
+  void info_cb(const PackagingMachineInfo::SharedPtr msg, uint8_t packaging_machine_id);
+  void packaging_result_cb(const PackagingResult &msg);
+  void recovered_order_cb(const PackagingResult::SharedPtr msg);
+  void pub_packaging_status_cb(void);
+  void pub_scheduler_status_cb(void);
+  void pub_fleet_metrics_cb(void);
+
+  // sends the queued orders to the machines which can take them, mutex_ must be held
+  void dispatch_queued_orders(void);
+  std::vector<scheduler::MachineSnapshot> machine_snapshots(void);
 
 };
 
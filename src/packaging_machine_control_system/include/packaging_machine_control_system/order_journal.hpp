@@ -0,0 +1,94 @@
+#ifndef ORDER_JOURNAL_HPP_
+#define ORDER_JOURNAL_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "packaging_machine_definition.hpp"
+
+namespace journal
+{
+
+enum class Step : uint8_t
+{
+  BEGIN = 1,    // the order is started, the payload is the serialized goal
+  FALLEN,       // the material box is emptied and unbound
+  TIGHTENED,    // the bag is tightened before the first package
+  PRINTED,      // the label of a package is printed, value is the count so far
+  ROLLED,       // the roller is turned to the day in value
+  GATE_OPENED,  // the pill gate of the cell in value is opened
+  CELL_DONE,    // the cell in value is completed
+  GATES_CLOSED, // the pill gates of the day in value are closed
+  END,          // the order is finished
+  PUSHED,       // a printed package is pushed out, value is the count so far
+};
+
+// What an unfinished order had done when the node stopped
+struct Progress
+{
+  uint32_t order_id = 0;
+  std::vector<uint8_t> goal;
+  bool drugs_fallen = false;
+  bool tightened = false;
+  uint32_t prints = 0;
+  uint32_t pushes = 0;
+  std::array<bool, DAYS> rolled{};
+  std::array<bool, DAYS> gates_closed{};
+  std::array<bool, CELLS> gate_opened{};
+  std::array<bool, CELLS> cells{};
+};
+
+// Append-only progress journal of the order running on a packaging machine.
+//
+// Every record is written with one write() as soon as its step is done, so it
+// survives a crash of the node. The records are flushed to the disk every
+// JOURNAL_SYNC_EVERY records and at once for BEGIN, FALLEN and END, which only
+// matters when the whole host goes down. A record carries its length and a
+// checksum, a torn record at the tail is cut off by recover(). The file only
+// holds the current order, it is emptied when the next one begins.
+// It is not thread-safe, only the thread running the order writes to it.
+class OrderJournal
+{
+public:
+  explicit OrderJournal(const std::string &path);
+  ~OrderJournal();
+
+  OrderJournal(const OrderJournal &) = delete;
+  OrderJournal &operator=(const OrderJournal &) = delete;
+
+  bool open(void);
+  const std::string &path(void) const { return path_; }
+
+  // Reads the order left unfinished by the last run, false if there is none.
+  // The order goes on in the journal, its next records follow the recovered ones
+  bool recover(Progress &progress);
+
+  bool begin(uint32_t order_id, const std::vector<uint8_t> &goal);
+  bool record(Step step, uint32_t value = 0);
+  bool end(void);
+
+private:
+  struct Header
+  {
+    uint32_t size;     // of the body, step to the end of the payload
+    uint32_t checksum; // FNV-1a of the body
+  };
+
+  static constexpr size_t BODY_SIZE = sizeof(uint8_t) + 2 * sizeof(uint32_t);
+
+  const std::string path_;
+  int fd_;
+  uint32_t order_id_;
+  size_t unsynced_;
+
+  bool append(Step step, uint32_t value, const std::vector<uint8_t> &payload, bool sync);
+
+  static uint32_t checksum(const uint8_t *data, size_t size);
+};
+
+} // namespace journal
+
+#endif  // ORDER_JOURNAL_HPP_
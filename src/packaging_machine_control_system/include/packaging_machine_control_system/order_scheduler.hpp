@@ -0,0 +1,103 @@
+#ifndef ORDER_SCHEDULER_HPP_
+#define ORDER_SCHEDULER_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "smdps_msgs/action/packaging_order.hpp"
+
+#include "packaging_machine_definition.hpp"
+
+namespace scheduler
+{
+
+// What the manager knows about a machine when an order is dispatched
+struct MachineSnapshot
+{
+  uint8_t id;
+  bool available;      // idle, conveyor available and an idle action client
+  uint8_t temperature; // heater temperature
+};
+
+struct QueuedOrder
+{
+  std::unique_ptr<smdps_msgs::action::PackagingOrder::Goal> goal;
+  size_t cells;
+  std::chrono::steady_clock::time_point enqueued_at;
+};
+
+// Queues the packaging orders and picks the machine for each of them.
+// Machines are ranked by the predicted time to finish the order, from the number
+// of cells and the average time a cell took on the machine, plus the time the
+// heater needs to reach MIN_TEMP. It is not thread-safe, the manager guards it.
+class OrderScheduler
+{
+public:
+  using Goal = smdps_msgs::action::PackagingOrder::Goal;
+  using Clock = std::chrono::steady_clock;
+
+  OrderScheduler(size_t max_queued_orders, double default_cell_time);
+
+  // false if the queue is full
+  bool enqueue(std::unique_ptr<Goal> goal);
+
+  // The machine which finishes the order at the head of the queue first, 0 if none can take it
+  uint8_t select_machine(const std::vector<MachineSnapshot> &machines) const;
+
+  QueuedOrder pop(void);
+  // puts back an order which could not be sent, it keeps its place and wait time
+  void push_front(QueuedOrder order);
+
+  // returns the time the order waited in the queue
+  double start(uint8_t machine_id, const QueuedOrder &order);
+  void finish(uint8_t machine_id, bool success);
+
+  bool empty(void) const { return queue_.empty(); }
+  size_t size(void) const { return queue_.size(); }
+  size_t max_size(void) const { return max_queued_orders_; }
+
+  double oldest_wait(void) const;
+  double mean_wait(void) const { return mean_wait_; }
+  double estimated_wait(size_t no_of_machines) const;
+  double cell_time(uint8_t machine_id) const;
+
+  uint64_t dispatched(void) const { return dispatched_; }
+  uint64_t rejected(void) const { return rejected_; }
+
+  static size_t count_cells(const Goal &goal);
+
+private:
+  struct MachineLoad
+  {
+    double cell_time;
+    size_t cells;
+    Clock::time_point started_at;
+    bool running;
+  };
+
+  const size_t max_queued_orders_;
+  const double default_cell_time_;
+
+  std::deque<QueuedOrder> queue_;
+  std::map<uint8_t, MachineLoad> load_;
+
+  double mean_wait_;
+  uint64_t dispatched_;
+  uint64_t rejected_;
+
+  MachineLoad &load(uint8_t machine_id);
+  double remaining(const MachineLoad &load, Clock::time_point now) const;
+
+  static double seconds(Clock::duration d)
+  {
+    return std::chrono::duration<double>(d).count();
+  }
+};
+
+} // namespace scheduler
+
+#endif  // ORDER_SCHEDULER_HPP_
@@ -2,6 +2,7 @@
 #ifndef PACKAGING_MACHINE_ACTION_CLIENT_HPP_
 #define PACKAGING_MACHINE_ACTION_CLIENT_HPP_
 
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <utility>
@@ -9,62 +10,97 @@
 
 #include "rclcpp/rclcpp.hpp"
 #include "rclcpp_action/rclcpp_action.hpp"
-#include "rclcpp_components/register_node_macro.hpp"
 
 #include "smdps_msgs/msg/packaging_status.hpp"
 #include "smdps_msgs/msg/packaging_result.hpp"
 #include "smdps_msgs/msg/package_info.hpp"
 #include "smdps_msgs/action/packaging_order.hpp"
 
-#define CELLS 28
+#include "packaging_machine_definition.hpp"
 
 using namespace std::chrono_literals;
 
 namespace action_client
 {
 
-class PackagingMachineActionClient : public rclcpp::Node
+// A long-lived action client of one packaging machine, owned by the manager.
+// It is created once and reused for every order dispatched to the machine.
+// It does not publish by itself, the manager takes the status of the order
+// when it has changed and publishes the statuses of all workers on one topic.
+class PackagingMachineActionClient
 {
+public:
   using PackagingStatus = smdps_msgs::msg::PackagingStatus;
   using PackagingResult = smdps_msgs::msg::PackagingResult;
   using PackageInfo = smdps_msgs::msg::PackageInfo;
   using PackagingOrder = smdps_msgs::action::PackagingOrder;
-  using GaolHandlerPackagingOrder = rclcpp_action::ClientGoalHandle<PackagingOrder>; 
+  using GaolHandlerPackagingOrder = rclcpp_action::ClientGoalHandle<PackagingOrder>;
 
-public:
-  explicit PackagingMachineActionClient(const rclcpp::NodeOptions & options);
-  
-  inline bool is_goal_done(void) const;
-  void send_goal(void);
+  using ResultCallback = std::function<void(const PackagingResult &)>;
+
+  explicit PackagingMachineActionClient(
+    rclcpp::Node *node,
+    uint8_t packaging_machine_id,
+    ResultCallback result_cb);
+
+  bool is_idle(void);
+  // copies the status of the order if it has changed since the last call
+  bool take_status(PackagingStatus &status);
+  bool is_server_ready(void) const;
+  uint8_t packaging_machine_id(void) const { return packaging_machine_id_; }
+
+  // Sends the goal without waiting for the server. The goal is copied into the
+  // request and released once it is sent, it is left to the caller if the
+  // worker is busy or the server is not available
+  bool send_goal(std::unique_ptr<PackagingOrder::Goal> &&goal);
+
+  // Finishes the order a restarted machine resumed from its journal, its goal
+  // handle died with the last run and the result never comes
+  bool finish_recovered(uint32_t order_id, bool success);
+
+  // Called now and then by the manager. Gives up the order if the goal response
+  // or the result is late, or if the machine is IDLE while the order is still
+  // waited for, e.g. the node died before it journaled the goal. The worker
+  // takes the next order afterwards.
+  void check(bool machine_idle);
 
 private:
+  using Clock = std::chrono::steady_clock;
+
   std::mutex mutex_;
 
-  uint8_t packaging_machine_id_;
+  rclcpp::Node *node_;
+  const uint8_t packaging_machine_id_;
   uint32_t order_id_;
   uint32_t material_box_id_;
-  std::array<PackageInfo, CELLS> print_info_;
 
   std::shared_ptr<PackagingStatus> packaging_status_;
+  bool status_changed_;
+
+  bool busy_;
+  uint64_t goal_seq_;          // the callbacks of an earlier goal are ignored
+  Clock::time_point sent_at_;
+  Clock::time_point idle_since_;
+  bool machine_idle_;          // IDLE reported since idle_since_
+  bool server_lost_;           // the action server went away during the order
 
-  bool goal_done_;
+  ResultCallback result_cb_;
 
-  rclcpp::TimerBase::SharedPtr packaging_status_timer_;
-  rclcpp::TimerBase::SharedPtr send_goal_timer_;
+  rclcpp::CallbackGroup::SharedPtr cbg_;
   rclcpp_action::Client<PackagingOrder>::SharedPtr client_ptr_;
 
-  rclcpp::Publisher<PackagingResult>::SharedPtr result_pub_;
-  rclcpp::Publisher<PackagingStatus>::SharedPtr packaging_status_pub_;
+  rclcpp::Logger get_logger(void) const { return node_->get_logger(); }
 
-  void pub_status_cb(void);
+  // false if the goal is not the current one, it was finished already
+  bool finish(uint64_t goal_seq, bool success);
 
-  void goal_response_callback(const GaolHandlerPackagingOrder::SharedPtr &goal_handle);
+  void goal_response_callback(uint64_t goal_seq, const GaolHandlerPackagingOrder::SharedPtr &goal_handle);
   void feedback_callback(
-    GaolHandlerPackagingOrder::SharedPtr,
+    uint64_t goal_seq,
     const std::shared_ptr<const PackagingOrder::Feedback> feedback);
-  void result_callback(const GaolHandlerPackagingOrder::WrappedResult &result);
+  void result_callback(uint64_t goal_seq, const GaolHandlerPackagingOrder::WrappedResult &result);
 };
 
 } // namespace action_client
 
-#endif  // PACKAGING_MACHINE_ACTION_CLIENT_HPP_
\ No newline at end of file
+#endif  // PACKAGING_MACHINE_ACTION_CLIENT_HPP_
@@ -68,7 +68,29 @@
 #define DELAY_VALVE_WAIT_FOR          250ms // wait_for delay for valves
 #define DELAY_MOTOR_WAIT_FOR          250ms // wait_for delay for motors
 #define DELAY_ORDER_START_WAIT_FOR    1s    // wait_for delay for order start
+#define DELAY_CONVEYOR_RESPONSE       1s    // manager waits for conveyor/stopper responses
+
+#define PACKAGING_STATUS_INTERVAL 500ms // changed order statuses are published at most this often
+
+#define ORDER_GOAL_RESPONSE_TIMEOUT 120s   // handle_goal waits up to 60 s for the material box before it answers
+#define ORDER_RESULT_TIMEOUT        30min  // a worker gives up the result of its order after it
+#define ORDER_IDLE_GRACE            30s    // the machine is IDLE while its worker still waits for the result
 
 #define MIN_TEMP 100
 
+#define SCHEDULER_EMA_ALPHA             0.2 // weight of the latest sample in the cycle time and wait averages
+#define SCHEDULER_HEATER_SEC_PER_DEGREE 3.0 // heating time per degree below MIN_TEMP
+
+#define METRICS_WINDOW_SEC    3600.0 // rolling window of the fleet metrics
+#define METRICS_HISTORY_HOURS 24     // hourly fleet metrics kept in the ring
+#define METRICS_MAX_SAMPLES   4096   // order samples kept in the rolling window
+
+#define JOURNAL_SYNC_EVERY 8 // journal records written before they are flushed to the disk
+
+#define LABEL_FORM_NAME "PKGLABEL" // stored form of the label layout, PKGLABEL.BAS
+
+#define PRINTER_MOCK_BYTES_PER_SEC   64000.0 // transfer rate of the mock printer backend
+#define PRINTER_MOCK_LABEL_TIME      800ms   // time the mock printer takes for a label
+#define PRINTER_MOCK_BUFFERED_LABELS 2       // labels the mock printer accepts while busy
+
 #endif  // PACKAGING_MACHINE_DEFINITION_HPP_
\ No newline at end of file
@@ -1,8 +1,13 @@
 #ifndef PACKAGING_MACHINE_NODE_HPP_
 #define PACKAGING_MACHINE_NODE_HPP_
 
+#include <array>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <functional>
 #include <future>
+#include <map>
 #include <memory>
 #include <string>
 #include <sstream>
@@ -26,6 +31,7 @@
 #include "smdps_msgs/msg/package_info.hpp"
 #include "smdps_msgs/msg/motor_status.hpp"
 #include "smdps_msgs/msg/unbind_request.hpp"
+#include "smdps_msgs/msg/packaging_result.hpp"
 
 #include "canopen_interfaces/msg/co_data.hpp"
 #include "canopen_interfaces/srv/co_read.hpp"
@@ -33,8 +39,11 @@
 
 #include "printer/config.h"
 #include "printer/printer.h"
+#include "printer/printer_backend.h"
+#include "printer/label_template.h"
 
 #include "packaging_machine_definition.hpp"
+#include "order_journal.hpp"
 
 using namespace std::chrono_literals;
 using std::placeholders::_1;
@@ -58,12 +67,22 @@ public:
   using PackageInfo = smdps_msgs::msg::PackageInfo;
   using MotorStatus = smdps_msgs::msg::MotorStatus;
   using UnbindRequest = smdps_msgs::msg::UnbindRequest;
+  using PackagingResult = smdps_msgs::msg::PackagingResult;
   using PackagingOrder = smdps_msgs::action::PackagingOrder;
 
   using GaolHandlerPackagingOrder = rclcpp_action::ServerGoalHandle<PackagingOrder>;
 
+  // Ready-to-send printer commands of an order, indexed by cell
+  struct RenderedLabels
+  {
+    std::array<std::string, CELLS> cells;
+    // the cell only holds the variables of the form stored in the printer
+    std::array<bool, CELLS> stored_form{};
+    std::string empty;
+  };
+
   explicit PackagingMachineNode(const rclcpp::NodeOptions& options);
-  ~PackagingMachineNode() = default;
+  ~PackagingMachineNode();
 
   void pub_status_cb(void);
   void heater_cb(void);
@@ -127,9 +146,16 @@ public:
   void wait_for_roller(const uint8_t target_state);
   void wait_for_pkg_len(const uint8_t target_state);
 
+  void create_printer(void);
   void init_printer_config(void);
-  std::vector<std::string> get_print_label_cmd(std::string name, int total, int current);
-  std::vector<std::string> get_print_label_cmd(PackageInfo msg);
+  void get_print_label_cmd(const PackageInfo &msg, std::string &buf);
+  std::shared_future<std::shared_ptr<const RenderedLabels>> prerender_labels(
+    std::shared_ptr<const PackagingOrder::Goal> goal);
+  std::shared_ptr<const RenderedLabels> take_rendered_labels(
+    std::shared_ptr<const PackagingOrder::Goal> goal);
+  // the goal is given up before its labels are taken
+  void drop_rendered_labels(uint32_t order_id);
+  void print_label(const RenderedLabels &labels, size_t index);
 
   void init_packaging_machine(void);
 
@@ -138,6 +164,22 @@ private:
 
   std::shared_ptr<Printer> printer_;
   std::shared_ptr<Config> printer_config_;
+  std::shared_ptr<LabelTemplate> label_template_;
+  bool use_stored_form_;
+  std::string stored_form_program_;
+
+  std::mutex labels_mutex_;
+  // order_id, labels rendered in the background
+  std::map<uint32_t, std::shared_future<std::shared_ptr<const RenderedLabels>>> rendered_labels_;
+  // one thread renders the goals in turn, the conversion to GBK is serialized anyway
+  std::deque<std::packaged_task<std::shared_ptr<const RenderedLabels>()>> label_tasks_;
+  std::condition_variable labels_cv_;
+  bool labels_stop_ = false;
+  std::thread label_render_thread_;
+  void label_render_worker(void);
+
+  // progress of the running order, an interrupted order is resumed from it
+  std::unique_ptr<journal::OrderJournal> journal_;
 
   bool sim_;
   bool skip_pkg_;
@@ -153,11 +195,13 @@ private:
 
   rclcpp::TimerBase::SharedPtr status_timer_;
   rclcpp::TimerBase::SharedPtr heater_timer_;
+  rclcpp::TimerBase::SharedPtr resume_timer_;
 
   rclcpp::Publisher<PackagingMachineStatus>::SharedPtr status_publisher_;
   rclcpp::Publisher<MotorStatus>::SharedPtr motor_status_publisher_;
   rclcpp::Publisher<PackagingMachineInfo>::SharedPtr info_publisher_;
   rclcpp::Publisher<UnbindRequest>::SharedPtr unbind_mtrl_box_publisher_;
+  rclcpp::Publisher<PackagingResult>::SharedPtr recovered_order_publisher_;
 
   rclcpp::Publisher<COData>::SharedPtr tpdo_pub_;
   rclcpp::Subscription<COData>::SharedPtr rpdo_sub_;
@@ -188,6 +232,14 @@ private:
 
   void order_execute(const std::shared_ptr<GaolHandlerPackagingOrder> goal_handle);
   void skip_order_execute(const std::shared_ptr<GaolHandlerPackagingOrder> goal_handle);
+  // runs the order from the steps found in done, a new order starts from an empty progress
+  bool run_order(
+    std::shared_ptr<const PackagingOrder::Goal> goal,
+    const journal::Progress &done,
+    std::shared_ptr<PackagingOrder::Feedback> feedback,
+    const std::function<void(void)> &publish_feedback);
+  // finishes the order interrupted by the last run, there is no action client for it anymore
+  void resume_order(std::shared_ptr<const journal::Progress> done);
   
   void init_handle(
     const std::shared_ptr<Trigger::Request> request, 
@@ -18,6 +18,8 @@ struct Config {
   uint8_t device_number;
 
   uint8_t port;
+  // bus-port.port..., the printer is looked up by it instead of port if set
+  std::string port_path;
   
   std::string serial;
 
@@ -32,6 +34,10 @@ struct Config {
 
   bool offset_x;
   bool offset_y;
+
+  // usb, capture or mock
+  std::string backend;
+  std::string capture_path;
 };
 
 #endif //CONFIG_H_
@@ -0,0 +1,54 @@
+#ifndef GBK_CONVERTER_H_
+#define GBK_CONVERTER_H_
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+
+#include <iconv.h>
+
+// UTF-8 to GBK converter shared by every label of a process.
+// Each thread keeps its own iconv descriptor, and converted strings are memoized
+// in a bounded LRU cache because patient names and drug lines repeat across cells.
+class GbkConverter {
+public:
+  explicit GbkConverter(size_t capacity = 512);
+
+  GbkConverter(const GbkConverter &) = delete;
+  GbkConverter &operator=(const GbkConverter &) = delete;
+
+  static GbkConverter &instance();
+
+  // Returns an empty string on failure, the same as Printer::convert_utf8_to_gbk
+  std::string convert(const std::string &utf8_string);
+
+  // Appends the converted string to out, returns false on failure
+  bool append(const std::string &utf8_string, std::string &out);
+
+  void clear();
+
+  uint64_t conversions() const { return conversions_.load(std::memory_order_relaxed); }
+  uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+private:
+  using Entry = std::pair<std::string, std::string>;
+
+  const size_t capacity_;
+
+  std::mutex mutex_;
+  std::list<Entry> lru_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+
+  std::atomic<uint64_t> conversions_{0};
+  std::atomic<uint64_t> hits_{0};
+
+  bool lookup(const std::string &utf8_string, std::string &out);
+  void insert(const std::string &utf8_string, const std::string &gbk_string);
+
+  bool convert_uncached(const std::string &utf8_string, std::string &out);
+};
+
+#endif //GBK_CONVERTER_H_
@@ -0,0 +1,117 @@
+#ifndef LABEL_TEMPLATE_H_
+#define LABEL_TEMPLATE_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// A TSPL label layout that is parsed once and rendered into a reusable buffer.
+//
+// Template syntax:
+//   ${cn_name} ${en_name} ${date} ${time} ${qr_code}  slots filled from the package info
+//   @drugs <y> <step> [max]
+//                       the following lines are repeated for every drug line,
+//                       ${drug} is the drug text and ${drug_y} is y + step * index,
+//                       a stored form holds at most max (default 8) drug lines
+//   @footer             the following lines are always rendered, even for an empty label
+//   # ...               comment
+// ${cn_name} and ${drug} are converted to GBK. Every rendered line ends with CRLF.
+//
+// The same layout can be downloaded into printer memory as a TSPL form, in which case
+// a label is only a few variable assignments followed by the form name. Stored forms
+// require every slot except ${drug_y} to be a complete quoted string, e.g. "${en_name}".
+class LabelTemplate {
+public:
+  explicit LabelTemplate(const std::string &text);
+
+  static LabelTemplate fromFile(const std::string &path);
+  static LabelTemplate defaultLayout();
+
+  // Appends the commands of one label to buf. An empty en_name renders the footer only.
+  template<typename Info>
+  void render(const Info &info, std::string &buf) const
+  {
+    render(info.cn_name, info.en_name, info.date, info.time, info.qr_code, info.drugs, buf);
+  }
+
+  void render(
+    const std::string &cn_name,
+    const std::string &en_name,
+    const std::string &date,
+    const std::string &time,
+    const std::string &qr_code,
+    const std::vector<std::string> &drugs,
+    std::string &buf) const;
+
+  void renderEmpty(std::string &buf) const;
+
+  // Layout of the stored form with the slots replaced by TSPL variables, without DOWNLOAD/EOP.
+  // Throws std::runtime_error if the layout cannot be expressed as a form.
+  std::string formProgram() const;
+
+  // Appends the variable assignments of one label and the command running the form.
+  // Returns false if the label does not fit into the form, e.g. too many drug lines.
+  template<typename Info>
+  bool renderFormValues(const Info &info, const std::string &form_name, std::string &buf) const
+  {
+    return renderFormValues(info.cn_name, info.en_name, info.date, info.time, info.qr_code, info.drugs, form_name, buf);
+  }
+
+  bool renderFormValues(
+    const std::string &cn_name,
+    const std::string &en_name,
+    const std::string &date,
+    const std::string &time,
+    const std::string &qr_code,
+    const std::vector<std::string> &drugs,
+    const std::string &form_name,
+    std::string &buf) const;
+
+  static const char *const kDefaultLayout;
+
+private:
+  enum class Slot : uint8_t {
+    LITERAL,
+    CN_NAME,
+    EN_NAME,
+    DATE,
+    TIME,
+    QR_CODE,
+    DRUG,
+    DRUG_Y,
+  };
+
+  struct Segment {
+    Slot slot;
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  std::string literals_;
+  std::vector<Segment> header_;
+  std::vector<Segment> drug_block_;
+  std::vector<Segment> footer_;
+  int drug_y_{400};
+  int drug_step_{64};
+  size_t drug_max_{8};
+  size_t reserve_{0};
+
+  std::vector<std::string> header_lines_;
+  std::vector<std::string> drug_lines_;
+  std::vector<std::string> footer_lines_;
+
+  static void appendFormLine(const std::string &line, size_t drug_index, int drug_y, std::string &buf);
+  static void appendFormValue(const char *variable, const std::string &value, bool gbk, std::string &buf);
+
+  void compileLine(const std::string &line, std::vector<Segment> &segments);
+  void appendLiteral(const std::string &text, std::vector<Segment> &segments);
+
+  void renderSegments(
+    const std::vector<Segment> &segments,
+    const std::string *const values[],
+    const std::string *drug,
+    int drug_y,
+    std::string &buf) const;
+};
+
+#endif //LABEL_TEMPLATE_H_
@@ -6,12 +6,94 @@
 #ifndef LIBUSBXX_HPP_
 #define LIBUSBXX_HPP_
 
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 #include <string>
+#include <thread>
+#include <vector>
 #include <iostream>
 #include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 
+#include <sys/time.h>
 #include <libusb-1.0/libusb.h>
 
+// Process-wide index of the attached USB devices, keyed by serial and by location.
+// It is kept current by hotplug events and shared by every libusbxx, so opening a
+// printer does not probe the serial descriptor of every other printer. Only the
+// vendor:product pairs looked up are watched, no other device on the bus is opened.
+// A location is the port path "bus-port.port...", the same path on any bus
+// "port.port..." or the first port number alone, as the packaging machines configure it.
+class UsbDeviceIndex {
+public:
+  static UsbDeviceIndex &instance();
+
+  UsbDeviceIndex(const UsbDeviceIndex &) = delete;
+  UsbDeviceIndex &operator=(const UsbDeviceIndex &) = delete;
+
+  ~UsbDeviceIndex();
+
+  libusb_context *context() const { return ctx_; }
+
+  // Returns a referenced device, or nullptr if none matches. An empty location matches any
+  // location, a location shared by several devices matches none, an empty serial matches
+  // any serial, the first of the location is taken. The caller must libusb_unref_device() it.
+  libusb_device *find(uint16_t vendor_id, uint16_t product_id, std::string_view serial, std::string_view location = {});
+
+  // Drops a device that could not be opened, e.g. it was unplugged without a hotplug event
+  void forget(libusb_device *device);
+
+private:
+  struct Entry {
+    libusb_device *device;
+    uint16_t vendor_id;
+    uint16_t product_id;
+    std::string path;                    // bus-port.port...
+    std::vector<std::string> locations;  // every location it is found by, "" included
+    std::string serial;
+    bool probed;                         // false if the serial could not be read
+  };
+
+  // a printer not found does not walk the bus more often
+  static constexpr std::chrono::seconds RESCAN_INTERVAL{2};
+
+  UsbDeviceIndex();
+
+  libusb_context *ctx_ = nullptr;
+  std::vector<libusb_hotplug_callback_handle> hotplug_handles_;
+  bool hotplug_ = false;
+
+  std::mutex mutex_;
+  std::unordered_set<uint32_t> watched_;  // vendor << 16 | product
+  std::unordered_map<libusb_device *, Entry> devices_;
+  std::unordered_map<std::string, libusb_device *> by_serial_;     // vendor:product:serial
+  std::unordered_multimap<std::string, libusb_device *> by_path_;  // vendor:product:location
+  std::vector<libusb_device *> arrived_;
+  std::chrono::steady_clock::time_point last_rescan_{};
+
+  std::atomic<bool> running_{false};
+  std::thread event_thread_;
+
+  static int LIBUSB_CALL hotplug_cb(libusb_context *ctx, libusb_device *device, libusb_hotplug_event event, void *user_data);
+
+  static std::string device_key(uint16_t vendor_id, uint16_t product_id, std::string_view id);
+
+  // false if the pair was watched already
+  bool watch(uint16_t vendor_id, uint16_t product_id);
+  bool watched(uint16_t vendor_id, uint16_t product_id);
+  bool rescan_due();
+  void rescan();
+  void add(libusb_device *device);
+  void remove(libusb_device *device);
+  void probe_arrived();
+  void event_loop();
+  libusb_device *lookup(uint16_t vendor_id, uint16_t product_id, std::string_view serial, std::string_view location);
+};
+
 class libusbxx {
   struct Deleter;
 
@@ -26,6 +108,8 @@ public:
 
   void openDevice(uint16_t vendor_id, uint16_t product_id, std::string_view serial, uint8_t port);
 
+  void openDevice(uint16_t vendor_id, uint16_t product_id, std::string_view serial, std::string_view location);
+
   template<typename T, typename = typename std::enable_if<
     std::is_convertible<decltype(std::declval<T>().data()), const uint8_t*>::value &&
     std::is_convertible<decltype(std::declval<T>().size()), std::size_t>::value
@@ -39,254 +123,468 @@ public:
 private:
   void init() const;
 
+  void open(uint16_t vendor_id, uint16_t product_id, std::string_view serial, std::string_view location);
+
   libusb_context *ctx_ = nullptr;
 
   libusb_device_handle *handle_ = nullptr;
 };
 
-template<typename T, typename = typename std::enable_if<
-  std::is_convertible<decltype(std::declval<T>().data()), const uint8_t*>::value &&
-  std::is_convertible<decltype(std::declval<T>().size()), std::size_t>::value
->::type>
-int libusbxx::bulkTransfer(uint8_t endpoint, T data, unsigned int timeout) 
+// ===================================== UsbDeviceIndex =====================================
+inline UsbDeviceIndex &UsbDeviceIndex::instance()
 {
-  return bulkTransfer(endpoint, data.data(), data.size(), timeout);
+  static UsbDeviceIndex index;
+  return index;
 }
 
-inline libusbxx::libusbxx(int log_level) 
+inline UsbDeviceIndex::UsbDeviceIndex()
 {
-  if (int r = libusb_init(&ctx_); r < 0) 
+  if (int r = libusb_init(&ctx_); r < 0)
   {
     throw std::runtime_error(std::string("init failed ") + libusb_error_name(r));
   }
 
-  // 设置调试级别
-  libusb_set_option(ctx_, LIBUSB_OPTION_LOG_LEVEL, log_level);
+  // 热插拔回调在 watch() 中按 vendor:product 注册
+  hotplug_ = libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG);
+  if (hotplug_)
+  {
+    running_ = true;
+    event_thread_ = std::thread(&UsbDeviceIndex::event_loop, this);
+  }
 }
 
-inline libusbxx::~libusbxx() 
+inline UsbDeviceIndex::~UsbDeviceIndex()
 {
-  if (handle_ != nullptr) 
+  if (running_.exchange(false))
   {
-    // 释放接口
-    libusb_release_interface(handle_, 0);
+    libusb_interrupt_event_handler(ctx_);
+    event_thread_.join();
+  }
+
+  for (auto handle : hotplug_handles_)
+    libusb_hotplug_deregister_callback(ctx_, handle);
 
-#ifndef IS_WIN32
-  // 重新附加内核驱动程序（如果之前分离了）
-  if (libusb_kernel_driver_active(handle_, 0)) 
   {
-      libusb_attach_kernel_driver(handle_, 0);
-  }
-#endif
-    libusb_close(handle_);
+    const std::lock_guard<std::mutex> lock(mutex_);
+    for (auto device : arrived_)
+      libusb_unref_device(device);
+    for (auto &[device, entry] : devices_)
+      libusb_unref_device(device);
+    arrived_.clear();
+    devices_.clear();
   }
 
-  if (ctx_ != nullptr) 
+  libusb_exit(ctx_);
+}
+
+inline int LIBUSB_CALL UsbDeviceIndex::hotplug_cb(libusb_context *ctx, libusb_device *device, libusb_hotplug_event event, void *user_data)
+{
+  (void) ctx;
+  auto *self = static_cast<UsbDeviceIndex *>(user_data);
+
+  const std::lock_guard<std::mutex> lock(self->mutex_);
+  if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)
+  {
+    // 回调中不能打开设备, 序列号在事件线程中读取
+    self->arrived_.push_back(libusb_ref_device(device));
+  }
+  else if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT)
   {
-    libusb_exit(ctx_);
+    self->remove(device);
   }
+
+  return 0;
 }
 
-inline void libusbxx::init() const 
+inline std::string UsbDeviceIndex::device_key(uint16_t vendor_id, uint16_t product_id, std::string_view id)
+{
+  return std::to_string(vendor_id) + ":" + std::to_string(product_id) + ":" + std::string(id);
+}
+
+inline bool UsbDeviceIndex::watch(uint16_t vendor_id, uint16_t product_id)
 {
-#ifndef IS_WIN32
-  // 检查并分离内核驱动程序（如果需要）
-  if (libusb_kernel_driver_active(handle_, 0)) 
   {
-    if (auto r = libusb_detach_kernel_driver(handle_, 0); r < 0) 
-    {
-      // throw std::runtime_error(std::format("kernel driver detach failed: {}", libusb_error_name(r)));
-      throw std::runtime_error("kernel driver detach failed: " + std::string(libusb_error_name(r)));
-    }
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (!watched_.insert(static_cast<uint32_t>(vendor_id) << 16 | product_id).second)
+      return false;
   }
-#endif
-  // 声明接口 0
-  if (auto r = libusb_claim_interface(handle_, 0); r < 0) 
+
+  if (!hotplug_)
+    return true;
+
+  // LIBUSB_HOTPLUG_ENUMERATE 会为已连接的设备触发 arrived 事件, 回调会加锁, 此处不能持有 mutex_
+  libusb_hotplug_callback_handle handle{};
+  auto r = libusb_hotplug_register_callback(ctx_,
+    LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+    LIBUSB_HOTPLUG_ENUMERATE,
+    vendor_id, product_id, LIBUSB_HOTPLUG_MATCH_ANY,
+    &UsbDeviceIndex::hotplug_cb, this, &handle);
+  if (r != LIBUSB_SUCCESS)
   {
-    // throw std::runtime_error(std::format("claim failed: {}", libusb_error_name(r)));
-    throw std::runtime_error("claim failed: " + std::string(libusb_error_name(r)));
+    std::cerr << "hotplug register failed: " << libusb_error_name(r) << std::endl;
+    return true;
   }
+
+  const std::lock_guard<std::mutex> lock(mutex_);
+  hotplug_handles_.push_back(handle);
+  return true;
 }
 
-inline int libusbxx::bulkTransfer(uint8_t endpoint, std::string data, unsigned int timeout) const 
+inline bool UsbDeviceIndex::watched(uint16_t vendor_id, uint16_t product_id)
 {
-  return bulkTransfer(endpoint, reinterpret_cast<uint8_t *>(data.data()), data.length(), timeout);
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return watched_.count(static_cast<uint32_t>(vendor_id) << 16 | product_id) != 0;
 }
 
-inline int libusbxx::bulkTransfer(uint8_t endpoint, uint8_t data[], int length, unsigned int timeout) const 
+inline void UsbDeviceIndex::event_loop()
 {
-  // 向设备传输数据
-  int transferred{};
-  auto r = libusb_bulk_transfer(handle_, endpoint, data, length, &transferred, timeout);
-  if (r != LIBUSB_SUCCESS || transferred != length) 
+  while (running_)
   {
-      // throw std::runtime_error(std::format("transfer failed: {}", libusb_error_name(r)));
-      throw std::runtime_error("transfer failed: " + std::string(libusb_error_name(r)));
+    timeval tv{0, 200000};
+    libusb_handle_events_timeout_completed(ctx_, &tv, nullptr);
+    probe_arrived();
   }
-
-  return transferred;
 }
 
-inline void libusbxx::openDevice(uint16_t vendor_id, uint16_t product_id) 
+inline void UsbDeviceIndex::probe_arrived()
 {
-  handle_ = libusb_open_device_with_vid_pid(ctx_, vendor_id, product_id);
-  if (handle_ == nullptr) 
+  std::vector<libusb_device *> arrived;
   {
-    // throw std::runtime_error(std::format("Device {}:{} open failed", vendor_id, product_id));
-    throw std::runtime_error("Device " + std::to_string(vendor_id) + ":" + std::to_string(product_id) + "open failed");
+    const std::lock_guard<std::mutex> lock(mutex_);
+    arrived.swap(arrived_);
   }
 
-  init();
+  for (auto device : arrived)
+  {
+    add(device);
+    libusb_unref_device(device);
+  }
+}
+
+inline bool UsbDeviceIndex::rescan_due()
+{
+  const auto now = std::chrono::steady_clock::now();
+
+  const std::lock_guard<std::mutex> lock(mutex_);
+  if (now - last_rescan_ < RESCAN_INTERVAL)
+    return false;
+
+  last_rescan_ = now;
+  return true;
 }
 
-inline void libusbxx::openDevice(uint16_t vendor_id, uint16_t product_id, std::string_view serial) 
+// adds the new devices and probes again those whose serial could not be read
+inline void UsbDeviceIndex::rescan()
 {
-  libusb_device_handle *handle = nullptr;
   libusb_device **list = nullptr;
 
-  // 获取设备列表
   auto cnt = libusb_get_device_list(ctx_, &list);
-  if (cnt < 0) 
+  if (cnt < 0)
   {
-    // throw std::runtime_error(std::format("Failed to get device list: {}", libusb_error_name(cnt)));
     throw std::runtime_error("Failed to get device list: " + std::string(libusb_error_name(cnt)));
   }
 
-  for (ssize_t i = 0; i < cnt; i++) 
+  for (ssize_t i = 0; i < cnt; i++)
   {
-    libusb_device *device = list[i];
-    libusb_device_descriptor desc{};
-    auto r = libusb_get_device_descriptor(device, &desc);
-    if (r < 0) 
+    bool known = false;
     {
-      std::cerr << libusb_error_name(r) << std::endl;
-      continue;
+      const std::lock_guard<std::mutex> lock(mutex_);
+      auto it = devices_.find(list[i]);
+      known = it != devices_.end() && it->second.probed;
     }
 
-    if (desc.idVendor == vendor_id && desc.idProduct == product_id)
-    {
-      r = libusb_open(device, &handle);
-      if (r < 0) 
-      {
-          // std::cerr << std::format("Device {}:{}, serial: {} open failed: {}", vendor_id, product_id, serial,
-          //                          libusb_error_name(r)) << std::endl;
-          std::cerr << "Device" + std::to_string(vendor_id) + ":" + std::to_string(product_id) +
-                        ", serial: " + std::string(serial) + " open failed: " + std::string(libusb_error_name(r))
-                        << std::endl;
-          continue;
-      }
+    if (!known)
+      add(list[i]);
+  }
+
+  libusb_free_device_list(list, 1);
+}
+
+inline void UsbDeviceIndex::add(libusb_device *device)
+{
+  Entry entry{device, 0, 0, "", {}, "", false};
 
+  libusb_device_descriptor desc{};
+  auto r = libusb_get_device_descriptor(device, &desc);
+  if (r < 0)
+  {
+    std::cerr << libusb_error_name(r) << std::endl;
+    return;
+  }
+  entry.vendor_id = desc.idVendor;
+  entry.product_id = desc.idProduct;
+
+  // hubs, keyboards and the like are not opened
+  if (!watched(entry.vendor_id, entry.product_id))
+    return;
+
+  uint8_t ports[8]; // Maximum depth of USB port hierarchy is 7
+  r = libusb_get_port_numbers(device, ports, sizeof(ports));
+  if (r > 0)
+  {
+    std::string chain;
+    for (int i = 0; i < r; i++)
+      chain += (i == 0 ? "" : ".") + std::to_string(ports[i]);
+    entry.path = std::to_string(libusb_get_bus_number(device)) + "-" + chain;
+
+    entry.locations.push_back(entry.path);
+    entry.locations.push_back(chain);
+    if (r > 1)
+      entry.locations.push_back(std::to_string(ports[0]));
+  }
+  entry.locations.push_back("");
+
+  // 读取序列号需要打开设备, 每个设备只读取一次
+  if (desc.iSerialNumber != 0)
+  {
+    libusb_device_handle *handle = nullptr;
+    if (libusb_open(device, &handle) == LIBUSB_SUCCESS)
+    {
       unsigned char serial_number[256];
       r = libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber, serial_number, sizeof(serial_number));
-      if (r < 0) 
+      if (r >= 0)
       {
-        libusb_close(handle);
-        throw std::runtime_error("Failed to get serial number: " + std::string(libusb_error_name(r)));
+        entry.serial.assign(reinterpret_cast<char *>(serial_number), r);
+        entry.probed = true;
       }
+      libusb_close(handle);
+    }
+  }
+  else
+  {
+    entry.probed = true;
+  }
+
+  const std::lock_guard<std::mutex> lock(mutex_);
+  remove(device);
+
+  libusb_ref_device(device);
+  if (!entry.serial.empty())
+    by_serial_[device_key(entry.vendor_id, entry.product_id, entry.serial)] = device;
+  for (const auto &location : entry.locations)
+    by_path_.emplace(device_key(entry.vendor_id, entry.product_id, location), device);
+  devices_.emplace(device, std::move(entry));
+}
+
+// mutex_ must be held
+inline void UsbDeviceIndex::remove(libusb_device *device)
+{
+  auto it = devices_.find(device);
+  if (it == devices_.end())
+    return;
+
+  const Entry &entry = it->second;
+  if (!entry.serial.empty())
+  {
+    auto serial_it = by_serial_.find(device_key(entry.vendor_id, entry.product_id, entry.serial));
+    if (serial_it != by_serial_.end() && serial_it->second == device)
+      by_serial_.erase(serial_it);
+  }
+  for (const auto &location : entry.locations)
+  {
+    auto range = by_path_.equal_range(device_key(entry.vendor_id, entry.product_id, location));
+    auto path_it = std::find_if(range.first, range.second, [device](const auto &item) { return item.second == device; });
+    if (path_it != range.second)
+      by_path_.erase(path_it);
+  }
+
+  devices_.erase(it);
+  libusb_unref_device(device);
+}
+
+inline void UsbDeviceIndex::forget(libusb_device *device)
+{
+  const std::lock_guard<std::mutex> lock(mutex_);
+  remove(device);
+}
+
+inline libusb_device *UsbDeviceIndex::lookup(uint16_t vendor_id, uint16_t product_id, std::string_view serial, std::string_view location)
+{
+  const std::lock_guard<std::mutex> lock(mutex_);
+
+  libusb_device *device = nullptr;
+  if (!serial.empty())
+  {
+    auto it = by_serial_.find(device_key(vendor_id, product_id, serial));
+    if (it != by_serial_.end())
+    {
+      const auto &locations = devices_.at(it->second).locations;
+      if (std::find(locations.begin(), locations.end(), location) != locations.end())
+        device = it->second;
+    }
+  }
+  else
+  {
+    auto range = by_path_.equal_range(device_key(vendor_id, product_id, location));
+    if (range.first != range.second)
+    {
+      device = range.first->second;
 
-      if (serial == reinterpret_cast<char *>(serial_number)) 
+      // e.g. two printers behind a hub on the configured port, either could be taken
+      if (!location.empty() && std::next(range.first) != range.second)
       {
-        break; // 找到匹配的设备，跳出循环
+        std::cerr << "USB location " << location << " matches several devices, configure the port path" << std::endl;
+        device = nullptr;
       }
-
-      libusb_close(handle);
-      handle = nullptr;
     }
   }
 
-  // 释放设备列表
-  libusb_free_device_list(list, 1);
+  return device == nullptr ? nullptr : libusb_ref_device(device);
+}
 
-  if (handle == nullptr) {
-      // throw std::runtime_error(std::format("Device {}:{} ({}), not found", vendor_id, product_id, serial));
-      throw std::runtime_error("Device " + std::to_string(vendor_id) + ":" + std::to_string(product_id) + " (" +
-                                std::string(serial) + "), not found");
+inline libusb_device *UsbDeviceIndex::find(uint16_t vendor_id, uint16_t product_id, std::string_view serial, std::string_view location)
+{
+  // 首次查找的 vendor:product 立即建立索引
+  if (watch(vendor_id, product_id))
+  {
+    probe_arrived();
+    if (!hotplug_)
+      rescan();
   }
 
-  handle_ = handle;
-  init();
+  if (auto device = lookup(vendor_id, product_id, serial, location))
+    return device;
+
+  // 热插拔事件可能尚未处理, 或平台不支持热插拔
+  probe_arrived();
+  if (rescan_due())
+    rescan();
+
+  return lookup(vendor_id, product_id, serial, location);
 }
 
-inline void libusbxx::openDevice(uint16_t vendor_id, uint16_t product_id, std::string_view serial, uint8_t port) 
+// ===================================== libusbxx =====================================
+template<typename T, typename>
+int libusbxx::bulkTransfer(uint8_t endpoint, T data, unsigned int timeout)
 {
-  libusb_device_handle *handle = nullptr;
-  libusb_device **list = nullptr;
+  return bulkTransfer(endpoint, data.data(), data.size(), timeout);
+}
 
-  auto cnt = libusb_get_device_list(ctx_, &list);
-  if (cnt < 0) 
+inline libusbxx::libusbxx(int log_level)
+  : ctx_(UsbDeviceIndex::instance().context())
+{
+  // 设置调试级别
+  libusb_set_option(ctx_, LIBUSB_OPTION_LOG_LEVEL, log_level);
+}
+
+inline libusbxx::~libusbxx()
+{
+  if (handle_ != nullptr)
   {
-    // throw std::runtime_error(std::format("Failed to get device list: {}", libusb_error_name(cnt)));
-    throw std::runtime_error("Failed to get device list: " + std::string(libusb_error_name(cnt)));
+    // 释放接口
+    libusb_release_interface(handle_, 0);
+
+#ifndef IS_WIN32
+  // 重新附加内核驱动程序（如果之前分离了）
+  if (libusb_kernel_driver_active(handle_, 0))
+  {
+      libusb_attach_kernel_driver(handle_, 0);
+  }
+#endif
+    libusb_close(handle_);
   }
 
-  for (ssize_t i = 0; i < cnt; i++) 
+  // the context is owned by UsbDeviceIndex
+}
+
+inline void libusbxx::init() const
+{
+#ifndef IS_WIN32
+  // 检查并分离内核驱动程序（如果需要）
+  if (libusb_kernel_driver_active(handle_, 0))
   {
-    libusb_device *device = list[i];
-    libusb_device_descriptor desc{};
-    auto r = libusb_get_device_descriptor(device, &desc);
-    if (r < 0) 
+    if (auto r = libusb_detach_kernel_driver(handle_, 0); r < 0)
     {
-      std::cerr << libusb_error_name(r) << std::endl;
-      continue;
+      // throw std::runtime_error(std::format("kernel driver detach failed: {}", libusb_error_name(r)));
+      throw std::runtime_error("kernel driver detach failed: " + std::string(libusb_error_name(r)));
     }
+  }
+#endif
+  // 声明接口 0
+  if (auto r = libusb_claim_interface(handle_, 0); r < 0)
+  {
+    // throw std::runtime_error(std::format("claim failed: {}", libusb_error_name(r)));
+    throw std::runtime_error("claim failed: " + std::string(libusb_error_name(r)));
+  }
+}
 
-    // auto bus_num = libusb_get_bus_number(device);
-    // auto dev_num = libusb_get_device_address(device);
-    // if (!(bus_num == bus_number && dev_num == device_address))
-    //   continue;
+inline int libusbxx::bulkTransfer(uint8_t endpoint, std::string data, unsigned int timeout) const
+{
+  return bulkTransfer(endpoint, reinterpret_cast<uint8_t *>(data.data()), data.length(), timeout);
+}
 
-    uint8_t path[8]; // Maximum depth of USB port hierarchy is 7
-    r = libusb_get_port_numbers(device, path, sizeof(path));
-    if (r < 0) 
-    {
-      libusb_close(handle);
-      throw std::runtime_error("Failed to get port numbers: " + std::string(libusb_error_name(r)));
-    }
-    if (path[0] != port)
-      continue;
+inline int libusbxx::bulkTransfer(uint8_t endpoint, uint8_t data[], int length, unsigned int timeout) const
+{
+  // 向设备传输数据
+  int transferred{};
+  auto r = libusb_bulk_transfer(handle_, endpoint, data, length, &transferred, timeout);
+  if (r != LIBUSB_SUCCESS || transferred != length)
+  {
+      // throw std::runtime_error(std::format("transfer failed: {}", libusb_error_name(r)));
+      throw std::runtime_error("transfer failed: " + std::string(libusb_error_name(r)));
+  }
 
-    if (desc.idVendor == vendor_id && desc.idProduct == product_id)
-    { 
-      r = libusb_open(device, &handle);
-      if (r < 0) 
-      {
-          // std::cerr << std::format("Device {}:{}, serial: {} open failed: {}", vendor_id, product_id, serial,
-          //                          libusb_error_name(r)) << std::endl;
-          std::cerr << "Device" + std::to_string(vendor_id) + ":" + std::to_string(product_id) +
-                        ", serial: " + std::string(serial) + " open failed: " + std::string(libusb_error_name(r))
-                        << std::endl;
-          continue;
-      }
-      
+  return transferred;
+}
 
-      unsigned char serial_number[256];
-      r = libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber, serial_number, sizeof(serial_number));
-      if (r < 0) 
-      {
-        libusb_close(handle);
-        throw std::runtime_error("Failed to get serial number: " + std::string(libusb_error_name(r)));
-      }
+inline void libusbxx::open(uint16_t vendor_id, uint16_t product_id, std::string_view serial, std::string_view location)
+{
+  auto &index = UsbDeviceIndex::instance();
 
-      if (serial == reinterpret_cast<char *>(serial_number)) 
-      {
-        break;
-      }
+  // 空序列号匹配任意序列号, 同型号的打印机有多台时可能打开另一台
+  if (serial.empty())
+  {
+    std::cerr << "No serial given for device " + std::to_string(vendor_id) + ":" + std::to_string(product_id) +
+                  ", the first one found" + (location.empty() ? "" : " at " + std::string(location)) + " is opened"
+                  << std::endl;
+  }
 
-      libusb_close(handle);
-      handle = nullptr;
+  // 索引中的设备可能已拔出而未收到事件, 移除后重试一次
+  for (int attempt = 0; attempt < 2 && handle_ == nullptr; attempt++)
+  {
+    libusb_device *device = index.find(vendor_id, product_id, serial, location);
+    if (device == nullptr)
+      break;
+
+    auto r = libusb_open(device, &handle_);
+    if (r < 0)
+    {
+      std::cerr << "Device" + std::to_string(vendor_id) + ":" + std::to_string(product_id) +
+                    ", serial: " + std::string(serial) + " open failed: " + std::string(libusb_error_name(r))
+                    << std::endl;
+      handle_ = nullptr;
+      index.forget(device);
     }
+    libusb_unref_device(device);
   }
 
-  libusb_free_device_list(list, 1);
-
-  if (handle == nullptr) {
+  if (handle_ == nullptr) {
     // throw std::runtime_error(std::format("Device {}:{} ({}), not found", vendor_id, product_id, serial));
     throw std::runtime_error("Device " + std::to_string(vendor_id) + ":" + std::to_string(product_id) + " (" +
-                              std::string(serial) + "), not found");
+                              std::string(serial) + ")" + (location.empty() ? "" : " at " + std::string(location)) + ", not found");
   }
 
-  handle_ = handle;
   init();
 }
 
+inline void libusbxx::openDevice(uint16_t vendor_id, uint16_t product_id)
+{
+  open(vendor_id, product_id, "", "");
+}
+
+inline void libusbxx::openDevice(uint16_t vendor_id, uint16_t product_id, std::string_view serial)
+{
+  open(vendor_id, product_id, serial, "");
+}
+
+inline void libusbxx::openDevice(uint16_t vendor_id, uint16_t product_id, std::string_view serial, uint8_t port)
+{
+  open(vendor_id, product_id, serial, std::to_string(port));
+}
+
+inline void libusbxx::openDevice(uint16_t vendor_id, uint16_t product_id, std::string_view serial, std::string_view location)
+{
+  open(vendor_id, product_id, serial, location);
+}
+
 #endif //LIBUSBXX_HPP_
@@ -7,23 +7,27 @@
 #define PRINTER_H_
 
 #include <map>
+#include <set>
 #include <vector>
 #include <memory>
 #include <cstdint>
 #include <string_view>
 
-#include <iconv.h>
-
-class libusbxx;
+class PrinterBackend;
 
 class Printer {
 public:
   explicit Printer(uint16_t, uint16_t, std::string_view, uint8_t);
 
+  // the last argument is the USB location, e.g. the port path "1-6.2"
+  explicit Printer(uint16_t, uint16_t, std::string_view, std::string_view);
+
   explicit Printer(uint16_t, uint16_t, std::string_view);
 
   explicit Printer(uint16_t, uint16_t);
 
+  explicit Printer(std::unique_ptr<PrinterBackend> backend);
+
   ~Printer();
 
   void configure(uint8_t, uint8_t, uint32_t);
@@ -36,15 +40,38 @@ public:
 
   void runTask(const std::vector<std::string> &);
 
+  void runTask(const std::string &);
+
+  // 将标签布局以 TSPL 程序 (NAME.BAS) 下载到打印机内存, 同一会话只下载一次
+  void downloadForm(const std::string &name, const std::string &program);
+
+  bool hasForm(const std::string &name) const;
+
+  // 发送变量赋值及表单名称, 由打印机内存中的表单完成排版
+  void runForm(const std::string &cmd);
+
+  bool busy() const;
+
+  // 传输失败后为 true, 例如打印机被拔出, 需重新创建 Printer
+  bool failed() const;
+
   std::string convert_utf8_to_gbk(const std::string &utf8_string);
 
 private:
-  std::unique_ptr<libusbxx> usb_;
+  std::unique_ptr<PrinterBackend> backend_;
   std::map<std::string, std::string> default_cmd_;
+  std::string default_cmd_buf_;
+  std::string task_buf_;
+  bool default_cmd_dirty_{true};
+  bool failed_{false};
+  std::set<std::string> forms_;
 
   uint8_t endpoint_in_{};
   uint8_t endpoint_out_{};
   uint32_t timeout_{};
+
+  const std::string &defaultConfig();
+  void send(void);
 };
 
 #endif //PRINTER_H_
@@ -0,0 +1,90 @@
+#ifndef PRINTER_BACKEND_H_
+#define PRINTER_BACKEND_H_
+
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <string_view>
+
+class libusbxx;
+
+// Transport behind Printer. One write() carries one complete printer job,
+// e.g. a label, a stored form run or a form download.
+class PrinterBackend {
+public:
+  virtual ~PrinterBackend() = default;
+
+  // Throws std::runtime_error if the data cannot be delivered
+  virtual void write(uint8_t endpoint, const uint8_t *data, size_t length, uint32_t timeout) = 0;
+
+  // True while the printer is still working on earlier jobs
+  virtual bool busy() const { return false; }
+};
+
+// The USB printer, opened with the same matching rules as libusbxx::openDevice
+class UsbPrinterBackend : public PrinterBackend {
+public:
+  UsbPrinterBackend(uint16_t vendor_id, uint16_t product_id, std::string_view serial, uint8_t port);
+
+  UsbPrinterBackend(uint16_t vendor_id, uint16_t product_id, std::string_view serial, std::string_view location);
+
+  UsbPrinterBackend(uint16_t vendor_id, uint16_t product_id, std::string_view serial);
+
+  UsbPrinterBackend(uint16_t vendor_id, uint16_t product_id);
+
+  ~UsbPrinterBackend() override;
+
+  void write(uint8_t endpoint, const uint8_t *data, size_t length, uint32_t timeout) override;
+
+private:
+  std::unique_ptr<libusbxx> usb_;
+};
+
+// Records the exact byte stream into path, which may also be a named pipe.
+// Every write is indexed in <path>.idx as "<ns since open> <offset> <length>".
+class CapturePrinterBackend : public PrinterBackend {
+public:
+  explicit CapturePrinterBackend(const std::string &path);
+
+  void write(uint8_t endpoint, const uint8_t *data, size_t length, uint32_t timeout) override;
+
+  uint64_t bytes() const { return offset_; }
+
+private:
+  std::mutex mutex_;
+  std::ofstream stream_;
+  std::ofstream index_;
+  uint64_t offset_{0};
+  const std::chrono::steady_clock::time_point start_;
+};
+
+// Imitates a printer that receives bytes at a fixed rate and needs a fixed time
+// per label. A write blocks for the transfer time and, once the printer buffer
+// holds buffered_labels jobs, until the oldest one is printed. Form downloads
+// are not printed. Writes are forwarded to next if given, e.g. a capture backend.
+class ThrottledPrinterBackend : public PrinterBackend {
+public:
+  ThrottledPrinterBackend(
+    double bytes_per_second,
+    std::chrono::milliseconds label_time,
+    size_t buffered_labels = 2,
+    std::unique_ptr<PrinterBackend> next = nullptr);
+
+  void write(uint8_t endpoint, const uint8_t *data, size_t length, uint32_t timeout) override;
+
+  bool busy() const override;
+
+private:
+  const double bytes_per_second_;
+  const std::chrono::steady_clock::duration label_time_;
+  const size_t buffered_labels_;
+  std::unique_ptr<PrinterBackend> next_;
+
+  mutable std::mutex mutex_;
+  std::chrono::steady_clock::time_point busy_until_;
+};
+
+#endif //PRINTER_BACKEND_H_
@@ -6,6 +6,7 @@ from launch import LaunchDescription
 from launch_ros.actions import Node
 from launch.launch_description_sources import PythonLaunchDescriptionSource
 from launch.actions import IncludeLaunchDescription, DeclareLaunchArgument
+from launch.conditions import IfCondition, UnlessCondition
 from launch.substitutions import LaunchConfiguration
 
 def generate_launch_description():
@@ -19,6 +20,7 @@ def generate_launch_description():
     no_of_pkg_mac = LaunchConfiguration("no_of_pkg_mac")
     use_respawn = LaunchConfiguration("use_respawn")
     params_file = LaunchConfiguration("params_file")
+    use_composition = LaunchConfiguration("use_composition")
 
     declare_no_of_pkg_mac_cmd = DeclareLaunchArgument(
         "no_of_pkg_mac",
@@ -38,15 +40,37 @@ def generate_launch_description():
         description="Full path to the ROS2 parameters file to use for all launched nodes",
     )
 
+    declare_use_composition_cmd = DeclareLaunchArgument(
+        "use_composition",
+        default_value="False",
+        description="Whether to run the manager and all packaging machines in one container with intra-process comms.",
+    )
+
     ld.add_action(declare_no_of_pkg_mac_cmd)
     ld.add_action(declare_use_respawn_cmd)
     ld.add_action(declare_params_file_cmd)
+    ld.add_action(declare_use_composition_cmd)
+
+    ld.add_action(
+        IncludeLaunchDescription(
+            PythonLaunchDescriptionSource(
+                os.path.join(launch_dir, "composable.launch.py")
+            ),
+            condition=IfCondition(use_composition),
+            launch_arguments={
+                "no_of_pkg_mac": no_of_pkg_mac,
+                "params_file": params_file,
+                "use_respawn": use_respawn,
+            }.items(),
+        )
+    )
 
     ld.add_action(
         IncludeLaunchDescription(
             PythonLaunchDescriptionSource(
                 os.path.join(launch_dir, "manager.launch.py")
             ),
+            condition=UnlessCondition(use_composition),
             launch_arguments={
                 "no_of_pkg_mac": no_of_pkg_mac,
                 "params_file": params_file,
@@ -60,6 +84,7 @@ def generate_launch_description():
             PythonLaunchDescriptionSource(
                 os.path.join(launch_dir, "pkg_mac.launch.py")
             ),
+            condition=UnlessCondition(use_composition),
             launch_arguments={
                 "no_of_pkg_mac": no_of_pkg_mac,
                 "params_file": params_file,
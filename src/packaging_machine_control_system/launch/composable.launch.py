@@ -0,0 +1,108 @@
+import os
+
+from ament_index_python.packages import get_package_share_directory
+
+from launch import LaunchDescription
+from launch_ros.actions import ComposableNodeContainer
+from launch_ros.descriptions import ComposableNode
+from launch.actions import DeclareLaunchArgument, OpaqueFunction
+from launch.substitutions import LaunchConfiguration
+
+def generate_launch_description():
+    ld = LaunchDescription()
+
+    pkg_name = "packaging_machine_control_system"
+    bringup_dir = get_package_share_directory(pkg_name)
+
+    no_of_pkg_mac = LaunchConfiguration("no_of_pkg_mac")
+    use_respawn = LaunchConfiguration("use_respawn")
+    params_file = LaunchConfiguration("params_file")
+    use_latency_probe = LaunchConfiguration("use_latency_probe")
+
+    declare_no_of_pkg_mac_cmd = DeclareLaunchArgument(
+        "no_of_pkg_mac",
+        default_value="0",
+        description="Number of Packaging Machines.",
+    )
+
+    declare_use_respawn_cmd = DeclareLaunchArgument(
+        "use_respawn",
+        default_value="True",
+        description="Whether to respawn if the container crashes.",
+    )
+
+    declare_params_file_cmd = DeclareLaunchArgument(
+        "params_file",
+        default_value=os.path.join(bringup_dir, "params", "control_system.yaml"),
+        description="Full path to the ROS2 parameters file to use for all launched nodes",
+    )
+
+    declare_use_latency_probe_cmd = DeclareLaunchArgument(
+        "use_latency_probe",
+        default_value="False",
+        description="Whether to load the status latency probe into the container.",
+    )
+
+    ld.add_action(declare_no_of_pkg_mac_cmd)
+    ld.add_action(declare_use_respawn_cmd)
+    ld.add_action(declare_params_file_cmd)
+    ld.add_action(declare_use_latency_probe_cmd)
+
+    # the manager and every packaging machine share one process,
+    # topics between them are passed as pointers instead of going through DDS
+    def prepare_container(context):
+        intra_process = [{"use_intra_process_comms": True}]
+
+        nodes = [
+            ComposableNode(
+                package=pkg_name,
+                plugin="PackagingMachineManager",
+                name="manager",
+                parameters=[
+                    params_file,
+                    {"no_of_pkg_mac": int(no_of_pkg_mac.perform(context))}
+                ],
+                extra_arguments=intra_process,
+            )
+        ]
+
+        for i in range(0, int(no_of_pkg_mac.perform(context))):
+            nodes.append(
+                ComposableNode(
+                    package=pkg_name,
+                    plugin="PackagingMachineNode",
+                    namespace=f"packaging_machine_{i+1}",
+                    name="pkg_mac_node",
+                    parameters=[
+                        params_file,
+                        {"packaging_machine_id": i+1},
+                    ],
+                    extra_arguments=intra_process,
+                )
+            )
+
+        if use_latency_probe.perform(context).lower() == "true":
+            nodes.append(
+                ComposableNode(
+                    package=pkg_name,
+                    plugin="benchmark::StatusLatencyProbe",
+                    name="status_latency_probe",
+                    extra_arguments=intra_process,
+                )
+            )
+
+        container = ComposableNodeContainer(
+            name="control_system_container",
+            namespace="",
+            package="rclcpp_components",
+            executable="component_container_mt",
+            composable_node_descriptions=nodes,
+            respawn=use_respawn,
+            respawn_delay=3.0,
+            output="screen",
+        )
+        return [container]
+
+    ld.add_action(OpaqueFunction(function=prepare_container))
+
+    return ld
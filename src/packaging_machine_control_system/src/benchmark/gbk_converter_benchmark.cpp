@@ -0,0 +1,91 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <iconv.h>
+
+#include "printer/gbk_converter.h"
+
+#define CELLS 28
+
+// This executable compares the per-call iconv conversion against GbkConverter
+// on the strings of a full packaging order.
+
+namespace {
+
+std::string convert_per_call(const std::string &utf8_string)
+{
+  iconv_t cd = iconv_open("GBK", "UTF-8");
+  if (cd == (iconv_t)(-1))
+    return "";
+
+  char *in_buf = const_cast<char*>(utf8_string.c_str());
+  size_t in_bytes_left = utf8_string.size();
+  size_t out_buf_size = in_bytes_left * 2;
+  char *out_buf = new char[out_buf_size];
+  char *out_ptr = out_buf;
+  size_t out_bytes_left = out_buf_size;
+
+  size_t result = iconv(cd, &in_buf, &in_bytes_left, &out_ptr, &out_bytes_left);
+  std::string gbk_string;
+  if (result != (size_t)(-1))
+    gbk_string.assign(out_buf, out_buf_size - out_bytes_left);
+
+  delete[] out_buf;
+  iconv_close(cd);
+  return gbk_string;
+}
+
+std::vector<std::string> order_strings(void)
+{
+  std::vector<std::string> strings;
+  for (size_t i = 0; i < CELLS; i++)
+  {
+    strings.emplace_back("香港中文大學醫院");
+    strings.emplace_back("阿司匹林腸溶片   1");
+    strings.emplace_back("二甲雙胍緩釋片   2");
+    strings.emplace_back("氨氯地平片   1");
+  }
+  return strings;
+}
+
+template<typename F>
+double run(const std::vector<std::string> &strings, size_t orders, F &&func)
+{
+  size_t bytes = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t n = 0; n < orders; n++)
+  {
+    for (const auto &s : strings)
+      bytes += func(s).size();
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  if (bytes == 0)
+    std::printf("conversion failed\n");
+
+  return std::chrono::duration<double, std::micro>(end - start).count() / orders;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  const size_t orders = argc > 1 ? std::stoul(argv[1]) : 1000;
+  const auto strings = order_strings();
+
+  GbkConverter converter;
+
+  const double per_call_us = run(strings, orders, convert_per_call);
+  const double cached_us = run(strings, orders, [&](const std::string &s) { return converter.convert(s); });
+
+  std::printf("orders: %zu, strings per order: %zu\n", orders, strings.size());
+  std::printf("iconv_open per call: %10.2f us/order\n", per_call_us);
+  std::printf("GbkConverter:        %10.2f us/order\n", cached_us);
+  std::printf("conversions: %lu, cache hits: %lu\n",
+    static_cast<unsigned long>(converter.conversions()),
+    static_cast<unsigned long>(converter.hits()));
+
+  return 0;
+}
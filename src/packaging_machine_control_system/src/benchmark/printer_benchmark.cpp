@@ -0,0 +1,292 @@
+#include <map>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <stdexcept>
+
+#include <iconv.h>
+
+#include "printer/printer.h"
+#include "printer/printer_backend.h"
+#include "printer/label_template.h"
+
+#define CELLS 28
+#define FORM_NAME "PKGLABEL"
+
+// This executable prints a sample order without a printer.
+//
+//   printer_benchmark golden <dir>   compare the captured byte streams with <dir>/*.prn
+//   printer_benchmark update <dir>   rewrite the golden files
+//   printer_benchmark legacy         compare the full layout with the label of the first release
+//   printer_benchmark throughput [bytes_per_sec] [label_ms]
+//                                    print the order on the throttled mock printer
+
+namespace {
+
+struct SampleInfo {
+  std::string cn_name;
+  std::string en_name;
+  std::string date;
+  std::string time;
+  std::string qr_code;
+  std::vector<std::string> drugs;
+};
+
+std::vector<SampleInfo> sample_order(void)
+{
+  std::vector<SampleInfo> order(CELLS);
+  for (size_t i = 0; i < CELLS; i++)
+  {
+    // a few empty cells, like a real order
+    if (i % 4 == 3)
+      continue;
+
+    auto &info = order[i];
+    info.cn_name = "陳大文";
+    info.en_name = "CHAN TAI MAN";
+    info.date = "2024-12-0" + std::to_string(1 + i / 4);
+    info.time = i % 4 == 0 ? "08:00" : i % 4 == 1 ? "13:00" : "20:00";
+    info.qr_code = "ORDER-1-" + std::to_string(i);
+    info.drugs = { "阿司匹林腸溶片   1", "二甲雙胍緩釋片   2", "氨氯地平片   1" };
+  }
+  return order;
+}
+
+// the same settings as PackagingMachineNode::init_printer_config
+const std::vector<std::pair<std::string, std::string>> DEFAULT_CONFIG = {
+  { "SIZE", "75 mm,80 mm" },
+  { "GAP", "0 mm, 0mm" },
+  { "SPEED", "1" },
+  { "DENSITY", "10" },
+  { "DIRECTION", "0, 0" },
+  { "REFERENCE", "-90, -120" },
+  { "OFFSET", "0 mm" },
+  { "SHIFT", "0" },
+  { "SET", "TEAR OFF" },
+  { "CLS", "" },
+};
+
+void configure(Printer &printer)
+{
+  printer.configure(0x81, 0x01, 1000);
+  for (const auto &[name, config] : DEFAULT_CONFIG)
+    printer.addDefaultConfig(name, config);
+}
+
+size_t print_order(Printer &printer, const LabelTemplate &label_template, bool stored_form)
+{
+  if (stored_form)
+    printer.downloadForm(FORM_NAME, label_template.formProgram());
+
+  std::string label;
+  size_t labels = 0;
+  for (const auto &info : sample_order())
+  {
+    label.clear();
+    if (stored_form && label_template.renderFormValues(info, FORM_NAME, label))
+    {
+      printer.runForm(label);
+    }
+    else
+    {
+      label_template.render(info, label);
+      printer.runTask(label);
+    }
+    labels++;
+  }
+  return labels;
+}
+
+std::string read_file(const std::string &path)
+{
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs)
+    throw std::runtime_error("failed to open " + path);
+
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  return ss.str();
+}
+
+std::string capture(const std::string &path, bool stored_form)
+{
+  const auto label_template = LabelTemplate::defaultLayout();
+  {
+    Printer printer(std::make_unique<CapturePrinterBackend>(path));
+    configure(printer);
+    print_order(printer, label_template, stored_form);
+  }
+  return read_file(path);
+}
+
+int golden(const std::string &dir, bool update)
+{
+  int failed = 0;
+  for (const bool stored_form : { false, true })
+  {
+    const std::string name = stored_form ? "label_stored_form.prn" : "label_default.prn";
+    const std::string output = capture("/tmp/printer_benchmark_" + name, stored_form);
+
+    if (update)
+    {
+      std::ofstream(dir + "/" + name, std::ios::binary) << output;
+      std::printf("updated %s (%zu bytes)\n", name.c_str(), output.size());
+      continue;
+    }
+
+    const std::string expected = read_file(dir + "/" + name);
+    if (output == expected)
+    {
+      std::printf("%-24s OK\n", name.c_str());
+      continue;
+    }
+
+    size_t pos = 0;
+    while (pos < output.size() && pos < expected.size() && output[pos] == expected[pos])
+      pos++;
+    std::printf("%-24s MISMATCH at byte %zu (%zu bytes, expected %zu)\n", name.c_str(), pos, output.size(), expected.size());
+    failed = 1;
+  }
+  return failed;
+}
+
+// ===================================== legacy =====================================
+// A copy of the first release, kept apart from the code under test: iconv opened per string,
+// the commands of PackagingMachineNode::get_print_label_cmd and the default
+// settings sent before every label by Printer::runTask.
+std::string legacy_gbk(const std::string &utf8_string)
+{
+  iconv_t cd = iconv_open("GBK", "UTF-8");
+  if (cd == (iconv_t)(-1))
+    throw std::runtime_error("iconv_open failed");
+
+  char *in_buf = const_cast<char *>(utf8_string.c_str());
+  size_t in_bytes_left = utf8_string.size();
+  std::string out(in_bytes_left * 2, '\0');
+  char *out_ptr = out.data();
+  size_t out_bytes_left = out.size();
+
+  const size_t result = iconv(cd, &in_buf, &in_bytes_left, &out_ptr, &out_bytes_left);
+  iconv_close(cd);
+  if (result == (size_t)(-1))
+    throw std::runtime_error("iconv failed");
+
+  out.resize(out.size() - out_bytes_left);
+  return out;
+}
+
+std::vector<std::string> legacy_label_cmd(const SampleInfo &msg)
+{
+  std::vector<std::string> cmds{};
+  if (!msg.en_name.empty())
+  {
+    cmds.emplace_back("TEXT 240,180,\"TSS24.BF2\",0,2,2,\"" + legacy_gbk(msg.cn_name) + "\"");
+    cmds.emplace_back("TEXT 600,186,\"TSS24.BF2\",0,2,2,\"" + msg.en_name + "\"");
+    cmds.emplace_back("TEXT 240,270,\"4\",0,1,1,\"" + msg.date + "\"");
+    cmds.emplace_back("TEXT 240,334,\"4\",0,1,1,\"" + msg.time + "\"");
+    cmds.emplace_back("QRCODE 684,252,L,6,A,0,\"" + msg.qr_code + "\"");
+    for (size_t index = 0; index < msg.drugs.size(); ++index)
+    {
+      const int y = 400 + index * 64;
+      cmds.emplace_back("TEXT 240," + std::to_string(y) + ",\"TSS24.BF2\",0,2,2,\"" + legacy_gbk(msg.drugs[index]) + "\"");
+    }
+  }
+
+  cmds.emplace_back("PRINT 1,1");
+  return cmds;
+}
+
+std::string legacy_order(void)
+{
+  std::map<std::string, std::string> default_cmd;
+  for (const auto &[name, config] : DEFAULT_CONFIG)
+    default_cmd.try_emplace(name, config);
+
+  std::string stream;
+  for (const auto &info : sample_order())
+  {
+    for (const auto &[name, config] : default_cmd)
+      stream += name + " " + config + "\r\n";
+    for (const auto &command : legacy_label_cmd(info))
+      stream += command + "\r\n";
+  }
+  return stream;
+}
+
+int legacy(void)
+{
+  const std::string output = capture("/tmp/printer_benchmark_legacy.prn", false);
+  const std::string expected = legacy_order();
+  if (output == expected)
+  {
+    std::printf("%-24s OK\n", "legacy layout");
+    return 0;
+  }
+
+  size_t pos = 0;
+  while (pos < output.size() && pos < expected.size() && output[pos] == expected[pos])
+    pos++;
+  std::printf("%-24s MISMATCH at byte %zu (%zu bytes, expected %zu)\n", "legacy layout", pos, output.size(), expected.size());
+  return 1;
+}
+
+int throughput(double bytes_per_second, int label_ms)
+{
+  const auto label_template = LabelTemplate::defaultLayout();
+
+  std::printf("mock printer: %.0f bytes/s, %d ms/label\n", bytes_per_second, label_ms);
+  for (const bool stored_form : { false, true })
+  {
+    auto capture = std::make_unique<CapturePrinterBackend>("/tmp/printer_benchmark_throughput.prn");
+    const auto *captured = capture.get();
+
+    Printer printer(std::make_unique<ThrottledPrinterBackend>(
+      bytes_per_second, std::chrono::milliseconds(label_ms), 2, std::move(capture)));
+    configure(printer);
+
+    const auto start = std::chrono::steady_clock::now();
+    const size_t labels = print_order(printer, label_template, stored_form);
+    while (printer.busy())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%-12s %3zu labels, %7lu bytes, %6.2f s, %6.1f labels/min\n",
+      stored_form ? "stored form" : "full layout",
+      labels,
+      static_cast<unsigned long>(captured->bytes()),
+      seconds,
+      labels / seconds * 60);
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  const std::string mode = argc > 1 ? argv[1] : "throughput";
+
+  try
+  {
+    if ((mode == "golden" || mode == "update") && argc > 2)
+      return golden(argv[2], mode == "update");
+
+    if (mode == "legacy")
+      return legacy();
+
+    if (mode == "throughput")
+      return throughput(argc > 2 ? std::stod(argv[2]) : 64000.0, argc > 3 ? std::stoi(argv[3]) : 50);
+  }
+  catch (const std::exception &e)
+  {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+
+  std::fprintf(stderr, "usage: %s golden|update <dir> | legacy | throughput [bytes_per_sec] [label_ms]\n", argv[0]);
+  return 2;
+}
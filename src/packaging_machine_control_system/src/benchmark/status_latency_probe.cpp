@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
+
+#include "smdps_msgs/msg/packaging_machine_status.hpp"
+
+// Measures the delay between PackagingMachineNode stamping a status message and
+// this node receiving it. Run it as a separate process against the multi-process
+// layout, or load it into the container of composable.launch.py to measure the
+// intra-process path, and compare the reported percentiles.
+
+namespace benchmark
+{
+
+class StatusLatencyProbe : public rclcpp::Node
+{
+  using PackagingMachineStatus = smdps_msgs::msg::PackagingMachineStatus;
+
+public:
+  explicit StatusLatencyProbe(const rclcpp::NodeOptions &options)
+  : Node("status_latency_probe", options)
+  {
+    this->declare_parameter<std::string>("topic", "/packaging_machine_status");
+    this->declare_parameter<int>("report_every", 20);
+
+    const std::string topic = this->get_parameter("topic").as_string();
+    report_every_ = std::max<int64_t>(1, this->get_parameter("report_every").as_int());
+    samples_.reserve(report_every_);
+
+    sub_ = this->create_subscription<PackagingMachineStatus>(
+      topic,
+      10,
+      [this](PackagingMachineStatus::UniquePtr msg) { status_cb(std::move(msg)); });
+
+    RCLCPP_INFO(this->get_logger(), "Measuring %s, intra-process: %s",
+      topic.c_str(),
+      options.use_intra_process_comms() ? "on" : "off");
+  }
+
+private:
+  size_t report_every_;
+  std::vector<double> samples_;
+  rclcpp::Subscription<PackagingMachineStatus>::SharedPtr sub_;
+
+  void status_cb(PackagingMachineStatus::UniquePtr msg)
+  {
+    const rclcpp::Duration latency = this->get_clock()->now() - rclcpp::Time(msg->header.stamp);
+    samples_.push_back(latency.nanoseconds() / 1000.0);
+
+    if (samples_.size() < report_every_)
+      return;
+
+    std::sort(samples_.begin(), samples_.end());
+    auto percentile = [this](double p) {
+      return samples_[static_cast<size_t>(p * (samples_.size() - 1))];
+    };
+
+    double sum = 0;
+    for (const auto sample : samples_)
+      sum += sample;
+
+    RCLCPP_INFO(this->get_logger(),
+      "latency over %zu msgs (us): mean %.1f, p50 %.1f, p95 %.1f, p99 %.1f, max %.1f",
+      samples_.size(),
+      sum / samples_.size(),
+      percentile(0.50),
+      percentile(0.95),
+      percentile(0.99),
+      samples_.back());
+
+    samples_.clear();
+  }
+};
+
+} // namespace benchmark
+
+RCLCPP_COMPONENTS_REGISTER_NODE(benchmark::StatusLatencyProbe)
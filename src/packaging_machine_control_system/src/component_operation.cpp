@@ -315,6 +315,47 @@ bool PackagingMachineNode::read_pkg_len_ctrl(std::shared_ptr<uint32_t> data)
 }
 
 // ===================================== printer =====================================
+void PackagingMachineNode::create_printer()
+{
+  // the printer and the forms downloaded to it are kept over the goals until a write fails,
+  // e.g. the printer was unplugged, then it is opened again
+  if (printer_ && !printer_->failed())
+    return;
+
+  if (printer_)
+    RCLCPP_WARN(this->get_logger(), "The last write to the printer failed, reopening it");
+  printer_.reset();
+
+  if (printer_config_->backend == "capture")
+  {
+    printer_ = std::make_shared<Printer>(std::make_unique<CapturePrinterBackend>(printer_config_->capture_path));
+  }
+  else if (printer_config_->backend == "mock")
+  {
+    printer_ = std::make_shared<Printer>(std::make_unique<ThrottledPrinterBackend>(
+      PRINTER_MOCK_BYTES_PER_SEC, 
+      PRINTER_MOCK_LABEL_TIME, 
+      PRINTER_MOCK_BUFFERED_LABELS, 
+      std::make_unique<CapturePrinterBackend>(printer_config_->capture_path)));
+  }
+  else if (!printer_config_->port_path.empty())
+  {
+    printer_ = std::make_shared<Printer>(
+      printer_config_->vendor_id, 
+      printer_config_->product_id, 
+      printer_config_->serial,
+      std::string_view(printer_config_->port_path));
+  }
+  else
+  {
+    printer_ = std::make_shared<Printer>(
+      printer_config_->vendor_id, 
+      printer_config_->product_id, 
+      printer_config_->serial,
+      printer_config_->port);
+  }
+}
+
 void PackagingMachineNode::init_printer_config()
 {
   printer_->configure(printer_config_->endpoint_in, printer_config_->endpoint_out, printer_config_->timeout);
@@ -332,39 +373,115 @@ void PackagingMachineNode::init_printer_config()
   printer_->addDefaultConfig("SET", "CUTTER OFF");
   printer_->addDefaultConfig("SET", "PARTIAL_CUTTER OFF");
   printer_->addDefaultConfig("CLS");
+
+  // the settings above change nothing on a kept printer, the form is only downloaded once
+  if (use_stored_form_ && !printer_->hasForm(LABEL_FORM_NAME))
+  {
+    printer_->downloadForm(LABEL_FORM_NAME, stored_form_program_);
+    RCLCPP_DEBUG(this->get_logger(), "downloaded the label form");
+  }
 }
 
-std::vector<std::string> PackagingMachineNode::get_print_label_cmd(PackageInfo msg)
+void PackagingMachineNode::get_print_label_cmd(const PackageInfo &msg, std::string &buf)
 {
-  std::vector<std::string> cmds{};
+  buf.clear();
   if (!msg.en_name.empty())
-  {
     RCLCPP_INFO(this->get_logger(), "Add a english name: %s", msg.en_name.c_str());
 
-    std::string gbk_cn = printer_->convert_utf8_to_gbk(msg.cn_name);
-    std::string cn = "TEXT 240,180,\"TSS24.BF2\",0,2,2,\"" + gbk_cn + "\"";
-    cmds.emplace_back(cn);
-    std::string en = "TEXT 600,186,\"TSS24.BF2\",0,2,2,\"" + msg.en_name + "\"";
-    cmds.emplace_back(en);
-    std::string d = "TEXT 240,270,\"4\",0,1,1,\"" + msg.date + "\"";
-    cmds.emplace_back(d);
-    std::string t = "TEXT 240,334,\"4\",0,1,1,\"" + msg.time + "\"";
-    cmds.emplace_back(t);
-    cmds.emplace_back("QRCODE 684,252,L,6,A,0,\"" + msg.qr_code + "\"");
-    for (size_t index = 0; index < msg.drugs.size(); ++index) 
+  label_template_->render(msg, buf);
+  RCLCPP_DEBUG(this->get_logger(), "printer commands are ready");
+}
+
+std::shared_future<std::shared_ptr<const PackagingMachineNode::RenderedLabels>> PackagingMachineNode::prerender_labels(
+  std::shared_ptr<const PackagingOrder::Goal> goal)
+{
+  auto label_template = label_template_;
+  const bool use_stored_form = use_stored_form_;
+
+  std::packaged_task<std::shared_ptr<const RenderedLabels>()> render([goal, label_template, use_stored_form]() {
+    auto labels = std::make_shared<RenderedLabels>();
+    for (size_t i = 0; i < CELLS; i++)
     {
-      std::string utf_md = msg.drugs[index];
-      std::string gbk_md = printer_->convert_utf8_to_gbk(utf_md);
-      int y = 400 + index * 64;
-      std::string y_label = std::to_string(y);
-      std::string m = "TEXT 240,"+ y_label + ",\"TSS24.BF2\",0,2,2,\"" + gbk_md + "\"";
-      cmds.emplace_back(m);
+      if (goal->print_info[i].en_name.empty())
+        continue;
+
+      // fall back to the full layout if the label does not fit into the form
+      if (use_stored_form && label_template->renderFormValues(goal->print_info[i], LABEL_FORM_NAME, labels->cells[i]))
+        labels->stored_form[i] = true;
+      else
+        label_template->render(goal->print_info[i], labels->cells[i]);
     }
+
+    label_template->renderEmpty(labels->empty);
+    return std::shared_ptr<const RenderedLabels>(labels);
+  });
+
+  auto future = render.get_future().share();
+  {
+    const std::lock_guard<std::mutex> lock(labels_mutex_);
+    rendered_labels_[goal->order_id] = future;
+    label_tasks_.push_back(std::move(render));
   }
+  labels_cv_.notify_one();
+  return future;
+}
 
-  cmds.emplace_back("PRINT 1,1");
-  RCLCPP_DEBUG(this->get_logger(), "printer commands are ready");
-  return cmds;
+void PackagingMachineNode::label_render_worker(void)
+{
+  std::unique_lock<std::mutex> lock(labels_mutex_);
+
+  while (true)
+  {
+    labels_cv_.wait(lock, [this]() { return labels_stop_ || !label_tasks_.empty(); });
+    if (labels_stop_)
+      break;
+
+    auto render = std::move(label_tasks_.front());
+    label_tasks_.pop_front();
+
+    // an exception is kept in the future for take_rendered_labels
+    lock.unlock();
+    render();
+    lock.lock();
+  }
+}
+
+void PackagingMachineNode::drop_rendered_labels(uint32_t order_id)
+{
+  const std::lock_guard<std::mutex> lock(labels_mutex_);
+  rendered_labels_.erase(order_id);
+}
+
+std::shared_ptr<const PackagingMachineNode::RenderedLabels> PackagingMachineNode::take_rendered_labels(
+  std::shared_ptr<const PackagingOrder::Goal> goal)
+{
+  std::shared_future<std::shared_ptr<const RenderedLabels>> future;
+  {
+    const std::lock_guard<std::mutex> lock(labels_mutex_);
+    auto it = rendered_labels_.find(goal->order_id);
+    if (it != rendered_labels_.end())
+    {
+      future = it->second;
+      rendered_labels_.erase(it);
+    }
+  }
+
+  if (!future.valid())
+  {
+    RCLCPP_WARN(this->get_logger(), "Labels of order %u were not rendered in advance", goal->order_id);
+    future = prerender_labels(goal);
+    drop_rendered_labels(goal->order_id);
+  }
+
+  return future.get();
+}
+
+void PackagingMachineNode::print_label(const RenderedLabels &labels, size_t index)
+{
+  if (labels.stored_form[index])
+    printer_->runForm(labels.cells[index]);
+  else
+    printer_->runTask(labels.cells[index]);
 }
 
 // ===================================== wait for =====================================
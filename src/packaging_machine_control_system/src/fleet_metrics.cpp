@@ -0,0 +1,217 @@
+#include "packaging_machine_control_system/fleet_metrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace metrics
+{
+
+FleetMetrics::FleetMetrics(size_t no_of_machines)
+{
+  MachineClock clock;
+  clock.activity = Activity::OTHER;
+  clock.since = -1.0;
+  clock.minutes.fill(MinuteBucket{-1, 0.0, 0.0});
+  machines_.assign(no_of_machines, clock);
+
+  hours_.fill(HourSlot{-1, 0, 0, 0.0, 0.0, 0.0, 0, 0.0, 0.0});
+}
+
+void FleetMetrics::on_dispatched(uint32_t order_id, double queue_wait, double now)
+{
+  dispatched_at_[order_id] = now;
+
+  queue_waits_.push_back(Sample{now, queue_wait});
+  if (queue_waits_.size() > METRICS_MAX_SAMPLES)
+    queue_waits_.pop_front();
+
+  HourSlot &slot = hour_slot(now);
+  slot.queue_wait_sum += queue_wait;
+  slot.queue_waits++;
+}
+
+void FleetMetrics::on_result(uint32_t order_id, bool success, double now)
+{
+  auto it = dispatched_at_.find(order_id);
+  if (it == dispatched_at_.end())
+    return;
+
+  const double cycle_time = now - it->second;
+  dispatched_at_.erase(it);
+
+  HourSlot &slot = hour_slot(now);
+  if (!success)
+  {
+    failures_.push_back(now);
+    if (failures_.size() > METRICS_MAX_SAMPLES)
+      failures_.pop_front();
+    slot.failed++;
+    return;
+  }
+
+  cycle_times_.push_back(Sample{now, cycle_time});
+  if (cycle_times_.size() > METRICS_MAX_SAMPLES)
+    cycle_times_.pop_front();
+
+  slot.completed++;
+  slot.cycle_time_sum += cycle_time;
+  slot.cycle_time_max = std::max(slot.cycle_time_max, cycle_time);
+}
+
+void FleetMetrics::on_machine_state(uint8_t machine_id, Activity activity, double now)
+{
+  if (machine_id == 0 || machine_id > machines_.size())
+    return;
+
+  MachineClock &machine = machines_[machine_id - 1];
+  accrue(machine, now);
+  machine.activity = activity;
+}
+
+Summary FleetMetrics::summarize(double now)
+{
+  for (auto &machine : machines_)
+    accrue(machine, now);
+
+  prune(now);
+
+  Summary summary;
+  summary.completed = cycle_times_.size();
+  summary.failed = failures_.size();
+
+  // a window not filled yet is scaled up from the oldest sample
+  double covered = METRICS_WINDOW_SEC;
+  if (!cycle_times_.empty())
+    covered = std::min(covered, std::max(now - cycle_times_.front().time, 60.0));
+  summary.orders_per_hour = summary.completed * 3600.0 / covered;
+
+  std::vector<double> values;
+  values.reserve(cycle_times_.size());
+  for (const auto &sample : cycle_times_)
+    values.push_back(sample.value);
+  summary.cycle_time_p50 = percentile(values, 0.50);
+  summary.cycle_time_p95 = percentile(values, 0.95);
+  summary.cycle_time_p99 = percentile(values, 0.99);
+
+  values.clear();
+  double wait_sum = 0.0;
+  for (const auto &sample : queue_waits_)
+  {
+    values.push_back(sample.value);
+    wait_sum += sample.value;
+  }
+  summary.queue_wait_mean = values.empty() ? 0.0 : wait_sum / values.size();
+  summary.queue_wait_p95 = percentile(values, 0.95);
+
+  const int64_t first_minute = static_cast<int64_t>(std::floor((now - METRICS_WINDOW_SEC) / 60.0));
+  for (const auto &machine : machines_)
+  {
+    double busy = 0.0;
+    double idle = 0.0;
+    for (const auto &bucket : machine.minutes)
+    {
+      if (bucket.minute < first_minute)
+        continue;
+      busy += bucket.busy_sec;
+      idle += bucket.idle_sec;
+    }
+    summary.utilization.push_back(busy + idle > 0.0 ? busy / (busy + idle) : 0.0);
+  }
+
+  return summary;
+}
+
+std::vector<HourSlot> FleetMetrics::history(void) const
+{
+  std::vector<HourSlot> slots;
+  for (const auto &slot : hours_)
+  {
+    if (slot.hour >= 0)
+      slots.push_back(slot);
+  }
+
+  std::sort(slots.begin(), slots.end(),
+    [](const HourSlot &a, const HourSlot &b) { return a.hour < b.hour; });
+  return slots;
+}
+
+HourSlot &FleetMetrics::hour_slot(double time)
+{
+  const int64_t hour = static_cast<int64_t>(std::floor(time / 3600.0));
+  HourSlot &slot = hours_[hour % METRICS_HISTORY_HOURS];
+  if (slot.hour != hour)
+    slot = HourSlot{hour, 0, 0, 0.0, 0.0, 0.0, 0, 0.0, 0.0};
+
+  return slot;
+}
+
+void FleetMetrics::accrue(MachineClock &machine, double now)
+{
+  if (machine.since < 0.0 || machine.activity == Activity::OTHER)
+  {
+    machine.since = now;
+    return;
+  }
+
+  // split the time at minute boundaries, they are hour boundaries too
+  double t = machine.since;
+  while (t < now)
+  {
+    const int64_t minute = static_cast<int64_t>(std::floor(t / 60.0));
+    const double end = std::min(now, (minute + 1) * 60.0);
+    const double elapsed = end - t;
+
+    MinuteBucket &bucket = machine.minutes[minute % machine.minutes.size()];
+    if (bucket.minute != minute)
+      bucket = MinuteBucket{minute, 0.0, 0.0};
+
+    HourSlot &slot = hour_slot(t);
+    if (machine.activity == Activity::BUSY)
+    {
+      bucket.busy_sec += elapsed;
+      slot.busy_sec += elapsed;
+    }
+    else
+    {
+      bucket.idle_sec += elapsed;
+      slot.idle_sec += elapsed;
+    }
+
+    t = end;
+  }
+
+  machine.since = now;
+}
+
+void FleetMetrics::prune(double now)
+{
+  const double begin = now - METRICS_WINDOW_SEC;
+
+  while (!cycle_times_.empty() && cycle_times_.front().time < begin)
+    cycle_times_.pop_front();
+  while (!failures_.empty() && failures_.front() < begin)
+    failures_.pop_front();
+  while (!queue_waits_.empty() && queue_waits_.front().time < begin)
+    queue_waits_.pop_front();
+
+  // an order without result for a whole window is not coming back
+  for (auto it = dispatched_at_.begin(); it != dispatched_at_.end();)
+  {
+    if (it->second < begin)
+      it = dispatched_at_.erase(it);
+    else
+      ++it;
+  }
+}
+
+double FleetMetrics::percentile(std::vector<double> &values, double p)
+{
+  if (values.empty())
+    return 0.0;
+
+  const size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+} // namespace metrics
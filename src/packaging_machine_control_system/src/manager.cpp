@@ -1,32 +1,29 @@
 #include "packaging_machine_control_system/manager.hpp"
 
-PackagingMachineManager::PackagingMachineManager(
-  std::weak_ptr<rclcpp::Executor> executor,
-  const std::string &node_name, 
-  const std::string &node_namespace,
-  const rclcpp::NodeOptions &options) 
-: Node(std::move(node_name), node_namespace, options),
-  executor_(executor)
+PackagingMachineManager::PackagingMachineManager(const rclcpp::NodeOptions &options) 
+: Node("packaging_machine_manager", options)
 {
   this->declare_parameter<int32_t>("no_of_pkg_mac", 0);
+  this->declare_parameter<int32_t>("max_queued_orders", 32);
+  this->declare_parameter<double>("default_cell_time", 10.0);
   this->get_parameter("no_of_pkg_mac", no_of_pkg_mac);
 
+  if (no_of_pkg_mac >= packaging_machine_status_.capacity())
+  {
+    RCLCPP_ERROR(this->get_logger(), "Only %ld Packaging Machines fit in the status table", 
+      packaging_machine_status_.capacity() - 1);
+  }
+
+  scheduler_ = std::make_unique<scheduler::OrderScheduler>(
+    std::max<int64_t>(this->get_parameter("max_queued_orders").as_int(), 0),
+    this->get_parameter("default_cell_time").as_double());
+
+  metrics_ = std::make_unique<metrics::FleetMetrics>(no_of_pkg_mac);
+
   status_sub_ = this->create_subscription<PackagingMachineStatus>(
     "packaging_machine_status", 
     10, 
     std::bind(&PackagingMachineManager::status_cb, this, _1));
-  
-  packaging_result_sub_ = this->create_subscription<PackagingResult>(
-    "packaging_result", 
-    10, 
-    std::bind(&PackagingMachineManager::packaging_result_cb, this, _1));
-
-  action_client_manager_ = std::make_shared<rclcpp_components::ComponentManager>(
-    executor_, 
-    action_client_manager_node_name,
-    rclcpp::NodeOptions().use_global_arguments(false));
-
-  executor_->add_node(action_client_manager_);
 
   srv_cli_cbg_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
 
@@ -35,238 +32,293 @@ PackagingMachineManager::PackagingMachineManager(
     std::bind(&PackagingMachineManager::packaging_order_handle, this, _1, _2));
 
   unbind_order_id_pub_ = this->create_publisher<UnbindRequest>("unbind_order_id", 10); 
+  scheduler_status_pub_ = this->create_publisher<SchedulerStatus>("scheduler_status", 10); 
+  fleet_metrics_pub_ = this->create_publisher<FleetMetrics>("fleet_metrics", 10); 
+  packaging_status_pub_ = this->create_publisher<PackagingStatus>("packaging_status", 10); 
+  packaging_result_pub_ = this->create_publisher<PackagingResult>("packaging_result", 10); 
 
-  load_node_client_ = this->create_client<LoadNode>(
-    load_node_service_name,
-    rmw_qos_profile_services_default,
-    srv_cli_cbg_);
-  unload_node_client_ = this->create_client<UnloadNode>(
-    unload_node_service_name,
-    rmw_qos_profile_services_default,
-    srv_cli_cbg_);
-  list_node_client_ = this->create_client<ListNodes>(
-    list_nodes_service_name,
-    rmw_qos_profile_services_default,
-    srv_cli_cbg_);
+  for (size_t i = 0; i < no_of_pkg_mac; i++)
+  {
+    const uint8_t id = static_cast<uint8_t>(i + 1);
+    info_sub_.push_back(this->create_subscription<PackagingMachineInfo>(
+      "/packaging_machine_" + std::to_string(id) + "/info",
+      10,
+      [this, id](const PackagingMachineInfo::SharedPtr msg) { info_cb(msg, id); }));
+    recovered_order_sub_.push_back(this->create_subscription<PackagingResult>(
+      "/packaging_machine_" + std::to_string(id) + "/recovered_order",
+      10,
+      std::bind(&PackagingMachineManager::recovered_order_cb, this, _1)));
+  }
 
   for (size_t i = 0; i < no_of_pkg_mac; i++)
   {
     const std::string con_op_str = "/packaging_machine_" + std::to_string(i + 1) + "/conveyor_operation";
     const std::string stop_op_str = "/packaging_machine_" + std::to_string(i + 1) + "/stopper_operation";
-    conveyor_stopper_client_.push_back(
-      std::make_pair(
-        this->create_client<SetBool>(
-          con_op_str,
-          rmw_qos_profile_services_default,
-          srv_cli_cbg_),
-        this->create_client<SetBool>(
-          stop_op_str,
-          rmw_qos_profile_services_default,
-          srv_cli_cbg_)
-      )
-    );
+    ConveyorStopperClient client;
+    client.conveyor = this->create_client<SetBool>(
+      con_op_str,
+      rmw_qos_profile_services_default,
+      srv_cli_cbg_);
+    client.stopper = this->create_client<SetBool>(
+      stop_op_str,
+      rmw_qos_profile_services_default,
+      srv_cli_cbg_);
+    client.ready = false;
+    client.pending = 0;
+    conveyor_stopper_client_.push_back(std::move(client));
     RCLCPP_DEBUG(this->get_logger(), "Conveyor Service %s Client is created", con_op_str.c_str());
     RCLCPP_DEBUG(this->get_logger(), "Stopper Service %s Client is created", stop_op_str.c_str());
   }
 
-  while (rclcpp::ok() && !load_node_client_->wait_for_service(1s)) 
-  {
-    RCLCPP_ERROR(this->get_logger(), "Load Node Service not available!");
-  }
-  while (rclcpp::ok() && !unload_node_client_->wait_for_service(1s)) 
-  {
-    RCLCPP_ERROR(this->get_logger(), "Unload Node Service not available!");
-  }
-  while (rclcpp::ok() && !list_node_client_->wait_for_service(1s)) 
-  {
-    RCLCPP_ERROR(this->get_logger(), "List Nodes Service not available!");
-  }
+  machine_orders_.assign(no_of_pkg_mac, 0);
 
-  for (size_t i = 0; i < conveyor_stopper_client_.size(); i++)
+  // the action clients are created once and reused for every order, a machine
+  // packages one order at a time so it needs a single one
+  for (size_t i = 0; i < no_of_pkg_mac; i++)
   {
-    while (rclcpp::ok() && !conveyor_stopper_client_[i].first->wait_for_service(1s)) 
-    {
-      RCLCPP_ERROR(this->get_logger(), "Machine [%ld] Conveyor Service not available!", i + 1);
-    }
-    while (rclcpp::ok() && !conveyor_stopper_client_[i].second->wait_for_service(1s)) 
-    {
-      RCLCPP_ERROR(this->get_logger(), "Machine [%ld] Stopper Service not available!", i + 1);
-    }
+    action_clients_.push_back(std::make_unique<PackagingMachineActionClient>(
+      this, 
+      static_cast<uint8_t>(i + 1), 
+      std::bind(&PackagingMachineManager::packaging_result_cb, this, _1)));
   }
 
+  // the conveyors are released when a machine becomes IDLE, the timer only
+  // catches what the status transitions missed and the workers left waiting
   conveyor_stopper_timer_ = this->create_wall_timer(
     5s, 
     std::bind(&PackagingMachineManager::conveyor_stopper_cb, this));
 
+  packaging_status_timer_ = this->create_wall_timer(
+    PACKAGING_STATUS_INTERVAL, 
+    std::bind(&PackagingMachineManager::pub_packaging_status_cb, this));
+
+  scheduler_status_timer_ = this->create_wall_timer(
+    1s, 
+    std::bind(&PackagingMachineManager::pub_scheduler_status_cb, this));
+
+  fleet_metrics_timer_ = this->create_wall_timer(
+    10s, 
+    std::bind(&PackagingMachineManager::pub_fleet_metrics_cb, this));
+
   RCLCPP_INFO(this->get_logger(), "Packaging Machine Manager is up.");
   RCLCPP_INFO(this->get_logger(), "Total: %ld Packaging Machines are monitored", no_of_pkg_mac);
 }
 
 void PackagingMachineManager::conveyor_stopper_cb(void)
 {
-  using ServiceSharedFutureAndRequestId = rclcpp::Client<SetBool>::SharedFutureAndRequestId;
-  std::vector<ServiceSharedFutureAndRequestId> futures;
-  const size_t MAX_RETRIES = 2;
+  std::vector<size_t> to_release;
+  const auto status = packaging_machine_status_.snapshot();
 
-  for (size_t i = 0; i < conveyor_stopper_client_.size(); i++)
   {
-    size_t reties = 0;
-    while (rclcpp::ok() && !conveyor_stopper_client_[i].first->wait_for_service(1s)) 
-    {
-      RCLCPP_ERROR(this->get_logger(), "Machine [%ld] Conveyor Service is not available!", i + 1);
-      reties++;
-      if (reties > MAX_RETRIES)
-      {
-        RCLCPP_ERROR(this->get_logger(), "Break because Machine [%ld] Conveyor Service not available", i + 1);
-        return;
-      }
-    }
-    reties = 0;
-    while (rclcpp::ok() && !conveyor_stopper_client_[i].second->wait_for_service(1s)) 
+    const std::lock_guard<std::mutex> lock(this->mutex_);
+    const auto now = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < conveyor_stopper_client_.size(); i++)
     {
-      RCLCPP_ERROR(this->get_logger(), "Machine [%ld] Stopper Service is not available!", i + 1);
-      reties++;
-      if (reties > MAX_RETRIES)
+      ConveyorStopperClient &client = conveyor_stopper_client_[i];
+
+      if (client.pending > 0 && now - client.sent_at > DELAY_CONVEYOR_RESPONSE)
       {
-        RCLCPP_ERROR(this->get_logger(), "Break because Machine [%ld] Conveyor Service not available", i + 1);
-        return;
+        RCLCPP_ERROR(this->get_logger(), "Machine [%ld] Conveyor/Stopper Service is timeout", i + 1);
+        client.conveyor->prune_pending_requests();
+        client.stopper->prune_pending_requests();
+        client.pending = 0;
+        client.ready = false;
       }
+
+      const auto machine = i + 1 < status->size() ? (*status)[i + 1] : nullptr;
+      if (!machine || machine->packaging_machine_state != PackagingMachineStatus::IDLE)
+        continue;
+
+      if (claim_conveyor_stopper(i))
+        to_release.push_back(i);
     }
-    
-    const std::lock_guard<std::mutex> lock(this->mutex_);
-    
-    if (packaging_machine_status_[i + 1].packaging_machine_state == PackagingMachineStatus::IDLE)
-    {      
-      using ServiceResponseFuture = rclcpp::Client<SetBool>::SharedFuture;
-      auto response_received_cb = [this](ServiceResponseFuture future) {
-        auto response = future.get();
-        if (response) 
-        {
-          RCLCPP_DEBUG(this->get_logger(), "Sent a operation request.");
-        } 
-        else 
-        {
-          const std::string err_msg = "Service call failed or returned no result";
-          RCLCPP_ERROR(this->get_logger(), err_msg.c_str());
-        }
-      };
-
-      std::shared_ptr<SetBool::Request> conveyor_request = std::make_shared<SetBool::Request>();
-      conveyor_request->data = true;
-      auto conveyor_future = conveyor_stopper_client_[i].first->async_send_request(
-        conveyor_request,
-        response_received_cb);
-      futures.push_back(std::move(conveyor_future));
-
-      std::shared_ptr<SetBool::Request> stopper_request = std::make_shared<SetBool::Request>();
-      stopper_request->data = false;
-      auto stopper_future = conveyor_stopper_client_[i].second->async_send_request(
-        stopper_request,
-        response_received_cb);
-      futures.push_back(std::move(stopper_future));
-
-      RCLCPP_DEBUG(this->get_logger(), "Packaging Machine [%ld] Service is called", i + 1);
-    }
   }
 
-  for (const auto &future : futures)
+  for (const size_t i : to_release)
+    release_conveyor_stopper(i);
+
+  // a worker whose goal got lost is released, its result goes through packaging_result_cb
+  for (const auto &client : action_clients_)
+  {
+    const uint8_t id = client->packaging_machine_id();
+    const auto machine = id < status->size() ? (*status)[id] : nullptr;
+    client->check(machine && machine->packaging_machine_state == PackagingMachineStatus::IDLE);
+  }
+}
+
+bool PackagingMachineManager::claim_conveyor_stopper(size_t index)
+{
+  ConveyorStopperClient &client = conveyor_stopper_client_[index];
+
+  if (client.pending > 0)
+    return false;
+
+  // service_is_ready() does not block, the flag only saves logging every time
+  const bool ready = client.conveyor->service_is_ready() && client.stopper->service_is_ready();
+  if (ready != client.ready)
   {
-    std::future_status status = future.wait_for(200ms);
-    switch (status)
+    client.ready = ready;
+    if (ready)
+      RCLCPP_INFO(this->get_logger(), "Machine [%ld] Conveyor/Stopper Service is available", index + 1);
+    else
+      RCLCPP_ERROR(this->get_logger(), "Machine [%ld] Conveyor/Stopper Service is not available!", index + 1);
+  }
+
+  if (!client.ready)
+    return false;
+
+  client.pending = 2;
+  client.sent_at = std::chrono::steady_clock::now();
+  return true;
+}
+
+void PackagingMachineManager::release_conveyor_stopper(size_t index)
+{
+  using ServiceResponseFuture = rclcpp::Client<SetBool>::SharedFuture;
+  auto response_received_cb = [this, index](ServiceResponseFuture future) {
+    auto response = future.get();
     {
-    case std::future_status::ready:
-      RCLCPP_DEBUG(this->get_logger(), "OK");
-      break; 
-    case std::future_status::timeout: {
-      const std::string err_msg = "The Operation Service is timeout.";
-      RCLCPP_ERROR(this->get_logger(), err_msg.c_str());
-      break; 
-    }
-    case std::future_status::deferred: {
-      const std::string err_msg = "The Operation Service is deferred.";
-      RCLCPP_ERROR(this->get_logger(), err_msg.c_str());
-      break;
+      const std::lock_guard<std::mutex> lock(this->mutex_);
+      ConveyorStopperClient &client = conveyor_stopper_client_[index];
+      if (client.pending > 0)
+        client.pending--;
     }
+
+    if (response && response->success) 
+    {
+      RCLCPP_DEBUG(this->get_logger(), "Machine [%ld] operation request is done.", index + 1);
+    } 
+    else 
+    {
+      RCLCPP_ERROR(this->get_logger(), "Machine [%ld] operation request failed: %s", 
+        index + 1, response ? response->message.c_str() : "no result");
     }
-  }
+  };
+
+  // the clients are not touched by anyone else while the requests are pending
+  const ConveyorStopperClient &client = conveyor_stopper_client_[index];
+
+  auto conveyor_request = std::make_shared<SetBool::Request>();
+  conveyor_request->data = true;
+  client.conveyor->async_send_request(conveyor_request, response_received_cb);
+
+  auto stopper_request = std::make_shared<SetBool::Request>();
+  stopper_request->data = false;
+  client.stopper->async_send_request(stopper_request, response_received_cb);
+
+  RCLCPP_DEBUG(this->get_logger(), "Packaging Machine [%ld] Service is called", index + 1);
 }
 
 void PackagingMachineManager::status_cb(const PackagingMachineStatus::SharedPtr msg)
 {
-  const std::lock_guard<std::mutex> lock(this->mutex_);
-  packaging_machine_status_[msg->packaging_machine_id] = *msg;
+  bool release = false;
+  const size_t index = msg->packaging_machine_id - 1;
+
+  if (msg->packaging_machine_id >= packaging_machine_status_.capacity())
+  {
+    RCLCPP_ERROR(this->get_logger(), "Packaging Machine ID %d is out of the status table", msg->packaging_machine_id);
+    return;
+  }
+
+  // readers see the new status at once, they do not wait for mutex_
+  const auto prev = packaging_machine_status_.update(msg->packaging_machine_id, *msg);
+  const bool became_idle = msg->packaging_machine_state == PackagingMachineStatus::IDLE &&
+    (!prev || prev->packaging_machine_state != PackagingMachineStatus::IDLE);
+
+  metrics::Activity activity = metrics::Activity::OTHER;
+  if (msg->packaging_machine_state == PackagingMachineStatus::IDLE)
+    activity = metrics::Activity::IDLE;
+  else if (msg->packaging_machine_state == PackagingMachineStatus::BUSY)
+    activity = metrics::Activity::BUSY;
+
+  {
+    const std::lock_guard<std::mutex> lock(this->mutex_);
+
+    metrics_->on_machine_state(msg->packaging_machine_id, activity, this->get_clock()->now().seconds());
+
+    if (became_idle && index < conveyor_stopper_client_.size())
+      release = claim_conveyor_stopper(index);
+
+    if (!scheduler_->empty())
+      dispatch_queued_orders();
+  }
+
+  if (release)
+    release_conveyor_stopper(index);
+}
+
+void PackagingMachineManager::info_cb(const PackagingMachineInfo::SharedPtr msg, uint8_t packaging_machine_id)
+{
+  packaging_machine_info_.update(packaging_machine_id, *msg);
 }
 
-void PackagingMachineManager::packaging_result_cb(const PackagingResult::SharedPtr msg)
+void PackagingMachineManager::packaging_result_cb(const PackagingResult &msg)
 {
+  // the final status goes out before the result and before the worker takes another order
+  pub_packaging_status_cb();
+  packaging_result_pub_->publish(msg);
+
   const std::lock_guard<std::mutex> lock(this->mutex_);
-  if (!msg->success)
+
+  // the worker is idle again whatever the result is, the record goes in one step
+  auto target = orders_.find(msg.order_id);
+  if (target != orders_.end() && target->second.state == OrderState::DISPATCHED) 
+  {
+    const OrderRecord &record = target->second;
+    if (record.packaging_machine_id != msg.packaging_machine_id)
+    {
+      RCLCPP_ERROR(this->get_logger(), "Order %u was sent to machine [%d] but the result is from [%d]", 
+        msg.order_id, record.packaging_machine_id, msg.packaging_machine_id);
+    }
+
+    machine_orders_[record.packaging_machine_id - 1]--;
+    orders_.erase(target);
+    RCLCPP_INFO(this->get_logger(), "The action client of order %u is released", msg.order_id);
+  } 
+  else 
+  {
+    RCLCPP_ERROR(this->get_logger(), "Order %u is not dispatched by the manager.", msg.order_id);
+  }
+
+  scheduler_->finish(msg.packaging_machine_id, msg.success);
+  metrics_->on_result(msg.order_id, msg.success, this->get_clock()->now().seconds());
+
+  // the machine may report IDLE already, otherwise status_cb sends it the next order
+  dispatch_queued_orders();
+
+  if (!msg.success)
   {
     RCLCPP_ERROR(this->get_logger(), "A packaging order return error.");
     // TODO: how to handle
     return;
   }
 
-  auto target = std::find_if(curr_client_.begin(), curr_client_.end(),
-    [msg](const std::pair<uint32_t, uint64_t>& entry) {
-      return entry.first == msg->order_id;
-  });
-
   UnbindRequest unbind_msg;
-  unbind_msg.packaging_machine_id = msg->packaging_machine_id;
-  unbind_msg.order_id = msg->order_id;
-  unbind_msg.material_box_id = msg->material_box_id;
+  unbind_msg.packaging_machine_id = msg.packaging_machine_id;
+  unbind_msg.order_id = msg.order_id;
+  unbind_msg.material_box_id = msg.material_box_id;
   unbind_order_id_pub_->publish(unbind_msg);
-  
-  if (target != curr_client_.end()) 
-  {
-    RCLCPP_INFO(this->get_logger(), "The target action clinet is found in manager");
-
-    auto list_nodes_srv_request = std::make_shared<ListNodes::Request>();
-
-    using ListNodesServiceResponseFuture = rclcpp::Client<ListNodes>::SharedFuture;
-
-    auto list_nodes_response_received_cb = [this, target](ListNodesServiceResponseFuture future) {
-      auto srv_result = future.get();
-      if (srv_result) 
-      {
-        auto target_unique_id = std::find(srv_result->unique_ids.begin(), srv_result->unique_ids.end(), target->second);
-
-        if (target_unique_id != srv_result->unique_ids.end()) 
-        {
-          RCLCPP_INFO(this->get_logger(), "The target unique_id is found in current loaded. Try to unload it now.");
-
-          auto unload_node_srv_request = std::make_shared<UnloadNode::Request>();
-          unload_node_srv_request->unique_id = target->second;
-
-          using UnloadNodeServiceResponseFuture = rclcpp::Client<UnloadNode>::SharedFuture;
-
-          auto response_received_cb = [this, target](UnloadNodeServiceResponseFuture future) {
-            auto srv_result = future.get();
-            if (srv_result) 
-            {
-              curr_client_.erase(target);
-              RCLCPP_INFO(this->get_logger(), "The action client is unloaded (unique_id: %ld)", target->second);
-            } else 
-            {
-              RCLCPP_ERROR(this->get_logger(), "Service call failed or returned no result");
-            }
-          };
-          auto future = unload_node_client_->async_send_request(unload_node_srv_request, response_received_cb);
-        } else 
-        {
-          RCLCPP_ERROR(this->get_logger(), "The action client is not found in ListNodes Service");
-        }
-      } else 
-      {
-        RCLCPP_ERROR(this->get_logger(), "Service call failed or returned no result");
-      }
-    };
+}
 
-    auto list_nodes_future = list_node_client_->async_send_request(list_nodes_srv_request, list_nodes_response_received_cb);
-  } else {
-    RCLCPP_ERROR(this->get_logger(), "The target action clinet is not found in manager.");
+void PackagingMachineManager::recovered_order_cb(const PackagingResult::SharedPtr msg)
+{
+  size_t worker;
+  {
+    const std::lock_guard<std::mutex> lock(this->mutex_);
+    auto target = orders_.find(msg->order_id);
+    if (target == orders_.end() || target->second.state != OrderState::DISPATCHED ||
+        target->second.packaging_machine_id != msg->packaging_machine_id)
+    {
+      RCLCPP_WARN(this->get_logger(), "Order %u resumed by machine [%d] is not waited for", 
+        msg->order_id, msg->packaging_machine_id);
+      return;
+    }
+    worker = target->second.worker;
   }
+
+  // the worker reports the result through packaging_result_cb as for any order
+  action_clients_[worker]->finish_recovered(msg->order_id, msg->success);
 }
 
 void PackagingMachineManager::packaging_order_handle(
@@ -276,171 +328,202 @@ void PackagingMachineManager::packaging_order_handle(
   RCLCPP_INFO(this->get_logger(), "service handle");
   const std::lock_guard<std::mutex> lock(this->mutex_);
 
-  auto it = std::find_if(packaging_machine_status_.rbegin(), packaging_machine_status_.rend(),
-    [](const auto& entry) {
-        return entry.second.packaging_machine_state == PackagingMachineStatus::IDLE;
-  });
-
-  if (it == packaging_machine_status_.rend()) 
+  if (orders_.count(request->order_id) > 0)
   {
     response->success = false;
-    response->message = "Packaging Machines are not idle";
-    RCLCPP_ERROR(this->get_logger(), "Packaging Machines are not idle");
+    response->message = "Order " + std::to_string(request->order_id) + " is already in progress";
+    RCLCPP_ERROR(this->get_logger(), response->message.c_str());
     return;
   }
 
-  uint8_t target_machine_id = it->second.packaging_machine_id;
-
-  auto load_node_srv_request = std::make_shared<LoadNode::Request>();
-  load_node_srv_request->package_name = "packaging_machine_control_system";
-  load_node_srv_request->plugin_name = "action_client::PackagingMachineActionClient";
-  load_node_srv_request->node_name = "action_client_" + std::to_string(request->order_id);
-
-  rcl_interfaces::msg::ParameterValue p1_v;
-  p1_v.type = rcl_interfaces::msg::ParameterType::PARAMETER_INTEGER;
-  p1_v.integer_value = target_machine_id;
-  rcl_interfaces::msg::Parameter p1;
-  p1.name = "packaging_machine_id";
-  p1.value = p1_v;
-
-  rcl_interfaces::msg::ParameterValue p2_v;
-  p2_v.type = rcl_interfaces::msg::ParameterType::PARAMETER_INTEGER;
-  p2_v.integer_value = request->order_id;
-  rcl_interfaces::msg::Parameter p2;
-  p2.name = "order_id";
-  p2.value = p2_v;
-
-  rcl_interfaces::msg::ParameterValue p3_v;
-  p3_v.type = rcl_interfaces::msg::ParameterType::PARAMETER_INTEGER;
-  p3_v.integer_value = request->material_box_id;
-  rcl_interfaces::msg::Parameter p3;
-  p3.name = "material_box_id";
-  p3.value = p3_v;
-
-  rcl_interfaces::msg::ParameterValue p_cn_name_v;
-  p_cn_name_v.type = rcl_interfaces::msg::ParameterType::PARAMETER_STRING_ARRAY;
-  p_cn_name_v.string_array_value.resize(CELLS);
-  for (size_t i = 0; i < CELLS; i++)
+  // the print info is moved from the request into the goal, no string encoding, the action client copies it once into its request
+  auto goal = std::make_unique<PackagingMachineActionClient::PackagingOrder::Goal>();
+  goal->order_id = request->order_id;
+  goal->material_box_id = request->material_box_id;
+  goal->print_info = std::move(request->print_info);
+
+  if (!scheduler_->enqueue(std::move(goal)))
   {
-    p_cn_name_v.string_array_value[i] = request->print_info[i].cn_name;
+    response->success = false;
+    response->message = "The order queue is full (" + std::to_string(scheduler_->max_size()) + " orders)";
+    RCLCPP_ERROR(this->get_logger(), response->message.c_str());
+    return;
   }
-  rcl_interfaces::msg::Parameter p_cn_name;
-  p_cn_name.name = "cn_name";
-  p_cn_name.value = p_cn_name_v;
-
-  rcl_interfaces::msg::ParameterValue p_en_name_v;
-  p_en_name_v.type = rcl_interfaces::msg::ParameterType::PARAMETER_STRING_ARRAY;
-  p_en_name_v.string_array_value.resize(CELLS);
-  for (size_t i = 0; i < CELLS; i++)
+
+  orders_.emplace(request->order_id, OrderRecord{OrderState::QUEUED, 0, 0});
+  dispatch_queued_orders();
+
+  // a queued order is accepted, it is sent as soon as a machine is available
+  response->success = true;
+  if (scheduler_->empty())
   {
-    p_en_name_v.string_array_value[i] = request->print_info[i].en_name;
+    response->message = "Order " + std::to_string(request->order_id) + " is dispatched";
   }
-  rcl_interfaces::msg::Parameter p_en_name;
-  p_en_name.name = "en_name";
-  p_en_name.value = p_en_name_v;
-
-  rcl_interfaces::msg::ParameterValue p_date_v;
-  p_date_v.type = rcl_interfaces::msg::ParameterType::PARAMETER_STRING_ARRAY;
-  p_date_v.string_array_value.resize(CELLS);
-  for (size_t i = 0; i < CELLS; i++)
+  else
   {
-    p_date_v.string_array_value[i] = request->print_info[i].date;
+    response->message = "Order " + std::to_string(request->order_id) + " is queued, " + 
+      std::to_string(scheduler_->size()) + " orders waiting";
+    RCLCPP_INFO(this->get_logger(), response->message.c_str());
   }
-  rcl_interfaces::msg::Parameter p_date;
-  p_date.name = "date";
-  p_date.value = p_date_v;
-
-  rcl_interfaces::msg::ParameterValue p_time_v;
-  p_time_v.type = rcl_interfaces::msg::ParameterType::PARAMETER_STRING_ARRAY;
-  p_time_v.string_array_value.resize(CELLS);
-  for (size_t i = 0; i < CELLS; i++)
+}
+
+std::vector<scheduler::MachineSnapshot> PackagingMachineManager::machine_snapshots(void)
+{
+  const auto status_table = packaging_machine_status_.snapshot();
+  const auto info_table = packaging_machine_info_.snapshot();
+
+  std::vector<scheduler::MachineSnapshot> machines;
+  machines.reserve(no_of_pkg_mac);
+
+  for (uint8_t id = 1; id < status_table->size(); id++)
   {
-    p_time_v.string_array_value[i] = request->print_info[i].time;
+    const auto &status = (*status_table)[id];
+    if (!status)
+      continue;
+
+    // the machine still reports IDLE for a while after an order is sent to it
+    const bool has_order = id > 0 && id <= machine_orders_.size() && machine_orders_[id - 1] > 0;
+
+    const bool has_worker = std::any_of(action_clients_.begin(), action_clients_.end(),
+      [id](const auto& client) {
+        return client->packaging_machine_id() == id && client->is_idle() && client->is_server_ready();
+    });
+
+    const auto &info = (*info_table)[id];
+
+    scheduler::MachineSnapshot machine;
+    machine.id = id;
+    machine.available = status->packaging_machine_state == PackagingMachineStatus::IDLE &&
+      status->conveyor_state == PackagingMachineStatus::AVAILABLE &&
+      !has_order && has_worker;
+    machine.temperature = info ? info->temperature : 0;
+    machines.push_back(machine);
   }
-  rcl_interfaces::msg::Parameter p_time;
-  p_time.name = "time";
-  p_time.value = p_time_v;
-
-  rcl_interfaces::msg::ParameterValue p_drugs_v;
-  p_drugs_v.type = rcl_interfaces::msg::ParameterType::PARAMETER_STRING_ARRAY;
-  p_drugs_v.string_array_value.resize(CELLS);
-  for (size_t i = 0; i < CELLS; i++)
+
+  return machines;
+}
+
+void PackagingMachineManager::dispatch_queued_orders(void)
+{
+  while (!scheduler_->empty())
   {
-    auto join = [&](const std::vector<std::string>& vec, char delimiter) {
-      std::ostringstream oss;
-      for (size_t i = 0; i < vec.size(); ++i) 
-      {
-        oss << vec[i];
-        if (i != vec.size() - 1) 
-          oss << delimiter; // Add # delimiter except for the last element
-      }
-      return oss.str();
-    };
-    p_drugs_v.string_array_value[i] = join(request->print_info[i].drugs, '#');
-  }
-  rcl_interfaces::msg::Parameter p_drugs;
-  p_drugs.name = "drugs";
-  p_drugs.value = p_drugs_v;
-
-  load_node_srv_request->parameters.push_back(p1);
-  load_node_srv_request->parameters.push_back(p2);
-  load_node_srv_request->parameters.push_back(p3);
-  load_node_srv_request->parameters.push_back(p_cn_name);
-  load_node_srv_request->parameters.push_back(p_en_name);
-  load_node_srv_request->parameters.push_back(p_date);
-  load_node_srv_request->parameters.push_back(p_time);
-  load_node_srv_request->parameters.push_back(p_drugs);
-
-  using ServiceResponseFuture = rclcpp::Client<LoadNode>::SharedFuture;
-
-  auto response_received_cb = [this, request, response](ServiceResponseFuture future) {
-    auto srv_result = future.get();
-    if (srv_result) 
-    {
-      std::pair<uint32_t, uint64_t> _pair(request->order_id, srv_result->unique_id);
-      const std::lock_guard<std::mutex> lock(this->mutex_);
-      curr_client_.push_back(_pair);
-      RCLCPP_INFO(this->get_logger(), "Loaded a action client. unique_id: %ld ", srv_result->unique_id);
-    } else 
+    const uint8_t target_machine_id = scheduler_->select_machine(machine_snapshots());
+    if (target_machine_id == 0)
+      return;
+
+    auto worker = std::find_if(action_clients_.begin(), action_clients_.end(),
+      [target_machine_id](const auto& client) {
+        return client->packaging_machine_id() == target_machine_id && client->is_idle();
+    });
+
+    scheduler::QueuedOrder order = scheduler_->pop();
+    const uint32_t order_id = order.goal->order_id;
+
+    if (worker == action_clients_.end() || !(*worker)->send_goal(std::move(order.goal)))
     {
-      std::string err_msg = "Service call failed or returned no result";
-      response->message = err_msg;
-      RCLCPP_ERROR(this->get_logger(), err_msg.c_str());
+      RCLCPP_ERROR(this->get_logger(), "Failed to send order %u to Packaging Machine %d, it stays in the queue", 
+        order_id, target_machine_id);
+      scheduler_->push_front(std::move(order));
+      return;
     }
-  };
 
-  auto future = load_node_client_->async_send_request(load_node_srv_request, response_received_cb);
+    const double queue_wait = scheduler_->start(target_machine_id, order);
+    metrics_->on_dispatched(order_id, queue_wait, this->get_clock()->now().seconds());
+
+    OrderRecord &record = orders_[order_id];
+    record.state = OrderState::DISPATCHED;
+    record.packaging_machine_id = target_machine_id;
+    record.worker = std::distance(action_clients_.begin(), worker);
+    machine_orders_[target_machine_id - 1]++;
+
+    RCLCPP_INFO(this->get_logger(), "Order %u is dispatched to Packaging Machine %d, %zu orders waiting", 
+      order_id, target_machine_id, scheduler_->size());
+  }
+}
 
-  std::future_status status = future.wait_for(1000ms);
-  switch (status)
+void PackagingMachineManager::pub_packaging_status_cb(void)
+{
+  // only the orders whose status changed since the last round are published
+  PackagingStatus status;
+  for (const auto &client : action_clients_)
   {
-  case std::future_status::ready:
-    response->success = true;
-    break; 
-  default: {
-    response->success = false;
-    std::string err_msg = "The Loadnode Service is wait too long.";
-    response->message = err_msg;
-    RCLCPP_ERROR(this->get_logger(), err_msg.c_str());
-    break;
+    if (client->take_status(status))
+      packaging_status_pub_->publish(status);
   }
+}
+
+void PackagingMachineManager::pub_scheduler_status_cb(void)
+{
+  SchedulerStatus msg;
+
+  {
+    const std::lock_guard<std::mutex> lock(this->mutex_);
+    msg.queue_length = scheduler_->size();
+    msg.max_queue_length = scheduler_->max_size();
+    msg.oldest_wait_sec = scheduler_->oldest_wait();
+    msg.mean_wait_sec = scheduler_->mean_wait();
+    msg.estimated_wait_sec = scheduler_->estimated_wait(no_of_pkg_mac);
+    msg.dispatched = scheduler_->dispatched();
+    msg.rejected = scheduler_->rejected();
+
+    for (size_t i = 0; i < no_of_pkg_mac; i++)
+    {
+      msg.machine_ids.push_back(static_cast<uint8_t>(i + 1));
+      msg.cell_time_sec.push_back(scheduler_->cell_time(static_cast<uint8_t>(i + 1)));
+    }
   }
+
+  msg.stamp = this->get_clock()->now();
+  scheduler_status_pub_->publish(msg);
 }
 
-int main(int argc, char **argv)
+void PackagingMachineManager::pub_fleet_metrics_cb(void)
 {
-  rclcpp::init(argc, argv);
-
-  auto exec = std::make_shared<rclcpp::executors::MultiThreadedExecutor>();
-  auto options = rclcpp::NodeOptions();
-  auto node = std::make_shared<PackagingMachineManager>(
-    exec, 
-    "packaging_machine_manager",
-    "",
-    options);
-
-  exec->add_node(node->get_node_base_interface());
-  exec->spin();
-  rclcpp::shutdown();
+  FleetMetrics msg;
+  const rclcpp::Time now = this->get_clock()->now();
+
+  metrics::Summary summary;
+  std::vector<metrics::HourSlot> history;
+  {
+    const std::lock_guard<std::mutex> lock(this->mutex_);
+    summary = metrics_->summarize(now.seconds());
+    history = metrics_->history();
+  }
+
+  msg.stamp = now;
+  msg.window_sec = METRICS_WINDOW_SEC;
+  msg.completed = summary.completed;
+  msg.failed = summary.failed;
+  msg.orders_per_hour = summary.orders_per_hour;
+  msg.cycle_time_p50_sec = summary.cycle_time_p50;
+  msg.cycle_time_p95_sec = summary.cycle_time_p95;
+  msg.cycle_time_p99_sec = summary.cycle_time_p99;
+  msg.queue_wait_mean_sec = summary.queue_wait_mean;
+  msg.queue_wait_p95_sec = summary.queue_wait_p95;
+
+  for (size_t i = 0; i < summary.utilization.size(); i++)
+  {
+    msg.machine_ids.push_back(static_cast<uint8_t>(i + 1));
+    msg.utilization.push_back(summary.utilization[i]);
+  }
+
+  for (const auto &slot : history)
+  {
+    HourlyMetrics hour;
+    hour.start = rclcpp::Time(slot.hour * 3600, 0, now.get_clock_type());
+    hour.completed = slot.completed;
+    hour.failed = slot.failed;
+    hour.cycle_time_mean_sec = slot.completed > 0 ? slot.cycle_time_sum / slot.completed : 0.0;
+    hour.cycle_time_max_sec = slot.cycle_time_max;
+    hour.queue_wait_mean_sec = slot.queue_waits > 0 ? slot.queue_wait_sum / slot.queue_waits : 0.0;
+    hour.utilization = slot.busy_sec + slot.idle_sec > 0.0 ? slot.busy_sec / (slot.busy_sec + slot.idle_sec) : 0.0;
+    msg.history.push_back(hour);
+  }
+
+  fleet_metrics_pub_->publish(msg);
+
+  RCLCPP_DEBUG(this->get_logger(), "%.1f orders/hour, cycle time p50 %.1fs p95 %.1fs p99 %.1fs", 
+    msg.orders_per_hour, msg.cycle_time_p50_sec, msg.cycle_time_p95_sec, msg.cycle_time_p99_sec);
 }
 
+RCLCPP_COMPONENTS_REGISTER_NODE(PackagingMachineManager)
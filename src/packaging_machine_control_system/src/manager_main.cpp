@@ -0,0 +1,14 @@
+#include "packaging_machine_control_system/manager.hpp"
+
+int main(int argc, char **argv)
+{
+  rclcpp::init(argc, argv);
+
+  auto exec = std::make_shared<rclcpp::executors::MultiThreadedExecutor>();
+  auto options = rclcpp::NodeOptions();
+  auto node = std::make_shared<PackagingMachineManager>(options);
+
+  exec->add_node(node->get_node_base_interface());
+  exec->spin();
+  rclcpp::shutdown();
+}
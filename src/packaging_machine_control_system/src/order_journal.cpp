@@ -0,0 +1,212 @@
+#include "packaging_machine_control_system/order_journal.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace journal
+{
+
+OrderJournal::OrderJournal(const std::string &path)
+: path_(path),
+  fd_(-1),
+  order_id_(0),
+  unsynced_(0)
+{
+}
+
+OrderJournal::~OrderJournal()
+{
+  if (fd_ < 0)
+    return;
+
+  if (unsynced_ > 0)
+    ::fdatasync(fd_);
+  ::close(fd_);
+}
+
+bool OrderJournal::open(void)
+{
+  if (fd_ >= 0)
+    return true;
+
+  fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  return fd_ >= 0;
+}
+
+bool OrderJournal::recover(Progress &progress)
+{
+  if (!open())
+    return false;
+
+  struct stat st;
+  if (::fstat(fd_, &st) != 0)
+    return false;
+
+  std::vector<uint8_t> data(st.st_size);
+  size_t length = 0;
+  while (length < data.size())
+  {
+    const ssize_t n = ::pread(fd_, data.data() + length, data.size() - length, length);
+    if (n <= 0)
+      break;
+    length += n;
+  }
+
+  bool unfinished = false;
+  size_t offset = 0;
+  while (offset + sizeof(Header) + BODY_SIZE <= length)
+  {
+    Header header;
+    std::memcpy(&header, data.data() + offset, sizeof(header));
+
+    const uint8_t *body = data.data() + offset + sizeof(header);
+    if (header.size < BODY_SIZE || header.size > length - offset - sizeof(header) ||
+        header.checksum != checksum(body, header.size))
+      break;
+
+    const Step step = static_cast<Step>(body[0]);
+    uint32_t order_id;
+    uint32_t value;
+    std::memcpy(&order_id, body + 1, sizeof(order_id));
+    std::memcpy(&value, body + 1 + sizeof(order_id), sizeof(value));
+    offset += sizeof(header) + header.size;
+
+    if (step == Step::BEGIN)
+    {
+      progress = Progress();
+      progress.order_id = order_id;
+      progress.goal.assign(body + BODY_SIZE, body + header.size);
+      unfinished = true;
+      continue;
+    }
+
+    if (!unfinished || order_id != progress.order_id)
+      continue;
+
+    switch (step)
+    {
+    case Step::FALLEN:
+      progress.drugs_fallen = true;
+      break;
+    case Step::TIGHTENED:
+      progress.tightened = true;
+      break;
+    case Step::PRINTED:
+      progress.prints = value;
+      break;
+    case Step::PUSHED:
+      progress.pushes = value;
+      break;
+    case Step::ROLLED:
+      if (value < DAYS)
+        progress.rolled[value] = true;
+      break;
+    case Step::GATE_OPENED:
+      if (value < CELLS)
+        progress.gate_opened[value] = true;
+      break;
+    case Step::CELL_DONE:
+      if (value < CELLS)
+        progress.cells[value] = true;
+      break;
+    case Step::GATES_CLOSED:
+      if (value < DAYS)
+        progress.gates_closed[value] = true;
+      break;
+    case Step::END:
+      unfinished = false;
+      break;
+    default:
+      break;
+    }
+  }
+
+  // a torn record is cut off, or the next records would follow it
+  if (offset < static_cast<size_t>(st.st_size))
+    ::ftruncate(fd_, offset);
+
+  order_id_ = unfinished ? progress.order_id : 0;
+  return unfinished;
+}
+
+bool OrderJournal::begin(uint32_t order_id, const std::vector<uint8_t> &goal)
+{
+  if (!open())
+    return false;
+
+  // the previous order is finished, its records are not needed anymore
+  if (::ftruncate(fd_, 0) != 0)
+    return false;
+
+  order_id_ = order_id;
+  unsynced_ = 0;
+  return append(Step::BEGIN, 0, goal, true);
+}
+
+bool OrderJournal::record(Step step, uint32_t value)
+{
+  const bool sync = step == Step::FALLEN || ++unsynced_ >= JOURNAL_SYNC_EVERY;
+  return append(step, value, {}, sync);
+}
+
+bool OrderJournal::end(void)
+{
+  return append(Step::END, 0, {}, true);
+}
+
+bool OrderJournal::append(Step step, uint32_t value, const std::vector<uint8_t> &payload, bool sync)
+{
+  if (fd_ < 0)
+    return false;
+
+  std::vector<uint8_t> buf(sizeof(Header) + BODY_SIZE + payload.size());
+  uint8_t *body = buf.data() + sizeof(Header);
+  body[0] = static_cast<uint8_t>(step);
+  std::memcpy(body + 1, &order_id_, sizeof(order_id_));
+  std::memcpy(body + 1 + sizeof(order_id_), &value, sizeof(value));
+  if (!payload.empty())
+    std::memcpy(body + BODY_SIZE, payload.data(), payload.size());
+
+  Header header;
+  header.size = static_cast<uint32_t>(BODY_SIZE + payload.size());
+  header.checksum = checksum(body, header.size);
+  std::memcpy(buf.data(), &header, sizeof(header));
+
+  // one write per record, a crash leaves at most the tail torn
+  size_t written = 0;
+  while (written < buf.size())
+  {
+    const ssize_t n = ::write(fd_, buf.data() + written, buf.size() - written);
+    if (n < 0)
+    {
+      // a signal before anything was written, the rest of the record is still to go
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    written += n;
+  }
+
+  if (!sync)
+    return true;
+
+  unsynced_ = 0;
+  return ::fdatasync(fd_) == 0;
+}
+
+uint32_t OrderJournal::checksum(const uint8_t *data, size_t size)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+} // namespace journal
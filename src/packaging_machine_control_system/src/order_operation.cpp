@@ -1,30 +1,146 @@
 #include "packaging_machine_control_system/packaging_machine_node.hpp"
 
+#include "rclcpp/serialization.hpp"
+
+namespace
+{
+
+std::vector<uint8_t> serialize_goal(const PackagingMachineNode::PackagingOrder::Goal &goal)
+{
+  rclcpp::Serialization<PackagingMachineNode::PackagingOrder::Goal> serializer;
+  rclcpp::SerializedMessage message;
+  serializer.serialize_message(&goal, &message);
+
+  const auto &buffer = message.get_rcl_serialized_message();
+  return std::vector<uint8_t>(buffer.buffer, buffer.buffer + buffer.buffer_length);
+}
+
+bool deserialize_goal(const std::vector<uint8_t> &data, PackagingMachineNode::PackagingOrder::Goal &goal)
+{
+  rclcpp::Serialization<PackagingMachineNode::PackagingOrder::Goal> serializer;
+  rclcpp::SerializedMessage message(data.size());
+
+  auto &buffer = message.get_rcl_serialized_message();
+  std::memcpy(buffer.buffer, data.data(), data.size());
+  buffer.buffer_length = data.size();
+
+  try
+  {
+    serializer.deserialize_message(&message, &goal);
+  }
+  catch (const std::exception &)
+  {
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
 void PackagingMachineNode::order_execute(const std::shared_ptr<GaolHandlerPackagingOrder> goal_handle)
 {
   RCLCPP_INFO(this->get_logger(), "Executing goal");
   
   const auto goal = goal_handle->get_goal();
   auto feedback = std::make_shared<PackagingOrder::Feedback>();
+  auto result = std::make_shared<PackagingOrder::Result>();
+
+  if (!journal_->begin(goal->order_id, serialize_goal(*goal)))
+    RCLCPP_ERROR(this->get_logger(), "Failed to journal order %u, it cannot be resumed: %s", goal->order_id, std::strerror(errno));
+
+  if (!run_order(goal, journal::Progress(), feedback, [goal_handle, feedback]() { goal_handle->publish_feedback(feedback); }))
+    return;
+
+  journal_->end();
+  result->order_result = feedback->curr_order_status;
+  goal_handle->succeed(result);
+  
+  // lock.lock();
+  status_->packaging_machine_state = PackagingMachineStatus::IDLE;
+  // lock.unlock();
+  
+  RCLCPP_INFO(this->get_logger(), "Goal succeeded");
+}
+
+void PackagingMachineNode::resume_order(std::shared_ptr<const journal::Progress> done)
+{
+  auto goal = std::make_shared<PackagingOrder::Goal>();
+  if (!deserialize_goal(done->goal, *goal))
+  {
+    // the manager fails the order, the half made roll has to be cleared by hand
+    RCLCPP_ERROR(this->get_logger(), "The journal of order %u is unreadable, the order is dropped", done->order_id);
+    journal_->end();
+    status_->packaging_machine_state = PackagingMachineStatus::IDLE;
+
+    PackagingResult msg;
+    msg.success = false;
+    msg.packaging_machine_id = status_->packaging_machine_id;
+    msg.order_id = done->order_id;
+    recovered_order_publisher_->publish(msg);
+    return;
+  }
+
+  RCLCPP_WARN(this->get_logger(), "Resuming order %u", goal->order_id);
+
+  // the labels and the printer did not survive the restart
+  prerender_labels(goal);
+  create_printer();
+  RCLCPP_INFO(this->get_logger(), "printer initialized");
+  init_printer_config();
+
+  // the action client of the order is gone with the last run, nobody takes the feedback
+  auto feedback = std::make_shared<PackagingOrder::Feedback>();
+  if (!run_order(goal, *done, feedback, []() {}))
+    return;
+
+  journal_->end();
+  status_->packaging_machine_state = PackagingMachineStatus::IDLE;
+
+  // the manager finishes the order with it
+  PackagingResult msg;
+  msg.success = true;
+  msg.packaging_machine_id = status_->packaging_machine_id;
+  msg.order_id = goal->order_id;
+  msg.material_box_id = goal->material_box_id;
+  recovered_order_publisher_->publish(msg);
+
+  RCLCPP_INFO(this->get_logger(), "Resumed order %u succeeded", goal->order_id);
+}
+
+bool PackagingMachineNode::run_order(
+  std::shared_ptr<const PackagingOrder::Goal> goal,
+  const journal::Progress &done,
+  std::shared_ptr<PackagingOrder::Feedback> feedback,
+  const std::function<void(void)> &publish_feedback)
+{
   auto& curr_order_status = feedback->curr_order_status;
   auto& are_drugs_fallen = feedback->are_drugs_fallen;
-  auto result = std::make_shared<PackagingOrder::Result>();
 
   // std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
 
+  // every step is journaled once it is done, a resumed order skips the steps in
+  // done and replays the print queues without printing or pushing the packages again
+  auto record = [this](journal::Step step, uint32_t value) {
+    if (!journal_->record(step, value))
+      RCLCPP_ERROR(this->get_logger(), "Failed to journal step %d: %s", static_cast<int>(step), std::strerror(errno));
+  };
+
   RCLCPP_INFO(this->get_logger(), "======== packaging sequence 1 ==========");
 
-  ctrl_material_box_gate(MTRL_BOX_GATE_OPEN);
-  wait_for_material_box_gate(MTRL_BOX_GATE_OPEN_STATE);
+  if (!done.drugs_fallen)
+  {
+    ctrl_material_box_gate(MTRL_BOX_GATE_OPEN);
+    wait_for_material_box_gate(MTRL_BOX_GATE_OPEN_STATE);
 
-  std::this_thread::sleep_for(DELAY_MTRL_BOX_GATE);
+    std::this_thread::sleep_for(DELAY_MTRL_BOX_GATE);
 
-  ctrl_material_box_gate(MTRL_BOX_GATE_CLOSE);
-  wait_for_material_box_gate(MTRL_BOX_GATE_CLOSE_STATE);
+    ctrl_material_box_gate(MTRL_BOX_GATE_CLOSE);
+    wait_for_material_box_gate(MTRL_BOX_GATE_CLOSE_STATE);
+  }
 
   are_drugs_fallen = true;
   RCLCPP_INFO(this->get_logger(), "Set are_drugs_fallen to True");
-  goal_handle->publish_feedback(feedback);
+  publish_feedback();
 
   // lock.lock();
   status_->conveyor_state = PackagingMachineStatus::AVAILABLE;
@@ -32,15 +148,20 @@ void PackagingMachineNode::order_execute(const std::shared_ptr<GaolHandlerPackag
   
   RCLCPP_INFO(this->get_logger(), "Set conveyor_state to AVAILABLE");
 
-  ctrl_stopper(STOPPER_SUNK);
-  ctrl_conveyor(CONVEYOR_SPEED, 0, CONVEYOR_FWD, MOTOR_ENABLE);
+  if (!done.drugs_fallen)
+  {
+    ctrl_stopper(STOPPER_SUNK);
+    ctrl_conveyor(CONVEYOR_SPEED, 0, CONVEYOR_FWD, MOTOR_ENABLE);
 
-  UnbindRequest msg;
-  msg.packaging_machine_id = status_->packaging_machine_id;
-  msg.order_id = goal->order_id;
-  msg.material_box_id = goal->material_box_id;
-  unbind_mtrl_box_publisher_->publish(msg);
-  RCLCPP_INFO(this->get_logger(), "Published a unbind material box id request");
+    UnbindRequest msg;
+    msg.packaging_machine_id = status_->packaging_machine_id;
+    msg.order_id = goal->order_id;
+    msg.material_box_id = goal->material_box_id;
+    unbind_mtrl_box_publisher_->publish(msg);
+    RCLCPP_INFO(this->get_logger(), "Published a unbind material box id request");
+
+    record(journal::Step::FALLEN, 0);
+  }
 
   RCLCPP_INFO(this->get_logger(), "========== packaging sequence 2 ==========");
 
@@ -58,16 +179,18 @@ void PackagingMachineNode::order_execute(const std::shared_ptr<GaolHandlerPackag
     wait_for_squeezer(MotorStatus::IDLE);
   };
 
+  // the labels were rendered while waiting for the material box in handle_goal
+  const std::shared_ptr<const RenderedLabels> labels = take_rendered_labels(goal);
+
   auto print_empty_pkg = [&]() {
-    PackageInfo _msg;
-    std::vector<std::string> cmd = get_print_label_cmd(_msg);
-    printer_->runTask(cmd);
+    printer_->runTask(labels->empty);
     RCLCPP_INFO(this->get_logger(), "printed a empty package");
   };
 
   std::queue<size_t> to_be_printed;
   std::queue<size_t> printed;
   size_t postfix = PKG_POSTFIX;
+  uint32_t prints = 0;
 
   for (size_t i = 0; i < CELLS; i++)
   {
@@ -76,41 +199,72 @@ void PackagingMachineNode::order_execute(const std::shared_ptr<GaolHandlerPackag
   }
   RCLCPP_INFO(this->get_logger(), "to_be_printed size: %ld", to_be_printed.size());
 
-  // make sure the bag is tight
-  std::this_thread::sleep_for(DELAY_ORDER_START_WAIT_FOR);
-  ctrl_pkg_dis(status_->package_length / 4, PKG_DIS_FEED_DIR, MOTOR_ENABLE); 
-  wait_for_pkg_dis(MotorStatus::IDLE);
+  // the label and the push of a package are journaled apart, a restart between
+  // them pushes the printed package out without printing it again
+  auto push_pkg = [&]() {
+    if (prints <= done.pushes)
+      return;
+
+    perform_dis_push_pull();
+    record(journal::Step::PUSHED, prints);
+  };
+
+  // the packages printed before the restart only move through the queues
+  auto print_next_pkg = [&]() {
+    prints++;
+    const bool replayed = prints <= done.prints;
 
-  for (size_t i = 0; i < PKG_PREFIX; i++)
-  {
     if (to_be_printed.empty())
     {
       if (postfix > 0)
         postfix--;
 
-      print_empty_pkg();
+      if (!replayed)
+      {
+        print_empty_pkg();
+        record(journal::Step::PRINTED, prints);
+      }
     }
     else
-    {    
-      std::vector<std::string> cmd = get_print_label_cmd(goal->print_info[to_be_printed.front()]);
-      printer_->runTask(cmd);
-      RCLCPP_INFO(this->get_logger(), "printed a order %ld package", printed.front());
+    {
+      if (!replayed)
+      {
+        print_label(*labels, to_be_printed.front());
+        RCLCPP_INFO(this->get_logger(), "printed a order %ld package", to_be_printed.front());
+        record(journal::Step::PRINTED, prints);
+      }
 
       printed.push(to_be_printed.front());
       to_be_printed.pop();
     }
 
-    perform_dis_push_pull();
+    push_pkg();
+  };
+
+  // make sure the bag is tight
+  if (!done.tightened)
+  {
+    std::this_thread::sleep_for(DELAY_ORDER_START_WAIT_FOR);
+    ctrl_pkg_dis(status_->package_length / 4, PKG_DIS_FEED_DIR, MOTOR_ENABLE); 
+    wait_for_pkg_dis(MotorStatus::IDLE);
+    record(journal::Step::TIGHTENED, 0);
   }
+
+  for (size_t i = 0; i < PKG_PREFIX; i++)
+    print_next_pkg();
   RCLCPP_INFO(this->get_logger(), "Printed %d prefix", PKG_PREFIX);
 
   for (uint8_t day = 0; day < DAYS; day++)
   {
     RCLCPP_INFO(this->get_logger(), "@@@@@@@@@@ Day: %d @@@@@@@@@@", day);
 
-    std::this_thread::sleep_for(DELAY_GENERAL_STEP);
-    ctrl_roller(1, 0, MOTOR_ENABLE);
-    wait_for_roller(MotorStatus::IDLE);
+    if (!done.rolled[day])
+    {
+      std::this_thread::sleep_for(DELAY_GENERAL_STEP);
+      ctrl_roller(1, 0, MOTOR_ENABLE);
+      wait_for_roller(MotorStatus::IDLE);
+      record(journal::Step::ROLLED, day);
+    }
 
     auto index_exist_in_printed = [&]() {
       for (uint8_t cell = 0; cell < CELLS_PER_DAY; cell++)
@@ -130,50 +284,51 @@ void PackagingMachineNode::order_execute(const std::shared_ptr<GaolHandlerPackag
       const size_t index = CELLS_PER_DAY * day + cell;
       RCLCPP_INFO(this->get_logger(), "@@@@@@@@@@ index: %ld @@@@@@@@@@", index);
 
-      std::this_thread::sleep_for(DELAY_GENERAL_STEP);
-      ctrl_pill_gate(PILL_GATE_WIDTH, PILL_GATE_OPEN_DIR, MOTOR_ENABLE);
-      wait_for_pill_gate(MotorStatus::IDLE);
+      // opening the gate again would drop the pills of the next cell
+      if (!done.gate_opened[index])
+      {
+        std::this_thread::sleep_for(DELAY_GENERAL_STEP);
+        ctrl_pill_gate(PILL_GATE_WIDTH, PILL_GATE_OPEN_DIR, MOTOR_ENABLE);
+        wait_for_pill_gate(MotorStatus::IDLE);
+        record(journal::Step::GATE_OPENED, index);
+      }
 
       if (!printed.empty() && printed.front() == index)
       {
         printed.pop();
-      
-        if (to_be_printed.empty())
-        {
-          if (postfix > 0)
-            postfix--;
-
-          print_empty_pkg();
-        }
-        else
-        {        
-          std::vector<std::string> cmd = get_print_label_cmd(goal->print_info[to_be_printed.front()]);
-          printer_->runTask(cmd);
-          RCLCPP_INFO(this->get_logger(), "printed a order %ld package", printed.front());
-
-          printed.push(to_be_printed.front());
-          to_be_printed.pop();
-        }
-
-        perform_dis_push_pull();
+        print_next_pkg();
       }
 
       curr_order_status[index] = true;
-      goal_handle->publish_feedback(feedback);
+      if (!done.cells[index])
+      {
+        record(journal::Step::CELL_DONE, index);
+        publish_feedback();
+      }
     }
 
-    std::this_thread::sleep_for(DELAY_GENERAL_STEP);
-    ctrl_pill_gate(PILL_GATE_WIDTH * NO_OF_PILL_GATES * PILL_GATE_CLOSE_MARGIN_FACTOR, PILL_GATE_CLOSE_DIR, MOTOR_ENABLE);
-    wait_for_pill_gate(MotorStatus::IDLE);
+    if (!done.gates_closed[day])
+    {
+      std::this_thread::sleep_for(DELAY_GENERAL_STEP);
+      ctrl_pill_gate(PILL_GATE_WIDTH * NO_OF_PILL_GATES * PILL_GATE_CLOSE_MARGIN_FACTOR, PILL_GATE_CLOSE_DIR, MOTOR_ENABLE);
+      wait_for_pill_gate(MotorStatus::IDLE);
+      record(journal::Step::GATES_CLOSED, day);
+    }
   }
   RCLCPP_INFO(this->get_logger(), ">>>>>>>>>> completed %d cells <<<<<<<<<<", CELLS);
 
-  for (uint8_t i = 0; i < postfix; i++)
+  for (size_t i = 0; i < postfix; i++)
   {
-    print_empty_pkg();
-    perform_dis_push_pull();
+    if (++prints > done.prints)
+    {
+      print_empty_pkg();
+      record(journal::Step::PRINTED, prints);
+    }
+
+    push_pkg();
   }
 
+  // homing the roller again does no harm, it is not journaled
   std::this_thread::sleep_for(DELAY_GENERAL_STEP);
   ctrl_roller(0, 1, MOTOR_ENABLE);
   wait_for_roller(MotorStatus::IDLE);
@@ -182,20 +337,11 @@ void PackagingMachineNode::order_execute(const std::shared_ptr<GaolHandlerPackag
   // std::this_thread::sleep_for(DELAY_GENERAL_VALVE);
   // ctrl_cutter(0);
 
-  if (rclcpp::ok()) 
-  {
-    printer_.reset();
-    RCLCPP_INFO(this->get_logger(), "printer destroyed");
-    RCLCPP_INFO(this->get_logger(), "postfix: %ld", postfix);
-    result->order_result = curr_order_status;
-    goal_handle->succeed(result);
-    
-    // lock.lock();
-    status_->packaging_machine_state = PackagingMachineStatus::IDLE;
-    // lock.unlock();
-    
-    RCLCPP_INFO(this->get_logger(), "Goal succeeded");
-  }
+  if (!rclcpp::ok()) 
+    return false;
+
+  RCLCPP_INFO(this->get_logger(), "postfix: %ld", postfix);
+  return true;
 }
 
 void PackagingMachineNode::init_packaging_machine(void)
@@ -239,12 +385,7 @@ void PackagingMachineNode::init_packaging_machine(void)
 
   std::this_thread::sleep_for(DELAY_GENERAL_STEP);
 
-  printer_.reset();
-  printer_ = std::make_shared<Printer>(
-    printer_config_->vendor_id, 
-    printer_config_->product_id, 
-    printer_config_->serial,
-    printer_config_->port);
+  create_printer();
   RCLCPP_INFO(this->get_logger(), "printer initialized");
   init_printer_config();
 
@@ -257,8 +398,9 @@ void PackagingMachineNode::init_packaging_machine(void)
     msg.time = "17:00";
     msg.qr_code = "www.hkclr.hk";
     msg.drugs.push_back("DRUG 1");
-    auto cmd = get_print_label_cmd(msg);
-    printer_->runTask(cmd);
+    std::string label;
+    get_print_label_cmd(msg, label);
+    printer_->runTask(label);
     RCLCPP_INFO(this->get_logger(), "printed a empty package");
 
     std::this_thread::sleep_for(DELAY_PKG_DIS_WAIT_PRINTER);
@@ -276,9 +418,6 @@ void PackagingMachineNode::init_packaging_machine(void)
     wait_for_squeezer(MotorStatus::IDLE);
   }
 
-  printer_.reset();
-  RCLCPP_INFO(this->get_logger(), "printer destroyed");
-
   ctrl_conveyor(CONVEYOR_SPEED, 0, CONVEYOR_FWD, MOTOR_DISABLE);
   std::this_thread::sleep_for(DELAY_CONVEYOR_TESTING);
   ctrl_conveyor(CONVEYOR_SPEED, 0, CONVEYOR_FWD, MOTOR_ENABLE);
@@ -309,6 +448,8 @@ void PackagingMachineNode::skip_order_execute(const std::shared_ptr<GaolHandlerP
   auto& curr_order_status = feedback->curr_order_status;
   auto result = std::make_shared<PackagingOrder::Result>();
 
+  take_rendered_labels(goal);
+
   goal_handle->publish_feedback(feedback);
 
   status_->conveyor_state = PackagingMachineStatus::AVAILABLE;
@@ -0,0 +1,172 @@
+#include "packaging_machine_control_system/order_scheduler.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace scheduler
+{
+
+OrderScheduler::OrderScheduler(size_t max_queued_orders, double default_cell_time)
+: max_queued_orders_(max_queued_orders),
+  default_cell_time_(default_cell_time),
+  mean_wait_(0.0),
+  dispatched_(0),
+  rejected_(0)
+{
+}
+
+size_t OrderScheduler::count_cells(const Goal &goal)
+{
+  // same as the packaging machine, a cell without name is not packed
+  return std::count_if(goal.print_info.begin(), goal.print_info.end(),
+    [](const auto &info) { return !info.en_name.empty(); });
+}
+
+bool OrderScheduler::enqueue(std::unique_ptr<Goal> goal)
+{
+  if (queue_.size() >= max_queued_orders_)
+  {
+    rejected_++;
+    return false;
+  }
+
+  const size_t cells = count_cells(*goal);
+  queue_.push_back(QueuedOrder{std::move(goal), cells, Clock::now()});
+  return true;
+}
+
+uint8_t OrderScheduler::select_machine(const std::vector<MachineSnapshot> &machines) const
+{
+  if (queue_.empty())
+    return 0;
+
+  const size_t cells = queue_.front().cells;
+  uint8_t best_id = 0;
+  double best_time = std::numeric_limits<double>::max();
+
+  for (const auto &machine : machines)
+  {
+    if (!machine.available)
+      continue;
+
+    double predicted = cells * cell_time(machine.id);
+    if (machine.temperature < MIN_TEMP)
+      predicted += (MIN_TEMP - machine.temperature) * SCHEDULER_HEATER_SEC_PER_DEGREE;
+
+    // the higher ID wins a tie, as before the scheduler
+    if (predicted < best_time || (predicted == best_time && machine.id > best_id))
+    {
+      best_time = predicted;
+      best_id = machine.id;
+    }
+  }
+
+  return best_id;
+}
+
+QueuedOrder OrderScheduler::pop(void)
+{
+  QueuedOrder order = std::move(queue_.front());
+  queue_.pop_front();
+  return order;
+}
+
+void OrderScheduler::push_front(QueuedOrder order)
+{
+  queue_.push_front(std::move(order));
+}
+
+double OrderScheduler::start(uint8_t machine_id, const QueuedOrder &order)
+{
+  const Clock::time_point now = Clock::now();
+
+  MachineLoad &machine = load(machine_id);
+  machine.cells = order.cells;
+  machine.started_at = now;
+  machine.running = true;
+
+  const double wait = seconds(now - order.enqueued_at);
+  mean_wait_ = dispatched_ == 0 ? wait : SCHEDULER_EMA_ALPHA * wait + (1.0 - SCHEDULER_EMA_ALPHA) * mean_wait_;
+  dispatched_++;
+
+  return wait;
+}
+
+void OrderScheduler::finish(uint8_t machine_id, bool success)
+{
+  MachineLoad &machine = load(machine_id);
+  if (!machine.running)
+    return;
+
+  machine.running = false;
+
+  // a failed order says nothing about the speed of the machine
+  if (!success || machine.cells == 0)
+    return;
+
+  const double sample = seconds(Clock::now() - machine.started_at) / machine.cells;
+  machine.cell_time = SCHEDULER_EMA_ALPHA * sample + (1.0 - SCHEDULER_EMA_ALPHA) * machine.cell_time;
+}
+
+double OrderScheduler::cell_time(uint8_t machine_id) const
+{
+  auto it = load_.find(machine_id);
+  return it != load_.end() ? it->second.cell_time : default_cell_time_;
+}
+
+double OrderScheduler::oldest_wait(void) const
+{
+  if (queue_.empty())
+    return 0.0;
+
+  return seconds(Clock::now() - queue_.front().enqueued_at);
+}
+
+double OrderScheduler::estimated_wait(size_t no_of_machines) const
+{
+  if (no_of_machines == 0)
+    return 0.0;
+
+  const Clock::time_point now = Clock::now();
+
+  size_t running = 0;
+  double cell_time_sum = 0.0;
+  double soonest_free = std::numeric_limits<double>::max();
+  for (const auto &[id, machine] : load_)
+  {
+    cell_time_sum += machine.cell_time;
+    if (machine.running)
+    {
+      running++;
+      soonest_free = std::min(soonest_free, remaining(machine, now));
+    }
+  }
+
+  if (running < no_of_machines)
+    soonest_free = 0.0;
+
+  const double avg_cell_time = load_.empty() ? default_cell_time_ : cell_time_sum / load_.size();
+
+  size_t queued_cells = 0;
+  for (const auto &order : queue_)
+    queued_cells += order.cells;
+
+  return soonest_free + queued_cells * avg_cell_time / no_of_machines;
+}
+
+OrderScheduler::MachineLoad &OrderScheduler::load(uint8_t machine_id)
+{
+  auto it = load_.find(machine_id);
+  if (it == load_.end())
+    it = load_.emplace(machine_id, MachineLoad{default_cell_time_, 0, Clock::time_point(), false}).first;
+
+  return it->second;
+}
+
+double OrderScheduler::remaining(const MachineLoad &load, Clock::time_point now) const
+{
+  const double predicted = load.cells * load.cell_time;
+  return std::max(0.0, predicted - seconds(now - load.started_at));
+}
+
+} // namespace scheduler
@@ -3,205 +3,269 @@
 namespace action_client
 {
 
-PackagingMachineActionClient::PackagingMachineActionClient(const rclcpp::NodeOptions & options)
-: Node("action_client", options),
-  goal_done_(false)
-  // print_info_(CELLS)
+PackagingMachineActionClient::PackagingMachineActionClient(
+  rclcpp::Node *node,
+  uint8_t packaging_machine_id,
+  ResultCallback result_cb)
+: node_(node),
+  packaging_machine_id_(packaging_machine_id),
+  order_id_(0),
+  material_box_id_(0),
+  status_changed_(false),
+  busy_(false),
+  goal_seq_(0),
+  machine_idle_(false),
+  server_lost_(false),
+  result_cb_(std::move(result_cb))
 {
-  this->declare_parameter<std::uint8_t>("packaging_machine_id", 0);
-  this->declare_parameter<std::int64_t>("order_id", 0);
-  this->declare_parameter<std::int64_t>("material_box_id", 0);
-  this->declare_parameter<std::vector<std::string>>("cn_name", std::vector<std::string>{});
-  this->declare_parameter<std::vector<std::string>>("en_name", std::vector<std::string>{});
-  this->declare_parameter<std::vector<std::string>>("date", std::vector<std::string>{});
-  this->declare_parameter<std::vector<std::string>>("time", std::vector<std::string>{});
-  this->declare_parameter<std::vector<std::string>>("drugs", std::vector<std::string>{});
-
-  std::vector<std::string> _cn_name;
-  std::vector<std::string> _en_name;
-  std::vector<std::string> _date;
-  std::vector<std::string> _time;
-  std::vector<std::string> _drugs;
-
-  this->get_parameter("packaging_machine_id", packaging_machine_id_);
-  this->get_parameter("order_id", order_id_);
-  this->get_parameter("material_box_id", material_box_id_);
-  this->get_parameter("cn_name", _cn_name);
-  this->get_parameter("en_name", _en_name);
-  this->get_parameter("date", _date);
-  this->get_parameter("time", _time);
-  this->get_parameter("drugs", _drugs);
-
-  for (size_t i = 0; i < CELLS; i++)
-  {
-    print_info_[i].cn_name = _cn_name[i];
-    print_info_[i].en_name = _en_name[i];
-    print_info_[i].date = _date[i];
-    print_info_[i].time = _time[i];
-    auto split_string = [](const std::string& s, char delimiter) {
-      std::vector<std::string> result;
-      std::stringstream ss(s);
-      std::string item;
-
-      while (std::getline(ss, item, delimiter)) {
-        result.push_back(item);
-      }
-
-      return result;
-    };
-    print_info_[i].drugs = split_string(_drugs[i], '#');
-  }
-
-  for (size_t i = 0; i < CELLS; i++)
-  {
-    RCLCPP_DEBUG(this->get_logger(), print_info_[i].cn_name.c_str());
-    RCLCPP_DEBUG(this->get_logger(), print_info_[i].en_name.c_str());
-    RCLCPP_DEBUG(this->get_logger(), print_info_[i].date.c_str());
-    RCLCPP_DEBUG(this->get_logger(), print_info_[i].time.c_str());
-    for (size_t j = 0; j < print_info_[i].drugs.size(); j++)
-    {
-      RCLCPP_DEBUG(this->get_logger(), print_info_[i].drugs[j].c_str());
-    }
-  }
-
   const std::string action_server = "/packaging_machine_" + std::to_string(packaging_machine_id_) + "/packaging_order";
-  
+
   packaging_status_ = std::make_shared<PackagingStatus>();
   packaging_status_->packaging_machine_id = packaging_machine_id_;
-  packaging_status_->order_id = order_id_;
 
-  this->client_ptr_ = rclcpp_action::create_client<PackagingOrder>(
-    this->get_node_base_interface(),
-    this->get_node_graph_interface(),
-    this->get_node_logging_interface(),
-    this->get_node_waitables_interface(),
-    action_server);
-
-  packaging_status_timer_ = this->create_wall_timer(
-    std::chrono::milliseconds(500),
-  std::bind(&PackagingMachineActionClient::pub_status_cb, this));
-
-  this->send_goal_timer_ = this->create_wall_timer(
-    std::chrono::milliseconds(500),
-    std::bind(&PackagingMachineActionClient::send_goal, this));
+  cbg_ = node_->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
 
-  result_pub_ = this->create_publisher<PackagingResult>("packaging_result", 10);
-  packaging_status_pub_ = this->create_publisher<PackagingStatus>("packaging_status", 10);
+  this->client_ptr_ = rclcpp_action::create_client<PackagingOrder>(
+    node_->get_node_base_interface(),
+    node_->get_node_graph_interface(),
+    node_->get_node_logging_interface(),
+    node_->get_node_waitables_interface(),
+    action_server,
+    cbg_);
+
+  RCLCPP_INFO(this->get_logger(), "An Action Client of Packaging Machine [%d] is created.", packaging_machine_id_);
+}
 
-  RCLCPP_INFO(this->get_logger(), "An Action Client Component is created.");
+bool PackagingMachineActionClient::is_idle(void)
+{
+  const std::lock_guard<std::mutex> lock(this->mutex_);
+  return !busy_;
 }
 
-inline bool PackagingMachineActionClient::is_goal_done(void) const
+bool PackagingMachineActionClient::is_server_ready(void) const
 {
-  return this->goal_done_;
+  return client_ptr_->action_server_is_ready();
 }
 
-void PackagingMachineActionClient::pub_status_cb(void)
+bool PackagingMachineActionClient::take_status(PackagingStatus &status)
 {
   const std::lock_guard<std::mutex> lock(this->mutex_);
-  packaging_status_pub_->publish(*packaging_status_);
+  if (!status_changed_)
+    return false;
+
+  status = *packaging_status_;
+  status_changed_ = false;
+  return true;
 }
 
-void PackagingMachineActionClient::send_goal(void)
+bool PackagingMachineActionClient::send_goal(std::unique_ptr<PackagingOrder::Goal> &&goal)
 {
-  using namespace std::placeholders;
+  uint64_t goal_seq;
+  {
+    const std::lock_guard<std::mutex> lock(this->mutex_);
+    if (busy_)
+    {
+      RCLCPP_ERROR(this->get_logger(), "Action client of machine [%d] is busy with order %u", packaging_machine_id_, order_id_);
+      return false;
+    }
+
+    if (!this->client_ptr_->action_server_is_ready())
+    {
+      RCLCPP_ERROR(this->get_logger(), "Action server of machine [%d] is not available", packaging_machine_id_);
+      return false;
+    }
 
-  this->send_goal_timer_->cancel();
+    busy_ = true;
+    goal_seq = ++goal_seq_;
+    sent_at_ = Clock::now();
+    machine_idle_ = false;
+    server_lost_ = false;
+    order_id_ = goal->order_id;
+    material_box_id_ = goal->material_box_id;
+
+    *packaging_status_ = PackagingStatus();
+    packaging_status_->packaging_machine_id = packaging_machine_id_;
+    packaging_status_->order_id = order_id_;
+    status_changed_ = true;
+  }
 
-  this->goal_done_ = false;
+  RCLCPP_INFO(this->get_logger(), "print_info size: %zu", goal->print_info.size());
 
-  if (!this->client_ptr_) 
+  auto send_goal_options = rclcpp_action::Client<PackagingOrder>::SendGoalOptions();
+  send_goal_options.goal_response_callback =
+    [this, goal_seq](const GaolHandlerPackagingOrder::SharedPtr &goal_handle) {
+      goal_response_callback(goal_seq, goal_handle);
+    };
+  send_goal_options.feedback_callback =
+    [this, goal_seq](GaolHandlerPackagingOrder::SharedPtr, const std::shared_ptr<const PackagingOrder::Feedback> feedback) {
+      feedback_callback(goal_seq, feedback);
+    };
+  send_goal_options.result_callback =
+    [this, goal_seq](const GaolHandlerPackagingOrder::WrappedResult &result) {
+      result_callback(goal_seq, result);
+    };
+
+  // async_send_goal copies the goal into its own request, the goal is released afterwards
+  auto goal_handle_future = this->client_ptr_->async_send_goal(*goal, send_goal_options);
+
+  RCLCPP_INFO(this->get_logger(), "Sent goal of order %u to machine [%d]", goal->order_id, packaging_machine_id_);
+  goal.reset();
+  return true;
+}
+
+bool PackagingMachineActionClient::finish_recovered(uint32_t order_id, bool success)
+{
+  uint64_t goal_seq;
   {
-    RCLCPP_ERROR(this->get_logger(), "Action client not initialized");
+    const std::lock_guard<std::mutex> lock(this->mutex_);
+    if (!busy_ || order_id_ != order_id)
+      return false;
+    goal_seq = goal_seq_;
   }
 
-  if (!this->client_ptr_->wait_for_action_server()) 
+  RCLCPP_WARN(this->get_logger(), "Order %u is resumed by machine [%d]", order_id, packaging_machine_id_);
+  return finish(goal_seq, success);
+}
+
+void PackagingMachineActionClient::check(bool machine_idle)
+{
+  const bool server_ready = client_ptr_->action_server_is_ready();
+  const auto now = Clock::now();
+
+  uint64_t goal_seq;
+  uint32_t order_id;
+  const char *reason = nullptr;
   {
-    RCLCPP_ERROR(this->get_logger(), "Action server not available after waiting");
-    this->goal_done_ = true;
-    return;
-  }
+    const std::lock_guard<std::mutex> lock(this->mutex_);
+    if (!busy_)
+      return;
 
-  RCLCPP_INFO(this->get_logger(), "Sending goal 3");
+    if (!server_ready)
+      server_lost_ = true;
 
-  auto goal_msg = PackagingOrder::Goal();
-  goal_msg.order_id = order_id_;
-  goal_msg.material_box_id = material_box_id_;
-  std::copy(print_info_.begin(), print_info_.end(), goal_msg.print_info.begin()); 
+    // the machine reports IDLE for a while after the goal is sent, it only counts
+    // once the goal is accepted or the server has been restarted
+    const bool waited_idle = machine_idle && server_ready && (packaging_status_->server_accepted || server_lost_);
+    if (!waited_idle)
+      machine_idle_ = false;
+    else if (!machine_idle_)
+    {
+      machine_idle_ = true;
+      idle_since_ = now;
+    }
 
-  RCLCPP_INFO(this->get_logger(), "print_info size: %zu", goal_msg.print_info.size());
-  
-  auto send_goal_options = rclcpp_action::Client<PackagingOrder>::SendGoalOptions();
-  send_goal_options.goal_response_callback =
-    std::bind(&PackagingMachineActionClient::goal_response_callback, this, _1);
-  send_goal_options.feedback_callback =
-    std::bind(&PackagingMachineActionClient::feedback_callback, this, _1, _2);
-  send_goal_options.result_callback =
-    std::bind(&PackagingMachineActionClient::result_callback, this, _1);
+    if (!packaging_status_->server_accepted && !server_lost_ && now - sent_at_ > ORDER_GOAL_RESPONSE_TIMEOUT)
+      reason = "no goal response";
+    else if (now - sent_at_ > ORDER_RESULT_TIMEOUT)
+      reason = "no result";
+    else if (machine_idle_ && server_lost_)
+      reason = "the action server was restarted and the machine is IDLE";
+    else if (machine_idle_ && now - idle_since_ > ORDER_IDLE_GRACE)
+      reason = "the machine is IDLE";
+
+    goal_seq = goal_seq_;
+    order_id = order_id_;
+  }
 
-  auto goal_handle_future = this->client_ptr_->async_send_goal(goal_msg, send_goal_options);
+  if (reason == nullptr)
+    return;
 
-  RCLCPP_INFO(this->get_logger(), "Sent goal");
+  // a late result of the goal is ignored, the machine is not given a new order before it is IDLE
+  RCLCPP_ERROR(this->get_logger(), "Order %u of machine [%d] is given up: %s", order_id, packaging_machine_id_, reason);
+  finish(goal_seq, false);
 }
 
-void PackagingMachineActionClient::goal_response_callback(const GaolHandlerPackagingOrder::SharedPtr & goal_handle)
+void PackagingMachineActionClient::goal_response_callback(
+  uint64_t goal_seq, 
+  const GaolHandlerPackagingOrder::SharedPtr & goal_handle)
 {
   if (!goal_handle) {
     RCLCPP_ERROR(this->get_logger(), "Goal was rejected by server");
+    finish(goal_seq, false);
   } else {
     const std::lock_guard<std::mutex> lock(this->mutex_);
+    if (goal_seq != goal_seq_ || !busy_)
+      return;
     packaging_status_->server_accepted = true;
+    status_changed_ = true;
     RCLCPP_INFO(this->get_logger(), "Goal accepted by server, waiting for result");
   }
 }
 
 void PackagingMachineActionClient::feedback_callback(
-  GaolHandlerPackagingOrder::SharedPtr,
+  uint64_t goal_seq,
   const std::shared_ptr<const PackagingOrder::Feedback> feedback)
 {
   const std::lock_guard<std::mutex> lock(this->mutex_);
+  if (goal_seq != goal_seq_ || !busy_)
+    return;
+
+  // the same feedback again is not worth a status
+  if (packaging_status_->are_drugs_fallen == feedback->are_drugs_fallen &&
+      packaging_status_->order_status == feedback->curr_order_status)
+    return;
+
   packaging_status_->are_drugs_fallen = feedback->are_drugs_fallen;
   packaging_status_->order_status = feedback->curr_order_status;
+  status_changed_ = true;
 
-  RCLCPP_INFO(this->get_logger(), "A feedback received");
+  RCLCPP_DEBUG(this->get_logger(), "A feedback received");
 }
 
-void PackagingMachineActionClient::result_callback(const GaolHandlerPackagingOrder::WrappedResult & result)
+void PackagingMachineActionClient::result_callback(
+  uint64_t goal_seq, 
+  const GaolHandlerPackagingOrder::WrappedResult & result)
 {
-  this->goal_done_ = true;
-
   switch (result.code) {
     case rclcpp_action::ResultCode::SUCCEEDED:
       break;
     case rclcpp_action::ResultCode::ABORTED:
       RCLCPP_ERROR(this->get_logger(), "Goal was aborted");
+      finish(goal_seq, false);
       return;
     case rclcpp_action::ResultCode::CANCELED:
       RCLCPP_ERROR(this->get_logger(), "Goal was canceled");
+      finish(goal_seq, false);
       return;
     default:
       RCLCPP_ERROR(this->get_logger(), "Unknown result code");
+      finish(goal_seq, false);
       return;
   }
 
+  if (finish(goal_seq, true))
+    RCLCPP_INFO(this->get_logger(), "Goal Done");
+}
+
+bool PackagingMachineActionClient::finish(uint64_t goal_seq, bool success)
+{
+  PackagingResult result_msg;
   {
     const std::lock_guard<std::mutex> lock(this->mutex_);
-    packaging_status_->is_completed = true;
-    packaging_status_pub_->publish(*packaging_status_);
+    if (goal_seq != goal_seq_ || !busy_)
+    {
+      RCLCPP_WARN(this->get_logger(), "A result of machine [%d] comes after its order was given up", packaging_machine_id_);
+      return false;
+    }
+
+    if (success)
+    {
+      packaging_status_->is_completed = true;
+      status_changed_ = true;
+    }
+
+    result_msg.success = success;
+    result_msg.packaging_machine_id = packaging_machine_id_;
+    result_msg.order_id = order_id_;
+    result_msg.material_box_id = material_box_id_;
+
+    // the worker takes the next order from now on
+    busy_ = false;
   }
-  
-  RCLCPP_INFO(this->get_logger(), "Goal Done");
 
-  PackagingResult result_msg;
-  result_msg.success = this->goal_done_;
-  result_msg.packaging_machine_id = packaging_machine_id_;
-  result_msg.order_id = order_id_;
-  result_msg.material_box_id = material_box_id_;
-  result_pub_->publish(result_msg);
+  if (result_cb_)
+    result_cb_(result_msg);
+  return true;
 }
 
 } // namespace action_client
-
-#include "rclcpp_components/register_node_macro.hpp"
-
-RCLCPP_COMPONENTS_REGISTER_NODE(action_client::PackagingMachineActionClient)
\ No newline at end of file
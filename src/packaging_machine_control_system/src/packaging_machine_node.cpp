@@ -11,7 +11,9 @@ PackagingMachineNode::PackagingMachineNode(const rclcpp::NodeOptions& options)
   this->declare_parameter<uint8_t>("packaging_machine_id", 0);
   this->declare_parameter<std::vector<long int>>("default_states", std::vector<long int>{});
   this->declare_parameter<std::vector<long int>>("ports", std::vector<long int>{});
+  this->declare_parameter<std::vector<std::string>>("port_paths", std::vector<std::string>{});
   this->declare_parameter<bool>("simulation", false);
+  this->declare_parameter<std::string>("journal_path", "");
 
   this->get_parameter("packaging_machine_id", status_->packaging_machine_id);
   this->get_parameter("simulation", sim_);
@@ -24,10 +26,15 @@ PackagingMachineNode::PackagingMachineNode(const rclcpp::NodeOptions& options)
   std::vector<long int> ports = this->get_parameter("ports").as_integer_array();
   printer_config_->port = ports[status_->packaging_machine_id - 1];
 
+  std::vector<std::string> port_paths = this->get_parameter("port_paths").as_string_array();
+  if (port_paths.size() >= status_->packaging_machine_id)
+    printer_config_->port_path = port_paths[status_->packaging_machine_id - 1];
+
   RCLCPP_DEBUG(this->get_logger(), "ID: %d", status_->packaging_machine_id);
   RCLCPP_DEBUG(this->get_logger(), "default_states size: %ld", default_states.size());
   RCLCPP_DEBUG(this->get_logger(), "packaging_machine_state: %d", status_->packaging_machine_state);
   RCLCPP_DEBUG(this->get_logger(), "port: %d", printer_config_->port);
+  RCLCPP_DEBUG(this->get_logger(), "port_path: %s", printer_config_->port_path.c_str());
 
   this->declare_parameter<uint16_t>("vendor_id", 0);
   this->declare_parameter<uint16_t>("product_id", 0);
@@ -43,6 +50,10 @@ PackagingMachineNode::PackagingMachineNode(const rclcpp::NodeOptions& options)
   this->declare_parameter<int>("interval", 0);
   this->declare_parameter<bool>("offset_x", false);
   this->declare_parameter<bool>("offset_y", false);
+  this->declare_parameter<std::string>("label_template", "");
+  this->declare_parameter<bool>("use_stored_form", false);
+  this->declare_parameter<std::string>("printer_backend", "usb");
+  this->declare_parameter<std::string>("printer_capture_path", "");
 
   this->get_parameter("vendor_id", printer_config_->vendor_id);
   this->get_parameter("product_id", printer_config_->product_id);
@@ -59,6 +70,36 @@ PackagingMachineNode::PackagingMachineNode(const rclcpp::NodeOptions& options)
   this->get_parameter("interval", printer_config_->interval);
   this->get_parameter("offset_x", printer_config_->offset_x);
   this->get_parameter("offset_y", printer_config_->offset_y);
+  this->get_parameter("printer_backend", printer_config_->backend);
+  this->get_parameter("printer_capture_path", printer_config_->capture_path);
+  if (printer_config_->capture_path.empty())
+    printer_config_->capture_path = "/tmp/packaging_machine_" + std::to_string(status_->packaging_machine_id) + ".prn";
+  if (printer_config_->backend != "usb")
+    RCLCPP_WARN(this->get_logger(), "Printer backend: %s, capture: %s", printer_config_->backend.c_str(), printer_config_->capture_path.c_str());
+
+  const std::string label_template_path = this->get_parameter("label_template").as_string();
+  if (label_template_path.empty())
+    label_template_ = std::make_shared<LabelTemplate>(LabelTemplate::defaultLayout());
+  else
+  {
+    label_template_ = std::make_shared<LabelTemplate>(LabelTemplate::fromFile(label_template_path));
+    RCLCPP_INFO(this->get_logger(), "Loaded label template: %s", label_template_path.c_str());
+  }
+
+  this->get_parameter("use_stored_form", use_stored_form_);
+  if (use_stored_form_)
+  {
+    try
+    {
+      stored_form_program_ = label_template_->formProgram();
+      RCLCPP_INFO(this->get_logger(), "Labels are printed from the stored form %s", LABEL_FORM_NAME);
+    }
+    catch (const std::runtime_error &e)
+    {
+      use_stored_form_ = false;
+      RCLCPP_WARN(this->get_logger(), "Stored form is disabled: %s", e.what());
+    }
+  }
 
   status_->header.frame_id = "Packaging Machine";
   status_->conveyor_state = PackagingMachineStatus::AVAILABLE;
@@ -82,6 +123,7 @@ PackagingMachineNode::PackagingMachineNode(const rclcpp::NodeOptions& options)
   motor_status_publisher_ = this->create_publisher<MotorStatus>("motor_status", 10); 
   info_publisher_ = this->create_publisher<PackagingMachineInfo>("info", 10); 
   unbind_mtrl_box_publisher_ = this->create_publisher<UnbindRequest>("unbind_material_box_id", 10); 
+  recovered_order_publisher_ = this->create_publisher<PackagingResult>("recovered_order", 10); 
 
   tpdo_pub_ = this->create_publisher<COData>(
     "/packaging_machine_" + std::to_string(status_->packaging_machine_id) + "/tpdo", 
@@ -176,6 +218,31 @@ PackagingMachineNode::PackagingMachineNode(const rclcpp::NodeOptions& options)
     rcl_action_server_get_default_options(),
     action_ser_cbg_);
 
+  std::string journal_path = this->get_parameter("journal_path").as_string();
+  if (journal_path.empty())
+    journal_path = "/tmp/packaging_machine_" + std::to_string(status_->packaging_machine_id) + ".journal";
+
+  journal_ = std::make_unique<journal::OrderJournal>(journal_path);
+  auto unfinished = std::make_shared<journal::Progress>();
+  if (!journal_->open())
+  {
+    RCLCPP_ERROR(this->get_logger(), "Failed to open the order journal %s: %s", journal_path.c_str(), std::strerror(errno));
+  }
+  else if (journal_->recover(*unfinished))
+  {
+    // the machine stays busy until the order is finished, the manager sends it nothing meanwhile
+    status_->packaging_machine_state = PackagingMachineStatus::BUSY;
+    status_->conveyor_state = unfinished->drugs_fallen ? PackagingMachineStatus::AVAILABLE : PackagingMachineStatus::UNAVAILABLE;
+    RCLCPP_WARN(this->get_logger(), "Order %u was interrupted after %u labels and %u packages, it is resumed", 
+      unfinished->order_id, unfinished->prints, unfinished->pushes);
+
+    // the CANopen services only answer once the node is spinning
+    resume_timer_ = this->create_wall_timer(1s, [this, unfinished]() {
+      resume_timer_->cancel();
+      std::thread{std::bind(&PackagingMachineNode::resume_order, this, _1), unfinished}.detach();
+    });
+  }
+
   RCLCPP_INFO(this->get_logger(), "Packaging Machine Node %d is up.", status_->packaging_machine_id);
 
   if (!sim_)
@@ -185,6 +252,20 @@ PackagingMachineNode::PackagingMachineNode(const rclcpp::NodeOptions& options)
     
     RCLCPP_INFO(this->get_logger(), "The CO Service client is up.");
   }
+
+  label_render_thread_ = std::thread(&PackagingMachineNode::label_render_worker, this);
+}
+
+PackagingMachineNode::~PackagingMachineNode()
+{
+  {
+    const std::lock_guard<std::mutex> lock(labels_mutex_);
+    labels_stop_ = true;
+  }
+  labels_cv_.notify_all();
+
+  if (label_render_thread_.joinable())
+    label_render_thread_.join();
 }
 
 void PackagingMachineNode::pub_status_cb(void)
@@ -518,18 +599,14 @@ void PackagingMachineNode::print_one_pkg_handle(
     return;
   }
 
-  printer_.reset();
-  printer_ = std::make_shared<Printer>(
-    printer_config_->vendor_id, 
-    printer_config_->product_id, 
-    printer_config_->serial,
-    printer_config_->port);
+  create_printer();
   RCLCPP_INFO(this->get_logger(), "printer initialized");
   init_printer_config();
 
   PackageInfo _msg;
-  std::vector<std::string> cmd = get_print_label_cmd(_msg);
-  printer_->runTask(cmd);
+  std::string label;
+  get_print_label_cmd(_msg, label);
+  printer_->runTask(label);
   RCLCPP_INFO(this->get_logger(), "printed a empty package");
   response->success = true;
 
@@ -544,7 +621,6 @@ void PackagingMachineNode::print_one_pkg_handle(
 
   ctrl_squeezer(SQUEEZER_ACTION_PULL, MOTOR_ENABLE);
   wait_for_squeezer(MotorStatus::IDLE);
-  printer_.reset();
 }
 
 // This service is designed for debugging only
@@ -596,17 +672,23 @@ rclcpp_action::GoalResponse PackagingMachineNode::handle_goal(
   RCLCPP_INFO(this->get_logger(), "set packaging_machine_state to BUSY");
   RCLCPP_INFO(this->get_logger(), "set conveyor_state to UNAVAILABLE");
 
-  printer_.reset();
-  printer_ = std::make_shared<Printer>(
-    printer_config_->vendor_id, 
-    printer_config_->product_id, 
-    printer_config_->serial,
-    printer_config_->port);
-  RCLCPP_INFO(this->get_logger(), "printer initialized");
-  init_printer_config();
+  // render the labels while waiting for the material box
+  prerender_labels(goal);
+
+  try
+  {
+    create_printer();
+    RCLCPP_INFO(this->get_logger(), "printer initialized");
+    init_printer_config();
 
-  ctrl_stopper(STOPPER_PROTRUDE);
-  wait_for_stopper(STOPPER_PROTRUDE_STATE);
+    ctrl_stopper(STOPPER_PROTRUDE);
+    wait_for_stopper(STOPPER_PROTRUDE_STATE);
+  }
+  catch (...)
+  {
+    drop_rendered_labels(goal->order_id);
+    throw;
+  }
 
   uint16_t retry = 0;
   const uint8_t MAX_RETIRES = 60;
@@ -629,6 +711,8 @@ rclcpp_action::GoalResponse PackagingMachineNode::handle_goal(
     RCLCPP_INFO(this->get_logger(), "retry(%d) >= MAX_RETIRES", retry);
     // lock.lock();
     status_->packaging_machine_state = PackagingMachineStatus::IDLE;
+
+    drop_rendered_labels(goal->order_id);
     return rclcpp_action::GoalResponse::REJECT;
   }
 
@@ -652,16 +736,4 @@ void PackagingMachineNode::handle_accepted(const std::shared_ptr<GaolHandlerPack
     std::thread{std::bind(&PackagingMachineNode::order_execute, this, _1), goal_handle}.detach();
 }
 
-int main(int argc, char **argv)
-{
-  rclcpp::init(argc, argv);
-  
-  auto exec = std::make_shared<rclcpp::executors::MultiThreadedExecutor>();
-  auto options = rclcpp::NodeOptions();
-  auto node = std::make_shared<PackagingMachineNode>(options);
-
-  exec->add_node(node->get_node_base_interface());
-  exec->spin();
-
-  rclcpp::shutdown();
-}
\ No newline at end of file
+RCLCPP_COMPONENTS_REGISTER_NODE(PackagingMachineNode)
@@ -0,0 +1,133 @@
+#include "printer/gbk_converter.h"
+
+#include <cstdio>
+
+namespace {
+
+// iconv descriptors are not thread-safe, so every thread owns one
+struct ThreadDescriptor {
+  iconv_t cd = iconv_open("GBK", "UTF-8");
+  std::string buf;
+
+  ~ThreadDescriptor()
+  {
+    if (cd != (iconv_t)(-1))
+      iconv_close(cd);
+  }
+};
+
+ThreadDescriptor &thread_descriptor()
+{
+  thread_local ThreadDescriptor td;
+  return td;
+}
+
+} // namespace
+
+GbkConverter::GbkConverter(size_t capacity)
+  : capacity_(capacity == 0 ? 1 : capacity)
+{
+}
+
+GbkConverter &GbkConverter::instance()
+{
+  static GbkConverter converter;
+  return converter;
+}
+
+std::string GbkConverter::convert(const std::string &utf8_string)
+{
+  std::string gbk_string;
+  if (!append(utf8_string, gbk_string))
+    return "";
+
+  return gbk_string;
+}
+
+bool GbkConverter::append(const std::string &utf8_string, std::string &out)
+{
+  if (utf8_string.empty())
+    return true;
+
+  if (lookup(utf8_string, out))
+    return true;
+
+  const size_t offset = out.size();
+  if (!convert_uncached(utf8_string, out))
+  {
+    out.resize(offset);
+    return false;
+  }
+
+  insert(utf8_string, out.substr(offset));
+  return true;
+}
+
+void GbkConverter::clear()
+{
+  const std::lock_guard<std::mutex> lock(mutex_);
+  index_.clear();
+  lru_.clear();
+}
+
+bool GbkConverter::lookup(const std::string &utf8_string, std::string &out)
+{
+  const std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(utf8_string);
+  if (it == index_.end())
+    return false;
+
+  lru_.splice(lru_.begin(), lru_, it->second);
+  out.append(it->second->second);
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void GbkConverter::insert(const std::string &utf8_string, const std::string &gbk_string)
+{
+  const std::lock_guard<std::mutex> lock(mutex_);
+  if (index_.find(utf8_string) != index_.end())
+    return;
+
+  lru_.emplace_front(utf8_string, gbk_string);
+  index_.emplace(utf8_string, lru_.begin());
+
+  if (lru_.size() > capacity_)
+  {
+    index_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+}
+
+bool GbkConverter::convert_uncached(const std::string &utf8_string, std::string &out)
+{
+  auto &td = thread_descriptor();
+  if (td.cd == (iconv_t)(-1))
+  {
+    perror("iconv_open failed");
+    return false;
+  }
+
+  // 重置转换状态
+  iconv(td.cd, nullptr, nullptr, nullptr, nullptr);
+
+  // GBK 编码不会比 UTF-8 长, 预留空间以防万一
+  if (td.buf.size() < utf8_string.size() * 2)
+    td.buf.resize(utf8_string.size() * 2);
+
+  char *in_buf = const_cast<char*>(utf8_string.data());
+  size_t in_bytes_left = utf8_string.size();
+  char *out_ptr = &td.buf[0];
+  size_t out_bytes_left = td.buf.size();
+
+  size_t result = iconv(td.cd, &in_buf, &in_bytes_left, &out_ptr, &out_bytes_left);
+  if (result == (size_t)(-1))
+  {
+    perror("iconv failed");
+    return false;
+  }
+
+  out.append(td.buf.data(), td.buf.size() - out_bytes_left);
+  conversions_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
@@ -0,0 +1,375 @@
+#include "printer/label_template.h"
+#include "printer/gbk_converter.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+const char *const LabelTemplate::kDefaultLayout =
+  "TEXT 240,180,\"TSS24.BF2\",0,2,2,\"${cn_name}\"\n"
+  "TEXT 600,186,\"TSS24.BF2\",0,2,2,\"${en_name}\"\n"
+  "TEXT 240,270,\"4\",0,1,1,\"${date}\"\n"
+  "TEXT 240,334,\"4\",0,1,1,\"${time}\"\n"
+  "QRCODE 684,252,L,6,A,0,\"${qr_code}\"\n"
+  "@drugs 400 64\n"
+  "TEXT 240,${drug_y},\"TSS24.BF2\",0,2,2,\"${drug}\"\n"
+  "@footer\n"
+  "PRINT 1,1\n";
+
+namespace {
+
+struct SlotName {
+  const char *name;
+  size_t index;
+};
+
+// TSPL string variables of the stored form, drug lines use D0$, D1$, ...
+const char *const form_variables[] = { nullptr, "CN$", "EN$", "DT$", "TM$", "QR$" };
+
+// index into the values array of renderSegments, DRUG and DRUG_Y are handled separately
+const SlotName slot_names[] = {
+  { "cn_name", 1 },
+  { "en_name", 2 },
+  { "date", 3 },
+  { "time", 4 },
+  { "qr_code", 5 },
+  { "drug", 6 },
+  { "drug_y", 7 },
+};
+
+void append_int(int value, std::string &buf)
+{
+  char digits[16];
+  size_t n = 0;
+  const bool negative = value < 0;
+  unsigned int v = negative ? -static_cast<unsigned int>(value) : static_cast<unsigned int>(value);
+
+  do
+  {
+    digits[n++] = static_cast<char>('0' + v % 10);
+    v /= 10;
+  } while (v != 0);
+
+  if (negative)
+    buf.push_back('-');
+  while (n > 0)
+    buf.push_back(digits[--n]);
+}
+
+} // namespace
+
+LabelTemplate::LabelTemplate(const std::string &text)
+{
+  enum { HEADER, DRUGS, FOOTER } section = HEADER;
+
+  std::istringstream iss(text);
+  std::string line;
+  while (std::getline(iss, line))
+  {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    if (line.compare(0, 6, "@drugs") == 0)
+    {
+      std::istringstream args(line.substr(6));
+      if (!(args >> drug_y_ >> drug_step_))
+        throw std::runtime_error("label template: invalid @drugs directive: " + line);
+      size_t drug_max;
+      if (args >> drug_max)
+        drug_max_ = drug_max;
+      section = DRUGS;
+      continue;
+    }
+
+    if (line == "@footer")
+    {
+      section = FOOTER;
+      continue;
+    }
+
+    if (line[0] == '@')
+      throw std::runtime_error("label template: unknown directive: " + line);
+
+    switch (section)
+    {
+    case HEADER:
+      compileLine(line, header_);
+      header_lines_.push_back(line);
+      break;
+    case DRUGS:
+      compileLine(line, drug_block_);
+      drug_lines_.push_back(line);
+      break;
+    case FOOTER:
+      compileLine(line, footer_);
+      footer_lines_.push_back(line);
+      break;
+    }
+  }
+
+  if (footer_.empty())
+    throw std::runtime_error("label template: missing @footer section");
+
+  // enough for the layout with typical names and a handful of drug lines
+  reserve_ = literals_.size() * 2 + 512;
+}
+
+LabelTemplate LabelTemplate::fromFile(const std::string &path)
+{
+  std::ifstream ifs(path);
+  if (!ifs)
+    throw std::runtime_error("label template: failed to open " + path);
+
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  return LabelTemplate(ss.str());
+}
+
+LabelTemplate LabelTemplate::defaultLayout()
+{
+  return LabelTemplate(kDefaultLayout);
+}
+
+void LabelTemplate::compileLine(const std::string &line, std::vector<Segment> &segments)
+{
+  size_t pos = 0;
+  while (pos < line.size())
+  {
+    const size_t begin = line.find("${", pos);
+    if (begin == std::string::npos)
+      break;
+
+    const size_t end = line.find('}', begin + 2);
+    if (end == std::string::npos)
+      throw std::runtime_error("label template: unterminated slot: " + line);
+
+    appendLiteral(line.substr(pos, begin - pos), segments);
+
+    const std::string name = line.substr(begin + 2, end - begin - 2);
+    bool found = false;
+    for (const auto &slot_name : slot_names)
+    {
+      if (name == slot_name.name)
+      {
+        segments.push_back({ static_cast<Slot>(slot_name.index), 0, 0 });
+        found = true;
+        break;
+      }
+    }
+
+    if (!found)
+      throw std::runtime_error("label template: unknown slot: " + name);
+
+    pos = end + 1;
+  }
+
+  appendLiteral(line.substr(pos) + "\r\n", segments);
+}
+
+void LabelTemplate::appendLiteral(const std::string &text, std::vector<Segment> &segments)
+{
+  if (text.empty())
+    return;
+
+  // merge with the previous literal so that a label is a few large appends
+  if (!segments.empty() && segments.back().slot == Slot::LITERAL &&
+      segments.back().offset + segments.back().length == literals_.size())
+  {
+    segments.back().length += text.size();
+    literals_ += text;
+    return;
+  }
+
+  segments.push_back({ Slot::LITERAL, static_cast<uint32_t>(literals_.size()), static_cast<uint32_t>(text.size()) });
+  literals_ += text;
+}
+
+void LabelTemplate::render(
+  const std::string &cn_name,
+  const std::string &en_name,
+  const std::string &date,
+  const std::string &time,
+  const std::string &qr_code,
+  const std::vector<std::string> &drugs,
+  std::string &buf) const
+{
+  if (en_name.empty())
+  {
+    renderEmpty(buf);
+    return;
+  }
+
+  buf.reserve(buf.size() + reserve_);
+
+  const std::string *const values[] = { nullptr, &cn_name, &en_name, &date, &time, &qr_code };
+
+  renderSegments(header_, values, nullptr, 0, buf);
+  for (size_t i = 0; i < drugs.size(); i++)
+    renderSegments(drug_block_, values, &drugs[i], drug_y_ + static_cast<int>(i) * drug_step_, buf);
+  renderSegments(footer_, values, nullptr, 0, buf);
+}
+
+void LabelTemplate::renderEmpty(std::string &buf) const
+{
+  static const std::string empty;
+  const std::string *const values[] = { nullptr, &empty, &empty, &empty, &empty, &empty };
+  renderSegments(footer_, values, nullptr, 0, buf);
+}
+
+void LabelTemplate::renderSegments(
+  const std::vector<Segment> &segments,
+  const std::string *const values[],
+  const std::string *drug,
+  int drug_y,
+  std::string &buf) const
+{
+  for (const auto &segment : segments)
+  {
+    switch (segment.slot)
+    {
+    case Slot::LITERAL:
+      buf.append(literals_, segment.offset, segment.length);
+      break;
+    case Slot::CN_NAME:
+      GbkConverter::instance().append(*values[static_cast<size_t>(segment.slot)], buf);
+      break;
+    case Slot::EN_NAME:
+    case Slot::DATE:
+    case Slot::TIME:
+    case Slot::QR_CODE:
+      buf.append(*values[static_cast<size_t>(segment.slot)]);
+      break;
+    case Slot::DRUG:
+      if (drug)
+        GbkConverter::instance().append(*drug, buf);
+      break;
+    case Slot::DRUG_Y:
+      append_int(drug_y, buf);
+      break;
+    }
+  }
+}
+
+std::string LabelTemplate::formProgram() const
+{
+  std::string program;
+
+  for (const auto &line : header_lines_)
+    appendFormLine(line, 0, 0, program);
+  for (size_t i = 0; i < drug_max_; i++)
+  {
+    for (const auto &line : drug_lines_)
+      appendFormLine(line, i, drug_y_ + static_cast<int>(i) * drug_step_, program);
+  }
+  for (const auto &line : footer_lines_)
+    appendFormLine(line, 0, 0, program);
+
+  return program;
+}
+
+bool LabelTemplate::renderFormValues(
+  const std::string &cn_name,
+  const std::string &en_name,
+  const std::string &date,
+  const std::string &time,
+  const std::string &qr_code,
+  const std::vector<std::string> &drugs,
+  const std::string &form_name,
+  std::string &buf) const
+{
+  if (en_name.empty() || drugs.size() > drug_max_)
+    return false;
+
+  appendFormValue(form_variables[1], cn_name, true, buf);
+  appendFormValue(form_variables[2], en_name, false, buf);
+  appendFormValue(form_variables[3], date, false, buf);
+  appendFormValue(form_variables[4], time, false, buf);
+  appendFormValue(form_variables[5], qr_code, false, buf);
+
+  static const std::string empty;
+  for (size_t i = 0; i < drug_max_; i++)
+  {
+    const std::string variable = "D" + std::to_string(i) + "$";
+    appendFormValue(variable.c_str(), i < drugs.size() ? drugs[i] : empty, true, buf);
+  }
+
+  buf += form_name;
+  buf += "\r\n";
+  return true;
+}
+
+void LabelTemplate::appendFormLine(const std::string &line, size_t drug_index, int drug_y, std::string &buf)
+{
+  size_t pos = 0;
+  while (pos < line.size())
+  {
+    const size_t begin = line.find("${", pos);
+    if (begin == std::string::npos)
+      break;
+
+    const size_t end = line.find('}', begin + 2);
+    const std::string name = line.substr(begin + 2, end - begin - 2);
+
+    if (name == "drug_y")
+    {
+      buf.append(line, pos, begin - pos);
+      append_int(drug_y, buf);
+      pos = end + 1;
+      continue;
+    }
+
+    // a variable replaces the whole quoted string
+    if (begin == 0 || line[begin - 1] != '"' || end + 1 >= line.size() || line[end + 1] != '"')
+      throw std::runtime_error("label template: slot is not a quoted string: " + line);
+
+    buf.append(line, pos, begin - 1 - pos);
+    if (name == "drug")
+    {
+      buf += 'D';
+      append_int(static_cast<int>(drug_index), buf);
+      buf += '$';
+    }
+    else
+    {
+      for (const auto &slot_name : slot_names)
+      {
+        if (name == slot_name.name)
+        {
+          buf += form_variables[slot_name.index];
+          break;
+        }
+      }
+    }
+    pos = end + 2;
+  }
+
+  buf.append(line, pos, std::string::npos);
+  buf += "\r\n";
+}
+
+void LabelTemplate::appendFormValue(const char *variable, const std::string &value, bool gbk, std::string &buf)
+{
+  buf += variable;
+  buf += "=\"";
+
+  const size_t offset = buf.size();
+  if (gbk)
+    GbkConverter::instance().append(value, buf);
+  else
+    buf += value;
+
+  // TSPL escapes a double quote inside a string as \["]
+  for (size_t i = offset; i < buf.size(); i++)
+  {
+    if (buf[i] == '"')
+    {
+      buf.replace(i, 1, "\\[\"]");
+      i += 3;
+    }
+  }
+
+  buf += "\"\r\n";
+}
@@ -5,24 +5,32 @@
 
 #include "printer/config.h"
 #include "printer/printer.h"
-#include "printer/libusbxx.hpp"
+#include "printer/gbk_converter.h"
+#include "printer/printer_backend.h"
 
 Printer::Printer(uint16_t vendor_id, uint16_t product_id, std::string_view serial_num, uint8_t port)
-  : usb_(std::make_unique<libusbxx>()) 
+  : backend_(std::make_unique<UsbPrinterBackend>(vendor_id, product_id, serial_num, port)) 
+{
+}
+
+Printer::Printer(uint16_t vendor_id, uint16_t product_id, std::string_view serial_num, std::string_view location)
+  : backend_(std::make_unique<UsbPrinterBackend>(vendor_id, product_id, serial_num, location)) 
 {
-  usb_->openDevice(vendor_id, product_id, serial_num, port);
 }
 
 Printer::Printer(uint16_t vendor_id, uint16_t product_id, std::string_view serial_num)
-  : usb_(std::make_unique<libusbxx>()) 
+  : backend_(std::make_unique<UsbPrinterBackend>(vendor_id, product_id, serial_num)) 
 {
-  usb_->openDevice(vendor_id, product_id, serial_num);
 }
 
 Printer::Printer(uint16_t vendor_id, uint16_t product_id)
-  : usb_(std::make_unique<libusbxx>()) 
+  : backend_(std::make_unique<UsbPrinterBackend>(vendor_id, product_id)) 
+{
+}
+
+Printer::Printer(std::unique_ptr<PrinterBackend> backend)
+  : backend_(std::move(backend)) 
 {
-  usb_->openDevice(vendor_id, product_id);
 }
 
 Printer::~Printer() = default;
@@ -36,12 +44,15 @@ void Printer::configure(uint8_t endpoint_in, uint8_t endpoint_out, uint32_t time
 
 void Printer::addDefaultConfig(const std::string &name, const std::string &config) 
 {
-  default_cmd_.try_emplace(name, config);
+  if (default_cmd_.try_emplace(name, config).second) {
+    default_cmd_dirty_ = true;
+    forms_.clear();
+  }
 }
 
 void Printer::addDefaultConfig(const std::string &cmd) 
 {
-  default_cmd_.try_emplace(cmd, "");
+  addDefaultConfig(cmd, "");
 }
 
 bool Printer::updateDefaultConfig(const std::string &name, const std::string &config) 
@@ -49,6 +60,9 @@ bool Printer::updateDefaultConfig(const std::string &name, const std::string &co
   // if (default_cmd_.contains(name)) {
   if (default_cmd_.find(name) != default_cmd_.end()) {
     default_cmd_[name] = config;
+    default_cmd_dirty_ = true;
+    // 已下载的表单包含旧配置
+    forms_.clear();
     return true;
   }
 
@@ -57,55 +71,102 @@ bool Printer::updateDefaultConfig(const std::string &name, const std::string &co
 
 void Printer::runTask(const std::vector<std::string> &cmds) 
 {
-  for (auto &[name, config]: default_cmd_) {
-    // usb_->bulkTransfer(endpoint_out_, std::format("{} {}\r\n", name, config), timeout_);
-    usb_->bulkTransfer(endpoint_out_, name + " " + config + "\r\n", timeout_);
-  }
+  const std::string &default_cmd = defaultConfig();
 
-  for (auto command: cmds) {
-    // usb_->bulkTransfer(endpoint_out_, std::format("{}\r\n", command), timeout_);
-    usb_->bulkTransfer(endpoint_out_, command + "\r\n", timeout_);
+  task_buf_.clear();
+  task_buf_ += default_cmd;
+  for (auto &command: cmds) {
+    task_buf_ += command;
+    task_buf_ += "\r\n";
   }
+
+  send();
 }
 
-std::string Printer::convert_utf8_to_gbk(const std::string &utf8_string) 
+void Printer::runTask(const std::string &label) 
 {
-  // 设置转换
-  iconv_t cd = iconv_open("GBK", "UTF-8");
-  if (cd == (iconv_t)(-1)) {
-      perror("iconv_open failed");
-      return "";
-  }
+  const std::string &default_cmd = defaultConfig();
+
+  // 默认配置与标签内容合并为一次传输
+  task_buf_.clear();
+  task_buf_.reserve(default_cmd.size() + label.size());
+  task_buf_ += default_cmd;
+  task_buf_ += label;
 
-  // 准备输入和输出
-  char *in_buf = const_cast<char*>(utf8_string.c_str());
-  size_t in_bytes_left = utf8_string.size();
-  
-  // 预分配输出缓冲区，GBK 编码可能会稍大
-  size_t out_buf_size = in_bytes_left * 2; // 预留空间
-  char *out_buf = new char[out_buf_size];
-  char *out_ptr = out_buf;
-  size_t out_bytes_left = out_buf_size;
-
-  // 执行转换
-  size_t result = iconv(cd, &in_buf, &in_bytes_left, &out_ptr, &out_bytes_left);
-  
-  if (result == (size_t)(-1)) {
-    perror("iconv failed");
-    delete[] out_buf;
-    iconv_close(cd);
-    return "";
+  send();
+}
+
+void Printer::downloadForm(const std::string &name, const std::string &program) 
+{
+  if (hasForm(name))
+    return;
+
+  const std::string &default_cmd = defaultConfig();
+
+  // 默认配置写入表单, 运行表单时无需再次发送
+  task_buf_.clear();
+  task_buf_.reserve(name.size() + default_cmd.size() + program.size() + 32);
+  task_buf_ += "DOWNLOAD \"";
+  task_buf_ += name;
+  task_buf_ += ".BAS\"\r\n";
+  task_buf_ += default_cmd;
+  task_buf_ += program;
+  task_buf_ += "EOP\r\n";
+
+  send();
+  forms_.insert(name);
+}
+
+bool Printer::hasForm(const std::string &name) const 
+{
+  return forms_.find(name) != forms_.end();
+}
+
+void Printer::runForm(const std::string &cmd) 
+{
+  task_buf_.assign(cmd);
+  send();
+}
+
+bool Printer::busy() const 
+{
+  return backend_->busy();
+}
+
+bool Printer::failed() const 
+{
+  return failed_;
+}
+
+void Printer::send() 
+{
+  try {
+    backend_->write(endpoint_out_, reinterpret_cast<const uint8_t *>(task_buf_.data()), task_buf_.size(), timeout_);
+  } catch (...) {
+    failed_ = true;
+    throw;
   }
+}
 
-  // 计算转换后的字符串长度
-  size_t converted_length = out_buf_size - out_bytes_left;
-  
-  // 生成输出字符串
-  std::string gbk_string(out_buf, converted_length);
+const std::string &Printer::defaultConfig() 
+{
+  if (default_cmd_dirty_) 
+  {
+    default_cmd_buf_.clear();
+    for (auto &[name, config]: default_cmd_) {
+      default_cmd_buf_ += name;
+      default_cmd_buf_ += ' ';
+      default_cmd_buf_ += config;
+      default_cmd_buf_ += "\r\n";
+    }
+    default_cmd_dirty_ = false;
+  }
 
-  // 清理
-  delete[] out_buf;
-  iconv_close(cd);
+  return default_cmd_buf_;
+}
 
-  return gbk_string;
-}
\ No newline at end of file
+std::string Printer::convert_utf8_to_gbk(const std::string &utf8_string) 
+{
+  // iconv 描述符按线程复用, 转换结果缓存于 GbkConverter
+  return GbkConverter::instance().convert(utf8_string);
+}
@@ -0,0 +1,118 @@
+#include "printer/printer_backend.h"
+#include "printer/libusbxx.hpp"
+
+#include <thread>
+#include <cstring>
+#include <stdexcept>
+
+// ===================================== usb =====================================
+UsbPrinterBackend::UsbPrinterBackend(uint16_t vendor_id, uint16_t product_id, std::string_view serial, uint8_t port)
+  : usb_(std::make_unique<libusbxx>())
+{
+  usb_->openDevice(vendor_id, product_id, serial, port);
+}
+
+UsbPrinterBackend::UsbPrinterBackend(uint16_t vendor_id, uint16_t product_id, std::string_view serial, std::string_view location)
+  : usb_(std::make_unique<libusbxx>())
+{
+  usb_->openDevice(vendor_id, product_id, serial, location);
+}
+
+UsbPrinterBackend::UsbPrinterBackend(uint16_t vendor_id, uint16_t product_id, std::string_view serial)
+  : usb_(std::make_unique<libusbxx>())
+{
+  usb_->openDevice(vendor_id, product_id, serial);
+}
+
+UsbPrinterBackend::UsbPrinterBackend(uint16_t vendor_id, uint16_t product_id)
+  : usb_(std::make_unique<libusbxx>())
+{
+  usb_->openDevice(vendor_id, product_id);
+}
+
+UsbPrinterBackend::~UsbPrinterBackend() = default;
+
+void UsbPrinterBackend::write(uint8_t endpoint, const uint8_t *data, size_t length, uint32_t timeout)
+{
+  // libusb 不会修改发送缓冲区
+  usb_->bulkTransfer(endpoint, const_cast<uint8_t *>(data), static_cast<int>(length), timeout);
+}
+
+// ===================================== capture =====================================
+CapturePrinterBackend::CapturePrinterBackend(const std::string &path)
+  : stream_(path, std::ios::binary | std::ios::trunc),
+    index_(path + ".idx", std::ios::trunc),
+    start_(std::chrono::steady_clock::now())
+{
+  if (!stream_)
+    throw std::runtime_error("Failed to open printer capture: " + path);
+  if (!index_)
+    throw std::runtime_error("Failed to open printer capture index: " + path + ".idx");
+}
+
+void CapturePrinterBackend::write(uint8_t endpoint, const uint8_t *data, size_t length, uint32_t timeout)
+{
+  (void) endpoint;
+  (void) timeout;
+
+  const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_);
+
+  const std::lock_guard<std::mutex> lock(mutex_);
+  stream_.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(length));
+  stream_.flush();
+  index_ << elapsed.count() << ' ' << offset_ << ' ' << length << '\n';
+  index_.flush();
+
+  if (!stream_ || !index_)
+    throw std::runtime_error("Failed to write printer capture");
+
+  offset_ += length;
+}
+
+// ===================================== throttled =====================================
+ThrottledPrinterBackend::ThrottledPrinterBackend(
+  double bytes_per_second,
+  std::chrono::milliseconds label_time,
+  size_t buffered_labels,
+  std::unique_ptr<PrinterBackend> next)
+  : bytes_per_second_(bytes_per_second),
+    label_time_(label_time),
+    buffered_labels_(buffered_labels == 0 ? 1 : buffered_labels),
+    next_(std::move(next)),
+    busy_until_(std::chrono::steady_clock::now())
+{
+  if (bytes_per_second_ <= 0)
+    throw std::runtime_error("Throttled printer needs a positive transfer rate");
+}
+
+void ThrottledPrinterBackend::write(uint8_t endpoint, const uint8_t *data, size_t length, uint32_t timeout)
+{
+  static const char download[] = "DOWNLOAD";
+  const bool is_label = length < sizeof(download) - 1 || std::memcmp(data, download, sizeof(download) - 1) != 0;
+
+  std::chrono::steady_clock::time_point wait_until;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    const auto now = std::chrono::steady_clock::now();
+    const auto transfer = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(length / bytes_per_second_));
+
+    // 打印机缓冲区已满时等待最早的标签打印完成
+    const auto start = std::max(now, busy_until_ - label_time_ * static_cast<int>(buffered_labels_ - 1));
+    wait_until = start + transfer;
+
+    if (is_label)
+      busy_until_ = std::max(busy_until_, wait_until) + label_time_;
+  }
+
+  std::this_thread::sleep_until(wait_until);
+
+  if (next_)
+    next_->write(endpoint, data, length, timeout);
+}
+
+bool ThrottledPrinterBackend::busy() const
+{
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return std::chrono::steady_clock::now() < busy_until_;
+}
@@ -0,0 +1,72 @@
+#ifndef SMDPS_COMMON__STATUS_TABLE_HPP_
+#define SMDPS_COMMON__STATUS_TABLE_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Latest message of every packaging machine, indexed by packaging_machine_id.
+//
+// The whole table is an immutable version behind one shared_ptr. A writer
+// copies the table, replaces its own entry and publishes the copy with a
+// compare-and-swap, a reader takes the current version in one atomic load.
+// It is not lock-free: libstdc++ guards the atomic shared_ptr functions with a
+// small pool of mutexes, held only while the pointer is loaded or swapped and
+// never while a table is copied or read. A snapshot stays consistent for as
+// long as the reader holds it, whatever is published meanwhile.
+// (std::atomic<std::shared_ptr> replaces these functions from C++20 on.)
+template <typename T, size_t N = 16>
+class StatusTable
+{
+public:
+  using Entry = std::shared_ptr<const T>;
+  using Table = std::array<Entry, N>;
+  using Snapshot = std::shared_ptr<const Table>;
+
+  StatusTable()
+  : table_(std::make_shared<const Table>())
+  {
+  }
+
+  static constexpr size_t capacity(void) { return N; }
+
+  // Publishes a new version of the entry and returns the one it replaced,
+  // an id beyond the table is dropped and returns nullptr
+  Entry update(size_t id, const T &value)
+  {
+    if (id >= N)
+      return nullptr;
+
+    const Entry entry = std::make_shared<const T>(value);
+
+    Snapshot curr = std::atomic_load(&table_);
+    Snapshot next;
+    do
+    {
+      auto table = std::make_shared<Table>(*curr);
+      (*table)[id] = entry;
+      next = std::move(table);
+    } while (!std::atomic_compare_exchange_weak(&table_, &curr, next));
+
+    return (*curr)[id];
+  }
+
+  Snapshot snapshot(void) const
+  {
+    return std::atomic_load(&table_);
+  }
+
+  Entry get(size_t id) const
+  {
+    if (id >= N)
+      return nullptr;
+
+    return (*snapshot())[id];
+  }
+
+private:
+  Snapshot table_;
+};
+
+#endif  // SMDPS_COMMON__STATUS_TABLE_HPP_
@@ -0,0 +1,96 @@
+#ifndef ACCESS_LOG__
+#define ACCESS_LOG__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+// A record per HTTP request, fixed size so that logging it copies and allocates nothing
+struct AccessRecord
+{
+  uint64_t id;
+  int64_t stamp_ms;     // system clock of the response
+  uint32_t latency_us;
+  uint32_t req_bytes;
+  uint32_t res_bytes;
+  int32_t status;
+  char method[8];
+  char path[96];        // cut if longer
+};
+
+// The access log of the HTTP server.
+//
+// log() puts a record into a preallocated ring without a lock, the threads
+// of the server never wait for each other nor for the disk. A full ring drops
+// the record and counts it. A writer thread drains the ring every
+// flush_period, formats the records as JSON lines and appends them to the
+// file, which is rotated to path.1 at max_bytes, and to the sink if any.
+class AccessLog
+{
+public:
+  using Sink = std::function<void(const std::string &lines)>;
+
+  struct Config
+  {
+    size_t capacity = 4096;                           // records, rounded up to a power of 2
+    std::string path;                                 // no file if empty
+    size_t max_bytes = 64 * 1024 * 1024;
+    std::chrono::milliseconds flush_period{200};
+  };
+
+  AccessLog(const Config &config, Sink sink = nullptr);
+  ~AccessLog();
+
+  AccessLog(const AccessLog &) = delete;
+  AccessLog &operator=(const AccessLog &) = delete;
+
+  // false if the ring is full and the record is dropped
+  bool log(const AccessRecord &record);
+
+  uint64_t dropped(void) const { return dropped_.load(std::memory_order_relaxed); }
+
+  // the string is cut to fit the field, which stays terminated
+  template <size_t N>
+  static void copy_field(char (&field)[N], const std::string &value)
+  {
+    const size_t size = value.size() < N - 1 ? value.size() : N - 1;
+    value.copy(field, size);
+    field[size] = '\0';
+  }
+
+private:
+  struct Slot
+  {
+    std::atomic<uint64_t> seq;
+    AccessRecord record;
+  };
+
+  const Config config_;
+  const Sink sink_;
+
+  std::unique_ptr<Slot[]> slots_;
+  size_t mask_;
+  alignas(64) std::atomic<uint64_t> head_;  // next position to write, shared by the server threads
+  alignas(64) uint64_t tail_;               // next position to read, the writer only
+  std::atomic<uint64_t> dropped_;
+  uint64_t dropped_reported_;
+
+  std::atomic<bool> stop_;
+  FILE *file_;
+  size_t file_bytes_;
+  std::string lines_;
+  std::thread writer_;
+
+  void writer(void);
+  void drain(void);
+  bool pop(AccessRecord &record);
+  void append_line(const AccessRecord &record);
+  void write_file(void);
+};
+
+#endif // ACCESS_LOG__
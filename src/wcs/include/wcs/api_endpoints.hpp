@@ -24,8 +24,10 @@ const std::string abnormal_device = "/abnormalDevice";
 const std::string dispense_request = "/dispenseRequest";
 const std::string packaging_request = "/packagingRequest";
 const std::string packaging_info = "/packagingMachineInfo";
+const std::string mtrl_box_status = "/materialBoxStatus";
 const std::string init_pkg_mac = "/initPackagingMachine";
 const std::string order_completion = "/orderCompletion";
+const std::string mtrl_box_assignment = "/materialBoxAssignment";
 const std::string cleaning_mac_scan = "/cleaningMachine";
 const std::string mtrl_box_con_scan = "/materialBoxContainer";
 const std::string pkg_mac_scan = "/packagingMachines";
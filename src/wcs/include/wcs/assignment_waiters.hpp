@@ -0,0 +1,77 @@
+#ifndef ASSIGNMENT_WAITERS__
+#define ASSIGNMENT_WAITERS__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// The orders waiting for their material box, keyed by the order id of jinli.
+//
+// The jinli server tells the assignment of a material box to the callback of
+// the HTTP server, assign() wakes the order waiting for it at once. Polling
+// is kept as the fallback: while no callback came for callback_fresh the
+// order polls from min_poll, doubled up to max_poll, otherwise it only polls
+// every quiet_poll in case a callback is missed. An assignment arriving
+// before its order waits is kept for early_ttl.
+class AssignmentWaiters
+{
+public:
+  // the material box id of the order, 0 if it is not assigned yet
+  using Poll = std::function<uint32_t(void)>;
+  using KeepWaiting = std::function<bool(void)>;
+
+  struct Config
+  {
+    std::chrono::milliseconds min_poll{1000};
+    std::chrono::milliseconds max_poll{8000};
+    std::chrono::milliseconds quiet_poll{30000};
+    std::chrono::milliseconds callback_fresh{600000};
+    std::chrono::milliseconds early_ttl{60000};
+  };
+
+  explicit AssignmentWaiters(const Config &config);
+
+  AssignmentWaiters(const AssignmentWaiters &) = delete;
+  AssignmentWaiters &operator=(const AssignmentWaiters &) = delete;
+
+  // the material box id, 0 if the order is not assigned within timeout or keep_waiting turns false
+  uint32_t wait(
+    const std::string &order_id,
+    std::chrono::milliseconds timeout,
+    const Poll &poll,
+    const KeepWaiting &keep_waiting);
+
+  // true if an order was waiting for it
+  bool assign(const std::string &order_id, uint32_t mtrl_box_id);
+
+  size_t waiting(void);
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Slot
+  {
+    std::condition_variable assigned;
+    uint32_t mtrl_box_id = 0;
+    bool waited = false;
+    Clock::time_point since;
+  };
+
+  const Config config_;
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<Slot>> slots_;
+  bool callback_seen_;
+  Clock::time_point last_callback_;
+
+  // mutex_ must be held
+  std::shared_ptr<Slot> slot(const std::string &order_id);
+  bool callback_fresh(Clock::time_point now) const;
+};
+
+#endif // ASSIGNMENT_WAITERS__
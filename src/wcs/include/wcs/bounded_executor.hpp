@@ -0,0 +1,55 @@
+#ifndef BOUNDED_EXECUTOR__
+#define BOUNDED_EXECUTOR__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the slow part of HTTP requests on a few workers with a hard limit.
+//
+// A task gets a ticket which holds its place until the last copy of it is
+// dropped, so a task which hands its ticket to the callback of a service
+// call stays counted until the response comes. try_submit() refuses a task
+// at once while capacity tickets are out, the caller answers 503 instead of
+// letting a burst pile up on the threads of the HTTP server.
+class BoundedExecutor
+{
+public:
+  using Ticket = std::shared_ptr<void>;
+  using Task = std::function<void(Ticket)>;
+
+  BoundedExecutor(size_t workers, size_t capacity);
+  ~BoundedExecutor();
+
+  BoundedExecutor(const BoundedExecutor &) = delete;
+  BoundedExecutor &operator=(const BoundedExecutor &) = delete;
+
+  // false if the executor is full or stopped
+  bool try_submit(Task task);
+
+  size_t in_flight(void);
+  size_t capacity(void) const { return capacity_; }
+
+private:
+  // kept by the tickets, a ticket may outlive the executor in a callback
+  struct State
+  {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::pair<Task, Ticket>> tasks;
+    size_t in_flight = 0;
+    bool stop = false;
+  };
+
+  const size_t capacity_;
+  std::shared_ptr<State> state_;
+  std::vector<std::thread> workers_;
+
+  static void worker(std::shared_ptr<State> state);
+};
+
+#endif // BOUNDED_EXECUTOR__
@@ -0,0 +1,79 @@
+#ifndef HTTP_CLIENT_POOL__
+#define HTTP_CLIENT_POOL__
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "httplib/httplib.h"
+
+// A fixed set of keep-alive HTTP clients of one server.
+//
+// Every request takes a client for itself and gives it back when the response
+// is read, so concurrent callers neither share a socket nor wait for each
+// other while a client is free. The connection of a client stays open between
+// its requests. A caller waits up to acquire_timeout for a free client, the
+// request fails with Error::Connection after that.
+class HttpClientPool
+{
+public:
+  struct EndpointStats
+  {
+    uint64_t requests = 0;
+    uint64_t failures = 0;   // no response or not 200
+    double total_ms = 0.0;   // from the call to the response, waiting included
+    double max_ms = 0.0;
+    double waited_ms = 0.0;  // waiting for a free client
+  };
+
+  HttpClientPool(
+    const std::string &host,
+    int port,
+    size_t size,
+    std::chrono::milliseconds connection_timeout,
+    std::chrono::milliseconds read_timeout,
+    std::chrono::milliseconds acquire_timeout);
+
+  // a timeout of 0 uses the read timeout of the pool
+  httplib::Result Get(
+    const std::string &path,
+    const httplib::Params &params = {},
+    const httplib::Headers &headers = {},
+    std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+  httplib::Result Post(
+    const std::string &path,
+    const httplib::Headers &headers,
+    const std::string &body,
+    const std::string &content_type,
+    std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+  size_t size(void) const { return size_; }
+  size_t idle(void);
+
+  // the statistics of each path since the last call
+  std::map<std::string, EndpointStats> take_stats(void);
+
+private:
+  const size_t size_;
+  const std::chrono::milliseconds read_timeout_;
+  const std::chrono::milliseconds acquire_timeout_;
+
+  std::mutex mutex_;
+  std::condition_variable released_;
+  std::vector<std::unique_ptr<httplib::Client>> idle_;
+
+  std::mutex stats_mutex_;
+  std::map<std::string, EndpointStats> stats_;
+
+  std::unique_ptr<httplib::Client> acquire(void);
+  void release(std::unique_ptr<httplib::Client> client);
+
+  template <typename Request>
+  httplib::Result perform(const std::string &path, std::chrono::milliseconds timeout, Request &&request);
+};
+
+#endif // HTTP_CLIENT_POOL__
@@ -0,0 +1,157 @@
+#ifndef JSON_CODEC__
+#define JSON_CODEC__
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Typed bodies of the busiest jinli endpoints.
+//
+// The decoders run the SAX parser of nlohmann::json over the body and fill
+// the structs directly, no document is built and the unknown fields are
+// skipped. A missing field keeps its default. The new order is written
+// straight from the slots of the order.
+namespace json_codec
+{
+
+struct Location
+{
+  uint8_t dispenser_station = 0;
+  uint8_t dispenser_unit = 0;
+};
+
+// the order id of jinli, it comes as a number or a string
+struct OrderId
+{
+  std::string text;
+  int64_t number = 0;
+  bool is_number = false;
+
+  std::string key(void) const { return is_number ? std::to_string(number) : text; }
+
+  template <typename T>
+  void assign_to(T &out) const
+  {
+    if constexpr (std::is_arithmetic<T>::value)
+      out = static_cast<T>(is_number ? number : std::strtoll(text.c_str(), nullptr, 10));
+    else
+      out = key();
+  }
+};
+
+// POST dispenseRequest
+struct DispenseLocation
+{
+  uint8_t dispenser_station = 0;
+  uint8_t dispenser_unit = 0;
+  uint32_t amount = 0;
+};
+
+struct DispenseRequest
+{
+  std::vector<DispenseLocation> locations;
+};
+
+// POST orderCompletion
+struct OrderCompletion
+{
+  std::vector<uint32_t> material_box_ids;
+};
+
+// POST abnormalDispensation
+struct AbnormalDispensation
+{
+  OrderId order_id;
+  std::string error_msg;
+};
+
+// cellsInfoByMaterialBoxId
+struct CellDrug
+{
+  uint32_t amount = 0;
+  bool is_completed = false;
+  std::vector<Location> locations;
+};
+
+struct Cell
+{
+  size_t cell_id = 0; // 0 if jinli does not give it
+  std::vector<CellDrug> drugs;
+};
+
+struct CellsInfo
+{
+  std::vector<Cell> cells;
+};
+
+// false with the reason in error if the body is not JSON
+bool decode(const std::string &body, DispenseRequest &out, std::string *error = nullptr);
+bool decode(const std::string &body, OrderCompletion &out, std::string *error = nullptr);
+bool decode(const std::string &body, AbnormalDispensation &out, std::string *error = nullptr);
+bool decode(const std::string &body, CellsInfo &out, std::string *error = nullptr);
+
+void append_string(std::string &out, const std::string &value);
+void append_uint(std::string &out, uint64_t value);
+
+// newOrder, {"cells":[...]} with slots[order[i]] as the cell i, a cell
+// without drugs is null. The slots are anything with drugs of amount,
+// drug_id and locations of dispenser_station and dispenser_unit.
+template <typename Slots>
+void encode_new_order(const Slots &slots, const std::vector<size_t> &order, std::string &out)
+{
+  out.clear();
+  out.reserve(16 + order.size() * 96);
+  out += "{\"cells\":[";
+
+  for (size_t i = 0; i < order.size(); i++)
+  {
+    if (i > 0)
+      out += ',';
+
+    const auto &slot = slots[order[i]];
+    if (slot.drugs.empty())
+    {
+      out += "null";
+      continue;
+    }
+
+    out += "{\"drugs\":[";
+    for (size_t j = 0; j < slot.drugs.size(); j++)
+    {
+      const auto &drug = slot.drugs[j];
+      if (j > 0)
+        out += ',';
+
+      out += "{\"amount\":";
+      append_uint(out, drug.amount);
+      out += ",\"drugId\":";
+      append_string(out, drug.drug_id);
+
+      if (!drug.locations.empty())
+      {
+        out += ",\"locations\":[";
+        for (size_t k = 0; k < drug.locations.size(); k++)
+        {
+          if (k > 0)
+            out += ',';
+          out += "{\"dispenserStation\":";
+          append_uint(out, drug.locations[k].dispenser_station);
+          out += ",\"dispenserUnit\":";
+          append_uint(out, drug.locations[k].dispenser_unit);
+          out += '}';
+        }
+        out += ']';
+      }
+      out += '}';
+    }
+    out += "]}";
+  }
+
+  out += "]}";
+}
+
+} // namespace json_codec
+
+#endif // JSON_CODEC__
@@ -0,0 +1,107 @@
+#ifndef OUTBOX__
+#define OUTBOX__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Write-ahead log of the requests which must reach the jinli server.
+//
+// A request is appended to a memory-mapped file before it is sent for the
+// first time and marked complete once the server took it, the requests still
+// pending when the node stops are handed to the next run, which only sends
+// again those that are safe to repeat. Appending is a
+// memcpy into the map, a flusher thread commits the appended records with one
+// msync per commit_window, so the requests arriving together share a sync.
+// append() returns once its record is committed, or 0 if the sync failed and
+// the record was dropped. complete() does not wait, a completion lost in a
+// crash hands the request to the next run once more. The completed
+// requests are dropped by compact(), which rewrites the file when most of it
+// is dead.
+class Outbox
+{
+public:
+  struct Entry
+  {
+    uint64_t id;
+    std::string endpoint;
+    std::string body;
+  };
+
+  Outbox(const std::string &path, size_t initial_size, std::chrono::milliseconds commit_window);
+  ~Outbox();
+
+  Outbox(const Outbox &) = delete;
+  Outbox &operator=(const Outbox &) = delete;
+
+  // maps the file and gives the requests not completed by the last run
+  bool open(std::vector<Entry> &pending);
+
+  // the id of the request once it is on the disk, 0 if it could not be stored
+  uint64_t append(const std::string &endpoint, const std::string &body);
+  void complete(uint64_t id);
+
+  // false if the file is not rewritten, it is not worth or it failed
+  bool compact(void);
+
+  size_t pending(void);
+  const std::string &path(void) const { return path_; }
+
+private:
+  enum class Type : uint8_t
+  {
+    REQUEST = 1,  // the payload is the endpoint, a '\0' and the body
+    COMPLETE = 2,
+  };
+
+  struct Header
+  {
+    uint32_t size;     // of the body: type, id and payload, 0 ends the log
+    uint32_t checksum; // FNV-1a of the body
+  };
+
+  static constexpr size_t BODY_SIZE = sizeof(uint8_t) + sizeof(uint64_t);
+
+  const std::string path_;
+  const size_t initial_size_;
+  const std::chrono::milliseconds commit_window_;
+
+  std::mutex mutex_;
+  std::condition_variable dirty_;
+  std::condition_variable committed_cv_;
+
+  int fd_;
+  uint8_t *map_;
+  size_t capacity_;
+  size_t tail_;      // end of the last record
+  size_t committed_; // end of the records on the disk
+  bool syncing_;     // the flusher is in msync, the map must stay
+  bool stop_;
+  uint64_t epoch_;   // compactions, the offsets of an epoch mean nothing in the next
+  uint64_t next_id_;
+  std::map<uint64_t, Entry> pending_;
+
+  std::thread flusher_;
+
+  void flusher(void);
+
+  // mutex_ must be held for the rest
+  bool write_record(std::unique_lock<std::mutex> &lock, Type type, uint64_t id, const std::string &payload);
+  bool map_file(int fd, size_t capacity);
+  void unmap(void);
+  // the records after committed_ are cleared after a failed sync
+  void drop_uncommitted(void);
+  bool sync_dir(void);
+  // makes room for a record of size at the tail, may wait for the flusher
+  bool reserve(std::unique_lock<std::mutex> &lock, size_t size);
+
+  static uint32_t checksum(const uint8_t *data, size_t size);
+};
+
+#endif // OUTBOX__
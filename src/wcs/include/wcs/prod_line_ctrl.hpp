@@ -3,13 +3,25 @@
 
 #include <chrono>
 #include <functional>
+#include <future>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "rclcpp/rclcpp.hpp"
 #include "rclcpp_action/rclcpp_action.hpp"
+#include "rclcpp/serialization.hpp"
 
+#include "wcs/access_log.hpp"
 #include "wcs/api_endpoints.hpp"
+#include "wcs/assignment_waiters.hpp"
+#include "wcs/bounded_executor.hpp"
+#include "wcs/http_client_pool.hpp"
+#include "wcs/json_codec.hpp"
+#include "wcs/outbox.hpp"
+#include "wcs/retry_scheduler.hpp"
+#include "smdps_common/status_table.hpp"
 #include "wcs/prod_line_ctrl.hpp"
 #include "httplib/httplib.h"
 #include "nlohmann/json.hpp"
@@ -47,6 +59,7 @@ using std::placeholders::_3;
 
 class ProdLineCtrl : public rclcpp::Node
 {
+  using String = std_msgs::msg::String;
   using UInt8 = std_msgs::msg::UInt8;
   using Trigger = std_srvs::srv::Trigger;
 
@@ -88,13 +101,26 @@ public:
 
 private:
   std::mutex mutex_;
-  std::map<uint8_t, PackagingMachineStatus> pkg_mac_status_;
+  // indexed by packaging_machine_id, written and read without mutex_
+  StatusTable<PackagingMachineStatus> pkg_mac_status_;
 
   std::map<uint8_t, OrderRequest> orders_;
 
+  struct MtrlBoxCacheEntry
+  {
+    uint64_t hash; // of the status without its stamp
+    MaterialBoxStatus status;
+  };
+
+  std::mutex mtrl_box_cache_mutex_;
+  // material box id, the last status published of the boxes with an order
+  std::unordered_map<uint32_t, MtrlBoxCacheEntry> mtrl_box_cache_;
+
   rclcpp::TimerBase::SharedPtr hc_timer_;
   rclcpp::TimerBase::SharedPtr mtrl_box_amt_timer_;
   rclcpp::TimerBase::SharedPtr mtrl_box_info_timer_;
+  rclcpp::TimerBase::SharedPtr httpcli_stats_timer_;
+  rclcpp::TimerBase::SharedPtr outbox_compact_timer_;
 
   rclcpp::CallbackGroup::SharedPtr srv_ser_cbg_;
   rclcpp::CallbackGroup::SharedPtr srv_cli_cbg_;
@@ -109,6 +135,7 @@ private:
   rclcpp::Publisher<ScannerTrigger>::SharedPtr scan_pub_;
   rclcpp::Publisher<OrderCompletion>::SharedPtr order_compl_pub_;
   rclcpp::Publisher<MaterialBoxStatus>::SharedPtr mtrl_box_status_pub_;
+  rclcpp::Publisher<String>::SharedPtr access_log_pub_;
 
   rclcpp::Subscription<PackagingMachineStatus>::SharedPtr pkg_mac_status_sub_;
   rclcpp::Subscription<UnbindRequest>::SharedPtr unbind_mtrl_id_sub_;
@@ -121,8 +148,12 @@ private:
   rclcpp_action::Server<NewOrder>::SharedPtr action_server_;
 
   void hc_cb(void);
+  void httpcli_stats_cb(void);
+  void outbox_compact_cb(void);
   void mtrl_box_amt_container_cb(void);
   void mtrl_box_info_cb(void);
+  bool get_mtrl_box_status(const nlohmann::json &mtrl_box, MaterialBoxStatus &msg);
+  static uint64_t hash_mtrl_box_status(const MaterialBoxStatus &msg);
   void pkg_mac_status_cb(const PackagingMachineStatus::SharedPtr msg);
   void unbind_mtrl_id_cb(const UnbindRequest::SharedPtr msg);
 
@@ -140,19 +171,50 @@ private:
   std::string httpsvr_ip_; // FIXME
   int httpsvr_port_; // FIXME 
   const size_t DATA_CHUNK_SIZE = 4; // FIXME 
-
+  static constexpr uint64_t DATA_MAX_LENGTH = 1024 * 1024 * 16; // 16MB
+  const std::chrono::milliseconds SERVICE_CALL_TIMEOUT = 500ms;
+  int http_svr_threads_;
+  int http_svr_max_queued_; // connections waiting for a thread, 0 for no limit
+  std::atomic<uint64_t> http_req_seq_; // the last X-Request-Id given
+
+  enum class ServiceCall
+  {
+    DONE,
+    UNAVAILABLE, // the service is not up
+    OVERLOADED,  // svc_executor_ is full
+    TIMEOUT,
+  };
+
+  // the request is made and sent on svc_executor_, the caller waits up to SERVICE_CALL_TIMEOUT.
+  // httplib wants the response before the handler returns, so the HTTP thread is
+  // blocked for that bounded wait, http_svr_threads is kept above http_svc_max_in_flight
+  template <typename ServiceT>
+  ServiceCall call_service(
+    const typename rclcpp::Client<ServiceT>::SharedPtr &client,
+    std::function<std::shared_ptr<typename ServiceT::Request>(void)> make_request,
+    std::shared_ptr<typename ServiceT::Response> &response);
+  // false if the response is set for a call which is not DONE
+  bool reply_service_call(ServiceCall call, const std::string &name, httplib::Response &res, nlohmann::json &res_json);
+  static void reply_unavailable(httplib::Response &res, nlohmann::json &res_json, const std::string &msg);
+  std::shared_ptr<PackagingOrder::Request> make_pkg_order_request(uint8_t id);
+
+  // the body in one buffer sized by Content-Length
+  static void read_body(const httplib::Request &req, const httplib::ContentReader &ctx_reader, std::string &body);
   void health_handler(const httplib::Request &req, httplib::Response &res);
   void abnormal_dis_handler(const httplib::Request &req, httplib::Response &res, const httplib::ContentReader &ctx_reader);
   void abnormal_device_handler(const httplib::Request &req, httplib::Response &res, const httplib::ContentReader &ctx_reader);
   void dis_req_handler(const httplib::Request &req, httplib::Response &res, const httplib::ContentReader &ctx_reader);
   void pkg_req_handler(const httplib::Request &req, httplib::Response &res);
   void pkg_mac_info_handler(const httplib::Request &req, httplib::Response &res);
+  void mtrl_box_status_handler(const httplib::Request &req, httplib::Response &res);
   void order_comp_handler(const httplib::Request &req, httplib::Response &res, const httplib::ContentReader &ctx_reader);
+  void mtrl_box_assignment_handler(const httplib::Request &req, httplib::Response &res, const httplib::ContentReader &ctx_reader);
   void scanner_handler(const httplib::Request &req, httplib::Response &res, const std::string &location);
   void init_pkg_mac_handler(const httplib::Request &req, httplib::Response &res);
 
   // void dis_result_handler(std::vector<std::tuple<uint8_t, bool, ServiceSharedFutureAndRequestId>> futures);
 
+  // a record per request to access_log_, the full dump only at the debug level
   void logger_handler(const httplib::Request& req, const httplib::Response& res);
   void error_handler(const httplib::Request &req, httplib::Response &res);
   void exception_handler(const httplib::Request &req, httplib::Response &res, std::exception_ptr ep);
@@ -163,6 +225,15 @@ private:
   const std::string jinli_protocol_ = "http"; // FIXME
   std::string jinli_ip_;
   int jinli_port_;
+  int httpcli_pool_size_;
+  int httpcli_connection_timeout_ms_;
+  int httpcli_read_timeout_ms_;
+  int httpcli_acquire_timeout_ms_;
+  const std::chrono::milliseconds HEALTH_CHECK_TIMEOUT = 500ms; // connecting and reading each, within the period of hc_cb
+  const std::chrono::milliseconds MTRL_BOX_INFO_PERIOD = 3s;
+  const std::chrono::milliseconds OUTBOX_COMPACT_PERIOD = 60s;
+  const std::chrono::milliseconds MTRL_BOX_ASSIGNMENT_TIMEOUT = 600s;
+  int mtrl_box_info_workers_; // material boxes fetched at the same time, at most jinli_pool_size - 1
 
   size_t no_of_dis_stations_;
   size_t no_of_pkg_mac_;
@@ -172,24 +243,45 @@ private:
   
   bool get_mtrl_box_info(nlohmann::json &body_json);
   bool get_mtrl_box_info_by_id(const httplib::Params &params, nlohmann::json &res_json);
-  bool get_cells_info_by_id(const httplib::Params &params, nlohmann::json &res_json);
+  bool get_cells_info_by_id(const httplib::Params &params, json_codec::CellsInfo &cells_info);
   bool get_cell_info_by_id_and_cell_id(const httplib::Params &params, nlohmann::json &res_json);
   bool get_mtrl_box_amt(nlohmann::json &res_json);
-  bool new_order(const nlohmann::json &req_json, nlohmann::json &res_json);
-  void new_order_until_success(const nlohmann::json &req_json, nlohmann::json &res_json);
+  bool new_order(const std::string &req_body, nlohmann::json &res_json);
+  // false if the retries are given up after jinli_retry_deadline_sec
+  bool new_order_until_success(const std::string &req_body, nlohmann::json &res_json);
+  // the request is stored in the outbox before it is retried, an outbox_id of 0 stores it
+  void send_outbound(
+    uint64_t outbox_id,
+    const std::string &endpoint, 
+    const std::string &req_body, 
+    std::function<void(bool, const nlohmann::json &)> done);
+  bool post_outbound(const std::string &endpoint, const std::string &req_body, nlohmann::json &res_json);
+  // resends the dispense results of the last run, its orders are only reported
+  void replay_outbox(const std::vector<Outbox::Entry> &pending);
   bool get_order_by_id(const httplib::Params &params, nlohmann::json &res_json);
-  bool dis_result(const nlohmann::json &req_json, nlohmann::json &res_json);
-  void dis_result_until_success(const nlohmann::json &req_json, nlohmann::json &res_json);
+  // the order id of jinli as the key of the waiters, it comes as a number or a string
+  static std::string order_id_key(const nlohmann::json &order_id);
+  bool dis_result(const std::string &req_body, nlohmann::json &res_json);
   bool health_check(nlohmann::json &res_json);
 
-  void perform_until_success(
-    const nlohmann::json &req_json, 
-    nlohmann::json &res_json, 
-    std::function<bool(const nlohmann::json&, nlohmann::json&)> func);
-
 protected:
   std::shared_ptr<httplib::Server> httpsvr_;
-  std::shared_ptr<httplib::Client> httpcli_;
+  // shared by the timers, the order threads and the retry workers
+  std::shared_ptr<HttpClientPool> httpcli_pool_;
+  // a client of its own, a busy httpcli_pool_ does not make jinli look down
+  std::shared_ptr<HttpClientPool> health_cli_pool_;
+  // requests to the jinli server which have to get through
+  std::unique_ptr<RetryScheduler> jinli_retry_;
+  // what jinli_retry_ has not sent yet survives a restart in it
+  std::unique_ptr<Outbox> outbox_;
+  // the orders waiting for their material box
+  std::unique_ptr<AssignmentWaiters> assignment_waiters_;
+  // the slow work of the HTTP handlers, off the threads of httpsvr_
+  std::unique_ptr<BoundedExecutor> svc_executor_;
+  std::unique_ptr<BoundedExecutor> dis_executor_;
+  // the other workers of mtrl_box_info_cb, kept between the refreshes
+  std::unique_ptr<BoundedExecutor> mtrl_box_executor_;
+  std::unique_ptr<AccessLog> access_log_;
   std::atomic<bool> svr_started_;
   bool jinli_ser_state_;
   std::thread httpsvr_thread_;
@@ -0,0 +1,106 @@
+#ifndef RETRY_SCHEDULER__
+#define RETRY_SCHEDULER__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Retries requests to a remote server until they succeed, on a few workers.
+//
+// A request is an attempt function returning true once it is done. A failed
+// attempt is tried again after a backoff that doubles up to max_backoff, each
+// delay is shortened by a random part of up to jitter so that the retries of
+// an outage do not come back at the same time. At most max_in_flight attempts
+// of an endpoint run at once, the others wait for them. While the circuit is
+// open, i.e. the server is known to be down, nothing is attempted and the
+// requests wait without growing their backoff.
+class RetryScheduler
+{
+public:
+  enum class Outcome : uint8_t
+  {
+    SENT,
+    GIVEN_UP, // the deadline passed
+    STOPPED,  // the scheduler was destroyed first
+  };
+
+  using Attempt = std::function<bool(void)>;
+  // called once with the outcome of the request
+  using Done = std::function<void(Outcome)>;
+  using CircuitClosed = std::function<bool(void)>;
+
+  struct Config
+  {
+    size_t workers = 2;
+    size_t max_in_flight = 2;                          // attempts of one endpoint at once
+    std::chrono::milliseconds initial_backoff{200};
+    std::chrono::milliseconds max_backoff{30000};
+    double jitter = 0.5;                               // part of a delay which is random
+    std::chrono::milliseconds circuit_wait{1000};      // between checks of an open circuit
+    std::chrono::milliseconds deadline{0};             // a request is given up after it, 0 never
+  };
+
+  RetryScheduler(const Config &config, CircuitClosed circuit_closed);
+  ~RetryScheduler();
+
+  RetryScheduler(const RetryScheduler &) = delete;
+  RetryScheduler &operator=(const RetryScheduler &) = delete;
+
+  // the first attempt is made as soon as a worker and the endpoint are free
+  void submit(const std::string &endpoint, Attempt attempt, Done done = nullptr);
+
+  size_t pending(void);
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Task
+  {
+    uint64_t seq;
+    std::string endpoint;
+    Attempt attempt;
+    Done done;
+    uint32_t attempts;
+    Clock::time_point due;
+    Clock::time_point submitted_at;
+    std::chrono::milliseconds backoff;
+  };
+
+  struct Later
+  {
+    bool operator()(const Task &a, const Task &b) const
+    {
+      return a.due > b.due || (a.due == b.due && a.seq > b.seq);
+    }
+  };
+
+  const Config config_;
+  const CircuitClosed circuit_closed_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_;
+  uint64_t seq_;
+  std::priority_queue<Task, std::vector<Task>, Later> tasks_;
+  // endpoint, attempts running and the tasks waiting for one of them
+  std::map<std::string, size_t> in_flight_;
+  std::map<std::string, std::deque<Task>> blocked_;
+  std::mt19937 rng_;
+
+  std::vector<std::thread> workers_;
+
+  void worker(void);
+  // the delay before the next attempt, mutex_ must be held
+  std::chrono::milliseconds next_delay(Task &task);
+};
+
+#endif // RETRY_SCHEDULER__
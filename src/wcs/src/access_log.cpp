@@ -0,0 +1,169 @@
+#include "wcs/access_log.hpp"
+
+#include <charconv>
+#include <cstdio>
+#include <sys/stat.h>
+
+#include "wcs/json_codec.hpp"
+
+AccessLog::AccessLog(const Config &config, Sink sink)
+: config_(config),
+  sink_(std::move(sink)),
+  head_(0),
+  tail_(0),
+  dropped_(0),
+  dropped_reported_(0),
+  stop_(false),
+  file_(nullptr),
+  file_bytes_(0)
+{
+  size_t capacity = 1;
+  while (capacity < config_.capacity)
+    capacity <<= 1;
+
+  slots_.reset(new Slot[capacity]);
+  mask_ = capacity - 1;
+  for (size_t i = 0; i < capacity; i++)
+    slots_[i].seq.store(i, std::memory_order_relaxed);
+
+  lines_.reserve(capacity * 160);
+  writer_ = std::thread(&AccessLog::writer, this);
+}
+
+AccessLog::~AccessLog()
+{
+  stop_.store(true);
+  if (writer_.joinable())
+    writer_.join();
+
+  if (file_)
+    std::fclose(file_);
+}
+
+bool AccessLog::log(const AccessRecord &record)
+{
+  uint64_t pos = head_.load(std::memory_order_relaxed);
+
+  while (true)
+  {
+    Slot &slot = slots_[pos & mask_];
+    const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    const int64_t diff = static_cast<int64_t>(seq - pos);
+
+    if (diff == 0)
+    {
+      // the slot is free at pos, it is taken once head_ moves past it
+      if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+      {
+        slot.record = record;
+        slot.seq.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    }
+    else if (diff < 0)
+    {
+      // the writer has not read the slot of the last round yet
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    else
+    {
+      pos = head_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool AccessLog::pop(AccessRecord &record)
+{
+  Slot &slot = slots_[tail_ & mask_];
+  if (slot.seq.load(std::memory_order_acquire) != tail_ + 1)
+    return false;
+
+  record = slot.record;
+  slot.seq.store(tail_ + mask_ + 1, std::memory_order_release);
+  tail_++;
+  return true;
+}
+
+void AccessLog::writer(void)
+{
+  while (!stop_.load())
+  {
+    std::this_thread::sleep_for(config_.flush_period);
+    drain();
+  }
+  drain();
+}
+
+void AccessLog::drain(void)
+{
+  lines_.clear();
+
+  AccessRecord record;
+  while (pop(record))
+    append_line(record);
+
+  const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+  if (dropped != dropped_reported_)
+  {
+    lines_ += "{\"dropped\":";
+    json_codec::append_uint(lines_, dropped - dropped_reported_);
+    lines_ += "}\n";
+    dropped_reported_ = dropped;
+  }
+
+  if (lines_.empty())
+    return;
+
+  write_file();
+  if (sink_)
+    sink_(lines_);
+}
+
+void AccessLog::append_line(const AccessRecord &record)
+{
+  lines_ += "{\"ts_ms\":";
+  json_codec::append_uint(lines_, static_cast<uint64_t>(record.stamp_ms));
+  lines_ += ",\"id\":";
+  json_codec::append_uint(lines_, record.id);
+  lines_ += ",\"method\":";
+  json_codec::append_string(lines_, record.method);
+  lines_ += ",\"path\":";
+  json_codec::append_string(lines_, record.path);
+  lines_ += ",\"status\":";
+  char status[12];
+  lines_.append(status, std::to_chars(status, status + sizeof(status), record.status).ptr);
+  lines_ += ",\"latency_us\":";
+  json_codec::append_uint(lines_, record.latency_us);
+  lines_ += ",\"req_bytes\":";
+  json_codec::append_uint(lines_, record.req_bytes);
+  lines_ += ",\"res_bytes\":";
+  json_codec::append_uint(lines_, record.res_bytes);
+  lines_ += "}\n";
+}
+
+void AccessLog::write_file(void)
+{
+  if (config_.path.empty())
+    return;
+
+  if (file_ && file_bytes_ + lines_.size() > config_.max_bytes)
+  {
+    std::fclose(file_);
+    file_ = nullptr;
+    std::rename(config_.path.c_str(), (config_.path + ".1").c_str());
+  }
+
+  if (!file_)
+  {
+    file_ = std::fopen(config_.path.c_str(), "a");
+    if (!file_)
+      return;
+
+    struct stat st;
+    file_bytes_ = ::stat(config_.path.c_str(), &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+  }
+
+  file_bytes_ += std::fwrite(lines_.data(), 1, lines_.size(), file_);
+  std::fflush(file_);
+}
@@ -0,0 +1,100 @@
+#include "wcs/assignment_waiters.hpp"
+
+#include <algorithm>
+
+AssignmentWaiters::AssignmentWaiters(const Config &config)
+: config_(config),
+  callback_seen_(false)
+{
+}
+
+uint32_t AssignmentWaiters::wait(
+  const std::string &order_id,
+  std::chrono::milliseconds timeout,
+  const Poll &poll,
+  const KeepWaiting &keep_waiting)
+{
+  const auto deadline = Clock::now() + timeout;
+  auto interval = config_.min_poll;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::shared_ptr<Slot> waiter = slot(order_id);
+  waiter->waited = true;
+
+  while (waiter->mtrl_box_id == 0)
+  {
+    const auto now = Clock::now();
+    if (now >= deadline)
+      break;
+
+    lock.unlock();
+    const bool keep = !keep_waiting || keep_waiting();
+    lock.lock();
+    if (!keep)
+      break;
+
+    const auto period = callback_fresh(now) ? config_.quiet_poll : interval;
+    if (waiter->assigned.wait_until(lock, std::min(deadline, now + period), [&waiter]() { return waiter->mtrl_box_id != 0; }))
+      break;
+
+    // no callback in time, the server is asked
+    const bool fresh = callback_fresh(Clock::now());
+    lock.unlock();
+    const uint32_t mtrl_box_id = poll ? poll() : 0;
+    lock.lock();
+
+    if (mtrl_box_id != 0 && waiter->mtrl_box_id == 0)
+      waiter->mtrl_box_id = mtrl_box_id;
+    if (!fresh)
+      interval = std::min(interval * 2, config_.max_poll);
+  }
+
+  const uint32_t mtrl_box_id = waiter->mtrl_box_id;
+  slots_.erase(order_id);
+  return mtrl_box_id;
+}
+
+bool AssignmentWaiters::assign(const std::string &order_id, uint32_t mtrl_box_id)
+{
+  const std::lock_guard<std::mutex> lock(mutex_);
+  const auto now = Clock::now();
+  callback_seen_ = true;
+  last_callback_ = now;
+
+  // assignments nobody came for are dropped
+  for (auto it = slots_.begin(); it != slots_.end();)
+  {
+    if (!it->second->waited && now - it->second->since > config_.early_ttl)
+      it = slots_.erase(it);
+    else
+      ++it;
+  }
+
+  std::shared_ptr<Slot> waiter = slot(order_id);
+  if (waiter->mtrl_box_id == 0)
+    waiter->mtrl_box_id = mtrl_box_id;
+  waiter->assigned.notify_all();
+  return waiter->waited;
+}
+
+size_t AssignmentWaiters::waiting(void)
+{
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return std::count_if(slots_.begin(), slots_.end(), [](const auto &slot) { return slot.second->waited; });
+}
+
+std::shared_ptr<AssignmentWaiters::Slot> AssignmentWaiters::slot(const std::string &order_id)
+{
+  auto &slot = slots_[order_id];
+  if (!slot)
+  {
+    slot = std::make_shared<Slot>();
+    slot->since = Clock::now();
+  }
+  return slot;
+}
+
+bool AssignmentWaiters::callback_fresh(Clock::time_point now) const
+{
+  return callback_seen_ && now - last_callback_ < config_.callback_fresh;
+}
@@ -0,0 +1,205 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "wcs/json_codec.hpp"
+
+#define CELLS 28
+
+// This executable compares the nlohmann::json DOM path of the jinli bodies
+// against the typed codec: the time and the allocations of a body.
+
+namespace {
+
+std::atomic<size_t> allocations{0};
+
+struct DrugLocation
+{
+  uint8_t dispenser_station;
+  uint8_t dispenser_unit;
+};
+
+struct Drug
+{
+  uint32_t amount;
+  std::string drug_id;
+  std::vector<DrugLocation> locations;
+};
+
+struct Slot
+{
+  std::vector<Drug> drugs;
+};
+
+size_t map_index(size_t i)
+{
+  return (i / 4) + (i % 4) * 7;
+}
+
+std::vector<Slot> order_slots(size_t drugs_per_cell)
+{
+  std::vector<Slot> slots(CELLS);
+  for (size_t i = 0; i < CELLS; i++)
+  {
+    for (size_t j = 0; j < drugs_per_cell; j++)
+      slots[i].drugs.push_back(Drug{1, std::to_string(j + 1) + "_" + std::to_string(i % 7 + 1), {{static_cast<uint8_t>(j % 14 + 1), static_cast<uint8_t>(i % 7 + 1)}}});
+  }
+  return slots;
+}
+
+std::string cells_info_body(size_t drugs_per_cell)
+{
+  nlohmann::json body;
+  for (size_t i = 0; i < CELLS; i++)
+  {
+    nlohmann::json cell = {{"cellId", i + 1}, {"drugs", nlohmann::json::array()}};
+    for (size_t j = 0; j < drugs_per_cell; j++)
+    {
+      cell["drugs"].push_back({
+        {"amount", 1},
+        {"drugId", std::to_string(j + 1) + "_" + std::to_string(i % 7 + 1)},
+        {"drugName", "drug name of a cell"},
+        {"isCompleted", j % 2},
+        {"locations", {{{"dispenserStation", j % 14 + 1}, {"dispenserUnit", i % 7 + 1}}}}
+      });
+    }
+    body["cells"].push_back(cell);
+  }
+  return body.dump();
+}
+
+std::string dispense_request_body(size_t locations)
+{
+  nlohmann::json body;
+  body["locations"] = nlohmann::json::array();
+  for (size_t i = 0; i < locations; i++)
+    body["locations"].push_back({{"dispenserStation", i % 14 + 1}, {"dispenserUnit", i % 7 + 1}, {"amount", 2}});
+  return body.dump();
+}
+
+// the old order_execute, a document with the cells in order then one remapped
+std::string new_order_dom(const std::vector<Slot> &slots)
+{
+  nlohmann::json req_json, req_json_temp;
+  for (size_t i = 0; i < slots.size(); i++)
+  {
+    nlohmann::json _cell;
+    for (const auto &drug : slots[i].drugs)
+    {
+      nlohmann::json _drug;
+      _drug["amount"] = drug.amount;
+      _drug["drugId"] = drug.drug_id;
+      for (const auto &location : drug.locations)
+        _drug["locations"].push_back({{"dispenserStation", location.dispenser_station}, {"dispenserUnit", location.dispenser_unit}});
+      _cell["drugs"].push_back(_drug);
+    }
+    req_json_temp["cells"].push_back(_cell);
+  }
+
+  req_json["cells"] = nlohmann::json::array();
+  for (size_t i = 0; i < req_json_temp["cells"].size(); i++)
+    req_json["cells"].push_back(nullptr);
+  for (size_t i = 0; i < req_json_temp["cells"].size(); i++)
+    req_json["cells"][map_index(i)] = req_json_temp["cells"][i];
+  return req_json.dump();
+}
+
+template<typename F>
+void run(const char *name, size_t n, F &&func)
+{
+  func(); // warm up
+  const size_t before = allocations.load();
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n; i++)
+    func();
+  const auto end = std::chrono::steady_clock::now();
+
+  std::printf("%-28s %10.2f us %10.1f allocations\n", name,
+    std::chrono::duration<double, std::micro>(end - start).count() / n,
+    static_cast<double>(allocations.load() - before) / n);
+}
+
+} // namespace
+
+void *operator new(std::size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+// not inlined, gcc takes the free of an inlined delete for a mismatched one
+[[gnu::noinline]] void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void *p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+int main(int argc, char **argv)
+{
+  const size_t n = argc > 1 ? std::stoul(argv[1]) : 1000;
+  const size_t drugs_per_cell = argc > 2 ? std::stoul(argv[2]) : 4;
+
+  const std::string cells_body = cells_info_body(drugs_per_cell);
+  const std::string dispense_body = dispense_request_body(CELLS * drugs_per_cell);
+  const auto slots = order_slots(drugs_per_cell);
+
+  std::vector<size_t> order(CELLS);
+  for (size_t i = 0; i < CELLS; i++)
+    order[map_index(i)] = i;
+
+  std::printf("cells info %zu bytes, dispense request %zu bytes\n", cells_body.size(), dispense_body.size());
+
+  size_t sink = 0;
+  run("cells info DOM", n, [&]() {
+    const auto body = nlohmann::json::parse(cells_body);
+    for (const auto &cell : body["cells"])
+    {
+      for (const auto &drug : cell["drugs"])
+        sink += drug["isCompleted"].get<int>() + drug["locations"][0]["dispenserUnit"].get<int>();
+    }
+  });
+  run("cells info codec", n, [&]() {
+    json_codec::CellsInfo cells;
+    json_codec::decode(cells_body, cells);
+    for (const auto &cell : cells.cells)
+    {
+      for (const auto &drug : cell.drugs)
+        sink += drug.is_completed + drug.locations[0].dispenser_unit;
+    }
+  });
+
+  run("dispense request DOM", n, [&]() {
+    const auto body = nlohmann::json::parse(dispense_body);
+    for (const auto &loc : body["locations"])
+      sink += loc["dispenserStation"].get<int>() + loc["amount"].get<int>();
+  });
+  run("dispense request codec", n, [&]() {
+    json_codec::DispenseRequest request;
+    json_codec::decode(dispense_body, request);
+    for (const auto &loc : request.locations)
+      sink += loc.dispenser_station + loc.amount;
+  });
+
+  std::string encoded;
+  run("new order DOM", n, [&]() { sink += new_order_dom(slots).size(); });
+  run("new order codec", n, [&]() {
+    json_codec::encode_new_order(slots, order, encoded);
+    sink += encoded.size();
+  });
+
+  if (new_order_dom(slots) != encoded)
+    std::printf("the new order bodies differ\n");
+
+  return sink == 0;
+}
@@ -0,0 +1,85 @@
+#include "wcs/bounded_executor.hpp"
+
+#include <algorithm>
+
+BoundedExecutor::BoundedExecutor(size_t workers, size_t capacity)
+: capacity_(std::max<size_t>(capacity, 1)),
+  state_(std::make_shared<State>())
+{
+  for (size_t i = 0; i < std::max<size_t>(workers, 1); i++)
+    workers_.emplace_back(&BoundedExecutor::worker, state_);
+}
+
+BoundedExecutor::~BoundedExecutor()
+{
+  std::deque<std::pair<Task, Ticket>> dropped;
+  {
+    const std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->stop = true;
+    dropped.swap(state_->tasks);
+  }
+  state_->cv.notify_all();
+
+  for (auto &worker : workers_)
+  {
+    if (worker.joinable())
+      worker.join();
+  }
+
+  // the tasks not started release their tickets here, out of the mutex
+  dropped.clear();
+}
+
+bool BoundedExecutor::try_submit(Task task)
+{
+  const std::lock_guard<std::mutex> lock(state_->mutex);
+  if (state_->stop || state_->in_flight >= capacity_)
+    return false;
+
+  state_->in_flight++;
+  std::weak_ptr<State> weak_state = state_;
+  Ticket ticket(nullptr, [weak_state](void *) {
+    if (auto state = weak_state.lock())
+    {
+      const std::lock_guard<std::mutex> lock(state->mutex);
+      state->in_flight--;
+    }
+  });
+
+  state_->tasks.emplace_back(std::move(task), std::move(ticket));
+  state_->cv.notify_one();
+  return true;
+}
+
+size_t BoundedExecutor::in_flight(void)
+{
+  const std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->in_flight;
+}
+
+void BoundedExecutor::worker(std::shared_ptr<State> state)
+{
+  std::unique_lock<std::mutex> lock(state->mutex);
+
+  while (true)
+  {
+    state->cv.wait(lock, [&state]() { return state->stop || !state->tasks.empty(); });
+    if (state->stop)
+      break;
+
+    auto task = std::move(state->tasks.front());
+    state->tasks.pop_front();
+
+    lock.unlock();
+    try
+    {
+      task.first(std::move(task.second));
+    }
+    catch (...)
+    {
+    }
+    // the ticket of a task which did not pass it on is released here
+    task = {};
+    lock.lock();
+  }
+}
@@ -6,8 +6,23 @@ bool ProdLineCtrl::init_httpcli(void)
   {
     const std::lock_guard<std::mutex> lock(mutex_);
     
-    httpcli_ = std::make_shared<httplib::Client>(jinli_ip_, jinli_port_);
-    httpcli_->set_connection_timeout(0, 1000 * 200); // 200ms 
+    httpcli_pool_ = std::make_shared<HttpClientPool>(
+      jinli_ip_, 
+      jinli_port_, 
+      httpcli_pool_size_,
+      std::chrono::milliseconds(httpcli_connection_timeout_ms_),
+      std::chrono::milliseconds(httpcli_read_timeout_ms_),
+      std::chrono::milliseconds(httpcli_acquire_timeout_ms_));
+    RCLCPP_INFO(this->get_logger(), "HTTP client pool of %ld keep-alive connections", httpcli_pool_->size());
+
+    // only hc_cb uses it, the check never waits behind a busy httpcli_pool_
+    health_cli_pool_ = std::make_shared<HttpClientPool>(
+      jinli_ip_, 
+      jinli_port_, 
+      1,
+      std::min(std::chrono::milliseconds(httpcli_connection_timeout_ms_), HEALTH_CHECK_TIMEOUT),
+      HEALTH_CHECK_TIMEOUT,
+      std::chrono::milliseconds(0));
   }
   catch(const std::exception &e)
   {
@@ -25,7 +40,7 @@ bool ProdLineCtrl::init_httpcli(void)
 
 bool ProdLineCtrl::get_mtrl_box_info(nlohmann::json &res_json)
 {
-  auto res = httpcli_->Get(mtrl_box_info_url);
+  auto res = httpcli_pool_->Get(mtrl_box_info_url);
   
   if (res && res->status == httplib::StatusCode::OK_200) 
   {
@@ -46,7 +61,7 @@ bool ProdLineCtrl::get_mtrl_box_info_by_id(const httplib::Params &params, nlohma
     { "Content-Type", "text/plain" }
   };
 
-  auto res = httpcli_->Get(mtrl_box_info_by_id_url, params, headers);
+  auto res = httpcli_pool_->Get(mtrl_box_info_by_id_url, params, headers);
   
   if (res && res->status == httplib::StatusCode::OK_200) 
   {
@@ -61,23 +76,27 @@ bool ProdLineCtrl::get_mtrl_box_info_by_id(const httplib::Params &params, nlohma
   return false;
 }
 
-bool ProdLineCtrl::get_cells_info_by_id(const httplib::Params &params, nlohmann::json &res_json)
+bool ProdLineCtrl::get_cells_info_by_id(const httplib::Params &params, json_codec::CellsInfo &cells_info)
 {
   httplib::Headers headers = {
     { "Content-Type", "text/plain" }
   };
 
-  auto res = httpcli_->Get(cells_info_by_id_url, params, headers);
+  auto res = httpcli_pool_->Get(cells_info_by_id_url, params, headers);
   
   if (res && res->status == httplib::StatusCode::OK_200) 
   {
     RCLCPP_DEBUG(this->get_logger(), "%s OK", __FUNCTION__);
-    res_json = nlohmann::json::parse(res->body);
-    return true;
+
+    std::string error;
+    if (json_codec::decode(res->body, cells_info, &error))
+      return true;
+
+    RCLCPP_ERROR(this->get_logger(), "%s: %s", __FUNCTION__, error.c_str());
+    return false;
   } 
   
   std::string msg = std::string(__FUNCTION__) + " error occurred. Error code: " + to_string(res.error());
-  res_json["msg"] = msg;
   RCLCPP_ERROR(this->get_logger(), msg.c_str());
   return false;
 }
@@ -88,7 +107,7 @@ bool ProdLineCtrl::get_cell_info_by_id_and_cell_id(const httplib::Params &params
     { "Content-Type", "text/plain" }
   };
 
-  auto res = httpcli_->Get(cell_info_by_id_and_cell_id_url, params, headers);
+  auto res = httpcli_pool_->Get(cell_info_by_id_and_cell_id_url, params, headers);
   
   if (res && res->status == httplib::StatusCode::OK_200) 
   {
@@ -105,7 +124,7 @@ bool ProdLineCtrl::get_cell_info_by_id_and_cell_id(const httplib::Params &params
 
 bool ProdLineCtrl::get_mtrl_box_amt(nlohmann::json &res_json)
 {
-  auto res = httpcli_->Get(mtrl_box_amt_url);
+  auto res = httpcli_pool_->Get(mtrl_box_amt_url);
   
   if (res && res->status == httplib::StatusCode::OK_200) 
   {
@@ -120,14 +139,13 @@ bool ProdLineCtrl::get_mtrl_box_amt(nlohmann::json &res_json)
   return false;
 }
 
-bool ProdLineCtrl::new_order(const nlohmann::json &req_json, nlohmann::json &res_json)
+bool ProdLineCtrl::new_order(const std::string &req_body, nlohmann::json &res_json)
 {
   httplib::Headers headers = {
     { "Content-Type", "application/json" }
   };
-  std::string req_body = req_json.dump();
 
-  auto res = httpcli_->Post(new_order_url, headers, req_body, "application/json");
+  auto res = httpcli_pool_->Post(new_order_url, headers, req_body, "application/json");
 
   if (res && res->status == httplib::StatusCode::OK_200) 
   {
@@ -148,7 +166,7 @@ bool ProdLineCtrl::get_order_by_id(const httplib::Params &params, nlohmann::json
     { "Content-Type", "text/plain" }
   };
 
-  auto res = httpcli_->Get(order_by_id_url, params, headers);
+  auto res = httpcli_pool_->Get(order_by_id_url, params, headers);
 
   if (res && res->status == httplib::StatusCode::OK_200) 
   {
@@ -163,14 +181,18 @@ bool ProdLineCtrl::get_order_by_id(const httplib::Params &params, nlohmann::json
   return false;
 }
 
-bool ProdLineCtrl::dis_result(const nlohmann::json &req_json, nlohmann::json &res_json)
+std::string ProdLineCtrl::order_id_key(const nlohmann::json &order_id)
+{
+  return order_id.is_string() ? order_id.get<std::string>() : order_id.dump();
+}
+
+bool ProdLineCtrl::dis_result(const std::string &req_body, nlohmann::json &res_json)
 {
   httplib::Headers headers = {
     { "Content-Type", "application/json" }
   };
-  std::string req_body = req_json.dump();
 
-  auto res = httpcli_->Post(dis_result_url, headers, req_body, "application/json");
+  auto res = httpcli_pool_->Post(dis_result_url, headers, req_body, "application/json");
 
   if (res && res->status == httplib::StatusCode::OK_200) 
   {
@@ -187,7 +209,7 @@ bool ProdLineCtrl::dis_result(const nlohmann::json &req_json, nlohmann::json &re
 
 bool ProdLineCtrl::health_check(nlohmann::json &res_json)
 {
-  auto res = httpcli_->Get(health_url);
+  auto res = health_cli_pool_->Get(health_url);
 
   if (res && res->status == httplib::StatusCode::OK_200) 
   {
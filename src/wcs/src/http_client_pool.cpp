@@ -0,0 +1,112 @@
+#include "wcs/http_client_pool.hpp"
+
+HttpClientPool::HttpClientPool(
+  const std::string &host,
+  int port,
+  size_t size,
+  std::chrono::milliseconds connection_timeout,
+  std::chrono::milliseconds read_timeout,
+  std::chrono::milliseconds acquire_timeout)
+: size_(std::max<size_t>(size, 1)),
+  read_timeout_(read_timeout),
+  acquire_timeout_(acquire_timeout)
+{
+  for (size_t i = 0; i < size_; i++)
+  {
+    auto client = std::make_unique<httplib::Client>(host, port);
+    client->set_keep_alive(true);
+    client->set_connection_timeout(connection_timeout.count() / 1000, (connection_timeout.count() % 1000) * 1000);
+    idle_.push_back(std::move(client));
+  }
+}
+
+httplib::Result HttpClientPool::Get(
+  const std::string &path,
+  const httplib::Params &params,
+  const httplib::Headers &headers,
+  std::chrono::milliseconds timeout)
+{
+  return perform(path, timeout, [&](httplib::Client &client) {
+    return client.Get(path, params, headers);
+  });
+}
+
+httplib::Result HttpClientPool::Post(
+  const std::string &path,
+  const httplib::Headers &headers,
+  const std::string &body,
+  const std::string &content_type,
+  std::chrono::milliseconds timeout)
+{
+  return perform(path, timeout, [&](httplib::Client &client) {
+    return client.Post(path, headers, body, content_type);
+  });
+}
+
+size_t HttpClientPool::idle(void)
+{
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return idle_.size();
+}
+
+std::map<std::string, HttpClientPool::EndpointStats> HttpClientPool::take_stats(void)
+{
+  const std::lock_guard<std::mutex> lock(stats_mutex_);
+  std::map<std::string, EndpointStats> stats;
+  stats.swap(stats_);
+  return stats;
+}
+
+std::unique_ptr<httplib::Client> HttpClientPool::acquire(void)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!released_.wait_for(lock, acquire_timeout_, [this]() { return !idle_.empty(); }))
+    return nullptr;
+
+  auto client = std::move(idle_.back());
+  idle_.pop_back();
+  return client;
+}
+
+void HttpClientPool::release(std::unique_ptr<httplib::Client> client)
+{
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(std::move(client));
+  }
+  released_.notify_one();
+}
+
+template <typename Request>
+httplib::Result HttpClientPool::perform(const std::string &path, std::chrono::milliseconds timeout, Request &&request)
+{
+  using Ms = std::chrono::duration<double, std::milli>;
+  const auto start = std::chrono::steady_clock::now();
+
+  std::unique_ptr<httplib::Client> client = acquire();
+  const auto acquired = std::chrono::steady_clock::now();
+
+  httplib::Result res(nullptr, httplib::Error::Connection);
+  if (client)
+  {
+    // the client is ours until it is released, nobody else sees the timeout
+    const auto read_timeout = timeout.count() > 0 ? timeout : read_timeout_;
+    client->set_read_timeout(read_timeout.count() / 1000, (read_timeout.count() % 1000) * 1000);
+    res = request(*client);
+    release(std::move(client));
+  }
+
+  const double elapsed = Ms(std::chrono::steady_clock::now() - start).count();
+  {
+    const std::lock_guard<std::mutex> lock(stats_mutex_);
+    EndpointStats &stats = stats_[path];
+    stats.requests++;
+    if (!res || res->status != httplib::StatusCode::OK_200)
+      stats.failures++;
+    stats.total_ms += elapsed;
+    stats.max_ms = std::max(stats.max_ms, elapsed);
+    stats.waited_ms += Ms(acquired - start).count();
+  }
+
+  return res;
+}
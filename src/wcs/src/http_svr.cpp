@@ -1,5 +1,69 @@
 #include "wcs/prod_line_ctrl.hpp"
 
+namespace
+{
+
+// httplib runs a request on one thread from pre_routing_handler to logger_handler
+thread_local std::chrono::steady_clock::time_point request_start;
+thread_local uint64_t request_id = 0;
+
+} // namespace
+
+template <typename ServiceT>
+ProdLineCtrl::ServiceCall ProdLineCtrl::call_service(
+  const typename rclcpp::Client<ServiceT>::SharedPtr &client,
+  std::function<std::shared_ptr<typename ServiceT::Request>(void)> make_request,
+  std::shared_ptr<typename ServiceT::Response> &response)
+{
+  if (!client->service_is_ready())
+    return ServiceCall::UNAVAILABLE;
+
+  struct Pending
+  {
+    std::mutex mutex;
+    bool abandoned = false;
+    int64_t request_id = -1;
+    std::promise<std::shared_ptr<typename ServiceT::Response>> response;
+  };
+  auto pending = std::make_shared<Pending>();
+  auto future = pending->response.get_future();
+
+  const bool accepted = svc_executor_->try_submit([client, make_request, pending](BoundedExecutor::Ticket ticket) {
+    auto request = make_request();
+
+    const std::lock_guard<std::mutex> lock(pending->mutex);
+    if (pending->abandoned)
+      return;
+
+    // the ticket goes with the callback, the call is counted until its response
+    pending->request_id = client->async_send_request(request, 
+      [pending, ticket](typename rclcpp::Client<ServiceT>::SharedFuture future) {
+        pending->response.set_value(future.get());
+      }).request_id;
+  });
+
+  if (!accepted)
+    return ServiceCall::OVERLOADED;
+
+  if (future.wait_for(SERVICE_CALL_TIMEOUT) == std::future_status::ready)
+  {
+    response = future.get();
+    return ServiceCall::DONE;
+  }
+
+  // nobody waits for a late response, the call gives its place back
+  int64_t request_id;
+  {
+    const std::lock_guard<std::mutex> lock(pending->mutex);
+    pending->abandoned = true;
+    request_id = pending->request_id;
+  }
+  if (request_id >= 0)
+    client->remove_pending_request(request_id);
+
+  return ServiceCall::TIMEOUT;
+}
+
 bool ProdLineCtrl::init_httpsvr(void)
 {
   try
@@ -11,7 +75,12 @@ bool ProdLineCtrl::init_httpsvr(void)
     httpsvr_->set_error_handler(std::bind(&ProdLineCtrl::error_handler, this, _1, _2));
     httpsvr_->set_exception_handler(std::bind(&ProdLineCtrl::exception_handler, this, _1, _2, _3));
     httpsvr_->set_pre_routing_handler(std::bind(&ProdLineCtrl::pre_routing_handler, this, _1, _2));
-    httpsvr_->set_payload_max_length(1024 * 1024 * 16); // 16MB
+    httpsvr_->set_payload_max_length(DATA_MAX_LENGTH);
+
+    // the connections beyond the queue are closed at once rather than waiting
+    const size_t threads = http_svr_threads_;
+    const size_t max_queued = http_svr_max_queued_;
+    httpsvr_->new_task_queue = [threads, max_queued]() { return new httplib::ThreadPool(threads, max_queued); };
 
     httpsvr_->Get(from_url(health), std::bind(&ProdLineCtrl::health_handler, this, _1, _2));
     httpsvr_->Post(from_url(abnormal_dispensation), std::bind(&ProdLineCtrl::abnormal_dis_handler, this, _1, _2, _3));
@@ -19,7 +88,9 @@ bool ProdLineCtrl::init_httpsvr(void)
     httpsvr_->Post(from_url(dispense_request), std::bind(&ProdLineCtrl::dis_req_handler, this, _1, _2, _3));
     httpsvr_->Get(from_url(packaging_request), std::bind(&ProdLineCtrl::pkg_req_handler, this, _1, _2));
     httpsvr_->Get(from_url(packaging_info), std::bind(&ProdLineCtrl::pkg_mac_info_handler, this, _1, _2));
+    httpsvr_->Get(from_url(mtrl_box_status), std::bind(&ProdLineCtrl::mtrl_box_status_handler, this, _1, _2));
     httpsvr_->Post(from_url(order_completion), std::bind(&ProdLineCtrl::order_comp_handler, this, _1, _2, _3));
+    httpsvr_->Post(from_url(mtrl_box_assignment), std::bind(&ProdLineCtrl::mtrl_box_assignment_handler, this, _1, _2, _3));
     
     httpsvr_->Get(from_url(init_pkg_mac), std::bind(&ProdLineCtrl::init_pkg_mac_handler, this, _1, _2));
 
@@ -95,17 +166,10 @@ void ProdLineCtrl::abnormal_dis_handler(
   }
 
   std::string req_body;
-  ctx_reader([&](const char *data, size_t data_length) {
-    req_body.append(data, data_length);
-    return true;
-  });
+  read_body(req, ctx_reader, req_body);
 
-  nlohmann::json req_json;
-  try 
-  {
-    req_json = nlohmann::json::parse(req_body);
-  }
-  catch (const std::exception &e) 
+  json_codec::AbnormalDispensation dis_err;
+  if (!json_codec::decode(req_body, dis_err))
   {
     res_json["msg"] = "JSON parsing error";
     res.set_content(res_json.dump(), "application/json");
@@ -113,8 +177,8 @@ void ProdLineCtrl::abnormal_dis_handler(
   }
 
   DispensingError msg;
-  msg.order_id = req_json["orderId"];
-  msg.error_msg = req_json["errorMsg"];
+  dis_err.order_id.assign_to(msg.order_id);
+  msg.error_msg = std::move(dis_err.error_msg);
   dis_err_pub_->publish(msg);
 
   res_json["code"] = 200;
@@ -144,10 +208,7 @@ void ProdLineCtrl::abnormal_device_handler(
   }
 
   std::string req_body;
-  ctx_reader([&](const char *data, size_t data_length) {
-    req_body.append(data, data_length);
-    return true;
-  });
+  read_body(req, ctx_reader, req_body);
 
   nlohmann::json req_json;
   try 
@@ -188,53 +249,52 @@ void ProdLineCtrl::dis_req_handler(
   }
 
   std::string req_body;
-  ctx_reader([&](const char *data, size_t data_length) {
-    req_body.append(data, data_length);
-    return true;
-  });
+  read_body(req, ctx_reader, req_body);
 
-  nlohmann::json req_json;
+  json_codec::DispenseRequest dis_req;
   std::map<uint8_t, std::shared_ptr<DispenseDrug::Request>> dis_reqs;
-  try
-  {
-    req_json = nlohmann::json::parse(req_body);
-  } 
-  catch (const std::exception &e) 
+  if (!json_codec::decode(req_body, dis_req))
   {
     res_json["msg"] = "JSON parsing error";
     res.set_content(res_json.dump(), "application/json");
     return;
   }
 
-  RCLCPP_INFO(this->get_logger(), "\n%s", req_body.c_str());
+  RCLCPP_DEBUG(this->get_logger(), "\n%s", req_body.c_str());
 
-  for (const auto &loc : req_json["locations"])
+  for (const auto &loc : dis_req.locations)
   {
-    uint8_t station_id = loc["dispenserStation"];
-    if (dis_reqs.find(station_id) != dis_reqs.end()) 
-    {
-      auto &dis_req_ref = dis_reqs[station_id];
-      DispenseContent msg;
-      msg.unit_id = loc["dispenserUnit"];
-      msg.amount = loc["amount"];
-      dis_req_ref->content.push_back(msg);
-    } 
-    else 
+    if (dis_req_cli_.find(loc.dispenser_station) == dis_req_cli_.end())
     {
-      std::shared_ptr<DispenseDrug::Request> request = std::make_shared<DispenseDrug::Request>();
-      DispenseContent msg;
-      msg.unit_id = loc["dispenserUnit"];
-      msg.amount = loc["amount"];
-      request->content.push_back(msg);
-      dis_reqs[station_id] = request;
+      res_json["msg"] = "Unknown dispenserStation " + std::to_string(loc.dispenser_station);
+      res.set_content(res_json.dump(), "application/json");
+      return;
     }
+
+    auto &request = dis_reqs[loc.dispenser_station];
+    if (!request)
+      request = std::make_shared<DispenseDrug::Request>();
+
+    DispenseContent msg;
+    msg.unit_id = loc.dispenser_unit;
+    msg.amount = loc.amount;
+    request->content.push_back(msg);
   }
 
   RCLCPP_INFO(this->get_logger(), "%s, dis_reqs size: %ld", __FUNCTION__, dis_reqs.size());
   if (dis_reqs.size() > 0)
   {
-    std::thread(&ProdLineCtrl::dis_result_srv_handler, this, std::move(dis_reqs)).detach();
-  
+    // the dispensing runs on dis_executor_, a full one turns the request away
+    const bool accepted = dis_executor_->try_submit([this, dis_reqs](BoundedExecutor::Ticket) {
+      dis_result_srv_handler(dis_reqs);
+    });
+
+    if (!accepted)
+    {
+      reply_unavailable(res, res_json, "Too many dispense requests in progress");
+      return;
+    }
+
     res_json["code"] = 200;
     res_json["msg"] = "success";
   }
@@ -257,19 +317,15 @@ void ProdLineCtrl::pkg_req_handler(
     return;
   }
 
-  std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
-
   bool pkg_mac_availability = false;
-  lock.lock();
-  for (const auto &status: pkg_mac_status_)
+  for (const auto &status: *pkg_mac_status_.snapshot())
   {
-    if (status.second.packaging_machine_state == PackagingMachineStatus::IDLE)
+    if (status && status->packaging_machine_state == PackagingMachineStatus::IDLE)
     {
       pkg_mac_availability = true;
       break;
     }
   }
-  lock.unlock();
 
   if (!pkg_mac_availability)
   {
@@ -347,12 +403,32 @@ void ProdLineCtrl::pkg_req_handler(
   //   return;
   // }
 
-  std::thread pkg_srv_wait_thread_ = std::thread([this]() {
-    while (rclcpp::ok() && !pkg_order_cli_->wait_for_service(std::chrono::seconds(1))) 
-    {
-      RCLCPP_ERROR(this->get_logger(), "PackagingOrder Service not available, waiting again...");
-    }
-  });
+  std::shared_ptr<PackagingOrder::Response> srv_res;
+  const auto call = call_service<PackagingOrder>(
+    pkg_order_cli_, 
+    [this, id]() { return make_pkg_order_request(id); }, 
+    srv_res);
+
+  if (!reply_service_call(call, "PackagingOrder", res, res_json))
+    return;
+
+  if (srv_res && srv_res->success)
+  {
+    res_json["code"] = 200;
+    res_json["msg"] = "success";
+    RCLCPP_DEBUG(this->get_logger(), "Inside the PrintingOrder Callback OK");
+  }
+  else
+  {
+    RCLCPP_ERROR(this->get_logger(), "Inside the PrintingOrder Callback NOT OK. message: %s", srv_res ? srv_res->message.c_str() : "");
+  }
+
+  res.set_content(res_json.dump(), "application/json");
+}
+
+std::shared_ptr<PackagingOrder::Request> ProdLineCtrl::make_pkg_order_request(uint8_t id)
+{
+  const std::lock_guard<std::mutex> lock(mutex_);
 
   std::shared_ptr<PackagingOrder::Request> pkg_order_srv_req = std::make_shared<PackagingOrder::Request>();
   pkg_order_srv_req->order_id = this->get_clock()->now().seconds();
@@ -420,42 +496,7 @@ void ProdLineCtrl::pkg_req_handler(
     // }
   }
 
-  using PkgServiceResponseFuture = rclcpp::Client<PackagingOrder>::SharedFuture;
-  auto packaging_res_received_cb = [this, &res_json](PkgServiceResponseFuture future) {
-    auto srv_res = future.get();
-    if (srv_res && srv_res->success)
-    {
-      res_json["code"] = 200;
-      res_json["msg"] = "success";
-      RCLCPP_DEBUG(this->get_logger(), "Inside the PrintingOrder Callback OK");
-    }
-    else
-    {
-      RCLCPP_ERROR(this->get_logger(), "Inside the PrintingOrder Callback NOT OK. message: %s", srv_res->message.c_str());
-    }
-  };
-
-  if (pkg_srv_wait_thread_.joinable())
-    pkg_srv_wait_thread_.join();
-  
-  auto pkg_future = pkg_order_cli_->async_send_request(pkg_order_srv_req, packaging_res_received_cb);
-
-  std::future_status pkg_status = pkg_future.wait_for(500ms);
-  switch (pkg_status)
-  {
-  case std::future_status::ready:
-    break;
-  case std::future_status::timeout:
-    res_json["msg"] = "pkg_future timeout";
-    RCLCPP_ERROR(this->get_logger(), "PackagingOrder wait_for timeout");
-    break;
-  case std::future_status::deferred: 
-    res_json["msg"] = "pkg_future deferred";
-    RCLCPP_ERROR(this->get_logger(), "PackagingOrder wait_for deferred");
-    break;
-  }
-
-  res.set_content(res_json.dump(), "application/json");
+  return pkg_order_srv_req;
 }
 
 void ProdLineCtrl::pkg_mac_info_handler(
@@ -470,21 +511,19 @@ void ProdLineCtrl::pkg_mac_info_handler(
     { "packagingMachines", nlohmann::json::array() }
   };
 
-  std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
-  lock.lock();
-  for (const auto &status : pkg_mac_status_) 
+  for (const auto &status : *pkg_mac_status_.snapshot()) 
   {
-    const auto &status_val = status.second;
+    if (!status)
+      continue;
 
     nlohmann::json status_json;
-    status_json["id"] = status_val.packaging_machine_id;
-    status_json["state"] = status_val.packaging_machine_state;
-    status_json["conveyorState"] = status_val.conveyor_state;
-    status_json["canopenState"] = status_val.canopen_state;
+    status_json["id"] = status->packaging_machine_id;
+    status_json["state"] = status->packaging_machine_state;
+    status_json["conveyorState"] = status->conveyor_state;
+    status_json["canopenState"] = status->canopen_state;
 
     res_json["packagingMachines"].push_back(status_json);
   }
-  lock.unlock();
   
   res_json["code"] = 200;
   res_json["msg"] = "success";
@@ -492,6 +531,78 @@ void ProdLineCtrl::pkg_mac_info_handler(
   res.set_content(res_json.dump(), "application/json");
 }
 
+void ProdLineCtrl::mtrl_box_status_handler(
+  const httplib::Request &req, 
+  httplib::Response &res)
+{
+  nlohmann::json res_json = {
+    { "code", 0 },
+    { "msg", "failure" },
+    { "materialBoxes", nlohmann::json::array() }
+  };
+
+  // without materialBoxId all the boxes with an order are returned
+  bool all = true;
+  uint32_t mtrl_box_id = 0;
+  if (req.has_param("materialBoxId"))
+  {
+    const auto val = req.get_param_value("materialBoxId");
+    if (!is_number(val))
+    {
+      res_json["msg"] = "materialBoxId is not a number";
+      res.set_content(res_json.dump(), "application/json");
+      return;
+    }
+
+    all = false;
+    mtrl_box_id = static_cast<uint32_t>(stoul(val));
+  }
+
+  // answered from the cache of mtrl_box_info_cb, the jinli server is not asked
+  const std::lock_guard<std::mutex> lock(mtrl_box_cache_mutex_);
+  for (const auto &entry : mtrl_box_cache_)
+  {
+    if (!all && entry.first != mtrl_box_id)
+      continue;
+
+    const MaterialBoxStatus &status = entry.second.status;
+    nlohmann::json box_json;
+    box_json["id"] = status.id;
+    box_json["location"] = status.location;
+    box_json["status"] = status.status;
+    box_json["updatedAt"] = rclcpp::Time(status.header.stamp).seconds();
+    box_json["slots"] = nlohmann::json::array();
+
+    for (const auto &slot : status.material_box.slots)
+    {
+      nlohmann::json slot_json = nlohmann::json::array();
+      for (const auto &detail : slot.dispensing_detail)
+      {
+        slot_json.push_back({
+          { "dispenserStation", detail.location.dispenser_station },
+          { "dispenserUnit", detail.location.dispenser_unit },
+          { "amount", detail.amount }
+        });
+      }
+      box_json["slots"].push_back(slot_json);
+    }
+
+    res_json["materialBoxes"].push_back(box_json);
+  }
+
+  if (!all && res_json["materialBoxes"].empty())
+  {
+    res_json["msg"] = "materialBoxId " + std::to_string(mtrl_box_id) + " has no order";
+    res.set_content(res_json.dump(), "application/json");
+    return;
+  }
+
+  res_json["code"] = 200;
+  res_json["msg"] = "success";
+
+  res.set_content(res_json.dump(), "application/json");
+}
+
 void ProdLineCtrl::init_pkg_mac_handler(
   const httplib::Request &req, 
   httplib::Response &res)
@@ -521,42 +632,32 @@ void ProdLineCtrl::init_pkg_mac_handler(
 
   const uint8_t pkg_mac_id = static_cast<uint8_t>(stoi(val));
 
-  while (rclcpp::ok() && !init_pkg_mac_cli_[pkg_mac_id]->wait_for_service(std::chrono::seconds(1))) 
+  const auto cli = init_pkg_mac_cli_.find(pkg_mac_id);
+  if (cli == init_pkg_mac_cli_.end())
   {
-    RCLCPP_ERROR(this->get_logger(), "Init Packaging Machine Service not available!");
+    res_json["msg"] = "packagingMachineId is unknown";
+    res.set_content(res_json.dump(), "application/json");
+    return;
   }
 
-  std::shared_ptr<Trigger::Request> srv_req = std::make_shared<Trigger::Request>();
+  std::shared_ptr<Trigger::Response> srv_res;
+  const auto call = call_service<Trigger>(
+    cli->second, 
+    []() { return std::make_shared<Trigger::Request>(); }, 
+    srv_res);
 
-  using ServiceResponseFuture = rclcpp::Client<Trigger>::SharedFuture;
-  
-  auto res_received_cb = [this, &res_json](ServiceResponseFuture future) {
-    auto srv_res = future.get();
-    if (srv_res && srv_res->success)
-    {
-      res_json["code"] = 200;
-      res_json["msg"] = "success";
-      RCLCPP_DEBUG(this->get_logger(), "Inside the Init Packaging Machine Callback OK");
-    }
-    else
-    {
-      RCLCPP_ERROR(this->get_logger(), "Inside the Init Packaging Machine Callback NOT OK. message: %s", srv_res->message.c_str());
-    }
-  };
-  
-  auto future = init_pkg_mac_cli_[pkg_mac_id]->async_send_request(srv_req, res_received_cb);
+  if (!reply_service_call(call, "Init Packaging Machine", res, res_json))
+    return;
 
-  std::future_status status = future.wait_for(500ms);
-  switch (status)
+  if (srv_res && srv_res->success)
   {
-  case std::future_status::ready:
-    break;
-  case std::future_status::timeout:
-    RCLCPP_ERROR(this->get_logger(), "Init Packaging Machine wait_for timeout");
-    return;
-  case std::future_status::deferred: 
-    RCLCPP_ERROR(this->get_logger(), "Init Packaging Machine wait_for deferred");
-    return;
+    res_json["code"] = 200;
+    res_json["msg"] = "success";
+    RCLCPP_DEBUG(this->get_logger(), "Inside the Init Packaging Machine Callback OK");
+  }
+  else
+  {
+    RCLCPP_ERROR(this->get_logger(), "Inside the Init Packaging Machine Callback NOT OK. message: %s", srv_res ? srv_res->message.c_str() : "");
   }
 
   res.set_content(res_json.dump(), "application/json");
@@ -619,15 +720,57 @@ void ProdLineCtrl::order_comp_handler(
   }
 
   std::string req_body;
-  ctx_reader([&](const char *data, size_t data_length) {
-    req_body.append(data, data_length);
-    return true;
-  });
+  read_body(req, ctx_reader, req_body);
+
+  json_codec::OrderCompletion order_compl;
+  if (!json_codec::decode(req_body, order_compl))
+  {
+    res_json["msg"] = "JSON parsing error";
+    res.set_content(res_json.dump(), "application/json");
+    return;
+  }
+
+  for (const auto mtrl_box_id : order_compl.material_box_ids)
+  {
+    OrderCompletion msg;
+    msg.header.stamp = this->get_clock()->now();
+    msg.material_box_id = mtrl_box_id;
+    // msg.order_id = order["orderId"];
+    order_compl_pub_->publish(msg);
+  }
+
+  res_json["code"] = 200;
+  res_json["msg"] = "success";
+  RCLCPP_DEBUG(this->get_logger(), "\n%s", req_body.c_str());
+
+  res.set_content(res_json.dump(), "application/json");
+}
+
+void ProdLineCtrl::mtrl_box_assignment_handler(
+  const httplib::Request &req, 
+  httplib::Response &res, 
+  const httplib::ContentReader &ctx_reader)
+{
+  nlohmann::json res_json = {
+    { "code", 0 },
+    { "msg", "failure" }
+  };
+
+  if (req.is_multipart_form_data()) 
+  {
+    res.set_content(res_json.dump(), "application/json");
+    return;
+  }
+
+  std::string req_body;
+  read_body(req, ctx_reader, req_body);
 
   nlohmann::json req_json;
+  uint32_t mtrl_box_id = 0;
   try 
   {
     req_json = nlohmann::json::parse(req_body);
+    mtrl_box_id = req_json.at("materialBoxId").get<uint32_t>();
   } 
   catch (const std::exception &e) 
   {
@@ -636,16 +779,17 @@ void ProdLineCtrl::order_comp_handler(
     return;
   }
 
-  auto orders = req_json["orders"];
-  for (const auto &order : orders)
+  if (!req_json.contains("orderId") || mtrl_box_id == 0)
   {
-    OrderCompletion msg;
-    msg.header.stamp = this->get_clock()->now();
-    msg.material_box_id = order["materialBoxId"];
-    // msg.order_id = order["orderId"];
-    order_compl_pub_->publish(msg);
+    res_json["msg"] = "orderId and a non-zero materialBoxId are required";
+    res.set_content(res_json.dump(), "application/json");
+    return;
   }
 
+  const std::string order_id = order_id_key(req_json["orderId"]);
+  if (!assignment_waiters_->assign(order_id, mtrl_box_id))
+    RCLCPP_WARN(this->get_logger(), "No order waits for the material box %u yet, orderId = %s", mtrl_box_id, order_id.c_str());
+
   res_json["code"] = 200;
   res_json["msg"] = "success";
   RCLCPP_DEBUG(this->get_logger(), "\n%s", req_body.c_str());
@@ -671,6 +815,51 @@ inline bool ProdLineCtrl::is_number(const std::string &s)
   return !s.empty() && std::all_of(s.begin(), s.end(), [](unsigned char c) { return std::isdigit(c); });
 }
 
+void ProdLineCtrl::reply_unavailable(httplib::Response &res, nlohmann::json &res_json, const std::string &msg)
+{
+  res.status = httplib::StatusCode::ServiceUnavailable_503;
+  res.set_header("Retry-After", "1");
+  res_json["code"] = 503;
+  res_json["msg"] = msg;
+  res.set_content(res_json.dump(), "application/json");
+}
+
+bool ProdLineCtrl::reply_service_call(ServiceCall call, const std::string &name, httplib::Response &res, nlohmann::json &res_json)
+{
+  switch (call)
+  {
+  case ServiceCall::DONE:
+    return true;
+  case ServiceCall::UNAVAILABLE:
+    RCLCPP_ERROR(this->get_logger(), "%s Service not available", name.c_str());
+    reply_unavailable(res, res_json, name + " service is not available");
+    return false;
+  case ServiceCall::OVERLOADED:
+    RCLCPP_WARN(this->get_logger(), "%s rejected, %lu calls in progress", name.c_str(), svc_executor_->in_flight());
+    reply_unavailable(res, res_json, "Too many requests in progress");
+    return false;
+  case ServiceCall::TIMEOUT:
+    RCLCPP_ERROR(this->get_logger(), "%s wait_for timeout", name.c_str());
+    res_json["msg"] = name + " timeout";
+    res.set_content(res_json.dump(), "application/json");
+    return false;
+  }
+  return false;
+}
+
+void ProdLineCtrl::read_body(const httplib::Request &req, const httplib::ContentReader &ctx_reader, std::string &body)
+{
+  // one allocation for the body instead of a growth per chunk
+  const uint64_t length = std::strtoull(req.get_header_value("Content-Length").c_str(), nullptr, 10);
+  if (length > 0 && length <= DATA_MAX_LENGTH)
+    body.reserve(length);
+
+  ctx_reader([&](const char *data, size_t data_length) {
+    body.append(data, data_length);
+    return true;
+  });
+}
+
 size_t ProdLineCtrl::map_index(size_t index) 
 {
   return (index / 4) + (index % 4) * 7;
@@ -678,6 +867,28 @@ size_t ProdLineCtrl::map_index(size_t index)
 
 void ProdLineCtrl::logger_handler(const httplib::Request &req, const httplib::Response &res)
 {
+  const auto now = std::chrono::steady_clock::now();
+
+  AccessRecord record;
+  // a request refused before the routing has no id yet
+  record.id = request_id ? request_id : ++http_req_seq_;
+  record.stamp_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+  record.latency_us = request_id ? 
+    static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - request_start).count()) : 0;
+  // the body is streamed to the handlers which take a content reader, Content-Length tells its size
+  record.req_bytes = static_cast<uint32_t>(req.body.empty() ? 
+    std::strtoull(req.get_header_value("Content-Length").c_str(), nullptr, 10) : req.body.size());
+  record.res_bytes = static_cast<uint32_t>(res.body.size());
+  record.status = res.status;
+  AccessLog::copy_field(record.method, req.method);
+  AccessLog::copy_field(record.path, req.path);
+  access_log_->log(record);
+  request_id = 0;
+
+  if (!rcutils_logging_logger_is_enabled_for(this->get_logger().get_name(), RCUTILS_LOG_SEVERITY_DEBUG))
+    return;
+
   std::string s;
   char buf[BUFSIZ];
 
@@ -743,7 +954,10 @@ void ProdLineCtrl::exception_handler(const httplib::Request &req, httplib::Respo
 
 httplib::Server::HandlerResponse ProdLineCtrl::pre_routing_handler(const httplib::Request &req, httplib::Response &res)
 {
-  (void)res;
+  request_start = std::chrono::steady_clock::now();
+  request_id = ++http_req_seq_;
+  res.set_header("X-Request-Id", std::to_string(request_id));
+
   if (req.path == from_url("")) 
     return httplib::Server::HandlerResponse::Handled;
 
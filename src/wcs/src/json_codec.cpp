@@ -0,0 +1,354 @@
+#include "wcs/json_codec.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <initializer_list>
+
+#include "nlohmann/json.hpp"
+
+namespace json_codec
+{
+
+namespace
+{
+
+// the keys the decoders know, the others are skipped with their values
+enum Field : int
+{
+  NONE = -1,
+  AMOUNT,
+  CELL_ID,
+  CELLS,
+  DISPENSER_STATION,
+  DISPENSER_UNIT,
+  DRUGS,
+  ERROR_MSG,
+  IS_COMPLETED,
+  LOCATIONS,
+  MATERIAL_BOX_ID,
+  ORDER_ID,
+  ORDERS,
+};
+
+Field field_of(const std::string &key)
+{
+  static const std::pair<const char *, Field> fields[] = {
+    { "amount", AMOUNT },
+    { "cellId", CELL_ID },
+    { "cells", CELLS },
+    { "dispenserStation", DISPENSER_STATION },
+    { "dispenserUnit", DISPENSER_UNIT },
+    { "drugs", DRUGS },
+    { "errorMsg", ERROR_MSG },
+    { "isCompleted", IS_COMPLETED },
+    { "locations", LOCATIONS },
+    { "materialBoxId", MATERIAL_BOX_ID },
+    { "orderId", ORDER_ID },
+    { "orders", ORDERS },
+  };
+
+  for (const auto &field : fields)
+  {
+    if (key.size() == std::strlen(field.first) && key.compare(field.first) == 0)
+      return field.second;
+  }
+  return NONE;
+}
+
+// A frame per open object or array holds the key it is under, key_ is the
+// key of the value being read, NONE in an array. at() matches the frames
+// from the root, e.g. at({NONE, CELLS, NONE}) is an element of "cells".
+class SaxDecoder : public nlohmann::json_sax<nlohmann::json>
+{
+public:
+  bool null() override { return true; }
+  bool boolean(bool val) override { return integer(val ? 1 : 0); }
+  bool number_integer(number_integer_t val) override { return integer(val); }
+  bool number_unsigned(number_unsigned_t val) override { return integer(static_cast<int64_t>(val)); }
+  bool number_float(number_float_t val, const string_t &) override { return integer(static_cast<int64_t>(val)); }
+  bool string(string_t &val) override { return text(val); }
+  bool binary(binary_t &) override { return true; }
+
+  bool start_object(std::size_t) override { return push(false); }
+  bool end_object() override { return pop(); }
+  bool start_array(std::size_t) override { return push(true); }
+  bool end_array() override { return pop(); }
+
+  bool key(string_t &val) override
+  {
+    key_ = field_of(val);
+    return true;
+  }
+
+  bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &ex) override
+  {
+    error_ = ex.what();
+    return false;
+  }
+
+  const std::string &error(void) const { return error_; }
+
+protected:
+  struct Frame
+  {
+    bool array;
+    Field field;
+  };
+
+  std::vector<Frame> stack_;
+  Field key_ = NONE;
+
+  // an object or array is opened, its frame is pushed
+  virtual void open(void) {}
+  virtual bool integer(int64_t) { return true; }
+  virtual bool text(std::string &) { return true; }
+
+  bool at(std::initializer_list<Field> path) const
+  {
+    if (stack_.size() != path.size())
+      return false;
+
+    size_t depth = 0;
+    for (const Field field : path)
+    {
+      if (stack_[depth++].field != field)
+        return false;
+    }
+    return true;
+  }
+
+  bool in_object(void) const { return !stack_.empty() && !stack_.back().array; }
+
+private:
+  std::string error_;
+
+  bool push(bool array)
+  {
+    stack_.push_back(Frame{array, key_});
+    key_ = NONE;
+    open();
+    return true;
+  }
+
+  bool pop(void)
+  {
+    stack_.pop_back();
+    key_ = NONE;
+    return true;
+  }
+};
+
+class DispenseRequestDecoder : public SaxDecoder
+{
+public:
+  explicit DispenseRequestDecoder(DispenseRequest &out) : out_(out) {}
+
+private:
+  DispenseRequest &out_;
+
+  void open(void) override
+  {
+    if (in_object() && at({NONE, LOCATIONS, NONE}))
+      out_.locations.emplace_back();
+  }
+
+  bool integer(int64_t val) override
+  {
+    if (!in_object() || !at({NONE, LOCATIONS, NONE}))
+      return true;
+
+    auto &location = out_.locations.back();
+    if (key_ == DISPENSER_STATION)
+      location.dispenser_station = static_cast<uint8_t>(val);
+    else if (key_ == DISPENSER_UNIT)
+      location.dispenser_unit = static_cast<uint8_t>(val);
+    else if (key_ == AMOUNT)
+      location.amount = static_cast<uint32_t>(val);
+    return true;
+  }
+};
+
+class OrderCompletionDecoder : public SaxDecoder
+{
+public:
+  explicit OrderCompletionDecoder(OrderCompletion &out) : out_(out) {}
+
+private:
+  OrderCompletion &out_;
+
+  void open(void) override
+  {
+    if (in_object() && at({NONE, ORDERS, NONE}))
+      out_.material_box_ids.push_back(0);
+  }
+
+  bool integer(int64_t val) override
+  {
+    if (key_ == MATERIAL_BOX_ID && in_object() && at({NONE, ORDERS, NONE}))
+      out_.material_box_ids.back() = static_cast<uint32_t>(val);
+    return true;
+  }
+};
+
+class AbnormalDispensationDecoder : public SaxDecoder
+{
+public:
+  explicit AbnormalDispensationDecoder(AbnormalDispensation &out) : out_(out) {}
+
+private:
+  AbnormalDispensation &out_;
+
+  bool integer(int64_t val) override
+  {
+    if (key_ == ORDER_ID && at({NONE}))
+    {
+      out_.order_id.number = val;
+      out_.order_id.is_number = true;
+    }
+    return true;
+  }
+
+  bool text(std::string &val) override
+  {
+    if (!at({NONE}))
+      return true;
+
+    if (key_ == ORDER_ID)
+    {
+      out_.order_id.text = std::move(val);
+      out_.order_id.is_number = false;
+    }
+    else if (key_ == ERROR_MSG)
+    {
+      out_.error_msg = std::move(val);
+    }
+    return true;
+  }
+};
+
+class CellsInfoDecoder : public SaxDecoder
+{
+public:
+  explicit CellsInfoDecoder(CellsInfo &out) : out_(out) {}
+
+private:
+  CellsInfo &out_;
+
+  void open(void) override
+  {
+    if (!in_object())
+      return;
+
+    if (at({NONE, CELLS, NONE}))
+      out_.cells.emplace_back();
+    else if (at({NONE, CELLS, NONE, DRUGS, NONE}))
+      out_.cells.back().drugs.emplace_back();
+    else if (at({NONE, CELLS, NONE, DRUGS, NONE, LOCATIONS, NONE}))
+      out_.cells.back().drugs.back().locations.emplace_back();
+  }
+
+  bool integer(int64_t val) override
+  {
+    if (!in_object())
+      return true;
+
+    if (at({NONE, CELLS, NONE}))
+    {
+      if (key_ == CELL_ID)
+        out_.cells.back().cell_id = static_cast<size_t>(val);
+    }
+    else if (at({NONE, CELLS, NONE, DRUGS, NONE}))
+    {
+      auto &drug = out_.cells.back().drugs.back();
+      if (key_ == AMOUNT)
+        drug.amount = static_cast<uint32_t>(val);
+      else if (key_ == IS_COMPLETED)
+        drug.is_completed = val != 0;
+    }
+    else if (at({NONE, CELLS, NONE, DRUGS, NONE, LOCATIONS, NONE}))
+    {
+      auto &location = out_.cells.back().drugs.back().locations.back();
+      if (key_ == DISPENSER_STATION)
+        location.dispenser_station = static_cast<uint8_t>(val);
+      else if (key_ == DISPENSER_UNIT)
+        location.dispenser_unit = static_cast<uint8_t>(val);
+    }
+    return true;
+  }
+};
+
+template <typename Decoder, typename T>
+bool run(const std::string &body, T &out, std::string *error)
+{
+  out = T();
+  Decoder decoder(out);
+  if (nlohmann::json::sax_parse(body, &decoder))
+    return true;
+
+  if (error)
+    *error = decoder.error();
+  return false;
+}
+
+} // namespace
+
+bool decode(const std::string &body, DispenseRequest &out, std::string *error)
+{
+  return run<DispenseRequestDecoder>(body, out, error);
+}
+
+bool decode(const std::string &body, OrderCompletion &out, std::string *error)
+{
+  return run<OrderCompletionDecoder>(body, out, error);
+}
+
+bool decode(const std::string &body, AbnormalDispensation &out, std::string *error)
+{
+  return run<AbnormalDispensationDecoder>(body, out, error);
+}
+
+bool decode(const std::string &body, CellsInfo &out, std::string *error)
+{
+  return run<CellsInfoDecoder>(body, out, error);
+}
+
+void append_string(std::string &out, const std::string &value)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  out += '"';
+  for (const char c : value)
+  {
+    switch (c)
+    {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\b': out += "\\b"; break;
+      case '\f': out += "\\f"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20)
+        {
+          out += "\\u00";
+          out += hex[(c >> 4) & 0x0f];
+          out += hex[c & 0x0f];
+        }
+        else
+        {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+void append_uint(std::string &out, uint64_t value)
+{
+  char buf[20];
+  const auto result = std::to_chars(buf, buf + sizeof(buf), value);
+  out.append(buf, result.ptr);
+}
+
+} // namespace json_codec
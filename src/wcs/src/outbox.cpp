@@ -0,0 +1,386 @@
+#include "wcs/outbox.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Outbox::Outbox(const std::string &path, size_t initial_size, std::chrono::milliseconds commit_window)
+: path_(path),
+  initial_size_(std::max<size_t>(initial_size, 4096)),
+  commit_window_(commit_window),
+  fd_(-1),
+  map_(nullptr),
+  capacity_(0),
+  tail_(0),
+  committed_(0),
+  syncing_(false),
+  stop_(false),
+  epoch_(0),
+  next_id_(1)
+{
+}
+
+Outbox::~Outbox()
+{
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  dirty_.notify_all();
+
+  if (flusher_.joinable())
+    flusher_.join();
+
+  if (map_ && tail_ > committed_)
+    ::msync(map_, tail_, MS_SYNC);
+  unmap();
+}
+
+bool Outbox::open(std::vector<Entry> &pending)
+{
+  const std::lock_guard<std::mutex> lock(mutex_);
+  if (map_)
+    return true;
+
+  const int fd = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || !map_file(fd, std::max<size_t>(st.st_size, initial_size_)))
+  {
+    ::close(fd);
+    return false;
+  }
+
+  // the log ends at the first empty or torn record
+  size_t offset = 0;
+  while (offset + sizeof(Header) + BODY_SIZE <= capacity_)
+  {
+    Header header;
+    std::memcpy(&header, map_ + offset, sizeof(header));
+
+    const uint8_t *body = map_ + offset + sizeof(header);
+    if (header.size < BODY_SIZE || header.size > capacity_ - offset - sizeof(header) ||
+        header.checksum != checksum(body, header.size))
+      break;
+
+    uint64_t id;
+    std::memcpy(&id, body + 1, sizeof(id));
+    next_id_ = std::max(next_id_, id + 1);
+
+    const Type type = static_cast<Type>(body[0]);
+    if (type == Type::REQUEST)
+    {
+      const char *payload = reinterpret_cast<const char *>(body + BODY_SIZE);
+      const size_t payload_size = header.size - BODY_SIZE;
+      const size_t endpoint_size = strnlen(payload, payload_size);
+
+      Entry entry;
+      entry.id = id;
+      entry.endpoint.assign(payload, endpoint_size);
+      if (endpoint_size < payload_size)
+        entry.body.assign(payload + endpoint_size + 1, payload_size - endpoint_size - 1);
+      pending_[id] = std::move(entry);
+    }
+    else if (type == Type::COMPLETE)
+    {
+      pending_.erase(id);
+    }
+
+    offset += sizeof(header) + header.size;
+  }
+
+  // whatever follows is cleared, the next records must not run into a torn one
+  std::memset(map_ + offset, 0, capacity_ - offset);
+  tail_ = offset;
+  committed_ = offset;
+
+  for (const auto &entry : pending_)
+    pending.push_back(entry.second);
+
+  flusher_ = std::thread(&Outbox::flusher, this);
+  return true;
+}
+
+uint64_t Outbox::append(const std::string &endpoint, const std::string &body)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!map_)
+    return 0;
+
+  const uint64_t id = next_id_++;
+  std::string payload;
+  payload.reserve(endpoint.size() + 1 + body.size());
+  payload.append(endpoint).push_back('\0');
+  payload.append(body);
+
+  if (!write_record(lock, Type::REQUEST, id, payload))
+    return 0;
+
+  pending_[id] = Entry{id, endpoint, body};
+
+  // group commit, the flusher syncs the records appended meanwhile with this one
+  const size_t end = tail_;
+  const uint64_t epoch = epoch_;
+  dirty_.notify_one();
+  committed_cv_.wait(lock, [this, id, end, epoch]() {
+    return committed_ >= end || epoch_ != epoch || stop_ || pending_.count(id) == 0;
+  });
+
+  // a failed sync drops the record
+  if (pending_.count(id) == 0)
+    return 0;
+  return committed_ >= end || epoch_ != epoch ? id : 0;
+}
+
+void Outbox::complete(uint64_t id)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!map_ || pending_.erase(id) == 0)
+    return;
+
+  if (write_record(lock, Type::COMPLETE, id, std::string()))
+    dirty_.notify_one();
+}
+
+bool Outbox::compact(void)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!map_)
+    return false;
+
+  // the live records are rewritten, it is only worth when most of the log is dead
+  size_t live = 0;
+  for (const auto &entry : pending_)
+    live += sizeof(Header) + BODY_SIZE + entry.second.endpoint.size() + 1 + entry.second.body.size();
+  if (live * 2 > tail_ || tail_ - live < initial_size_ / 4)
+    return false;
+
+  // the records of the old file are all on the disk, a compaction tells their waiters so
+  committed_cv_.wait(lock, [this]() { return (!syncing_ && committed_ >= tail_) || stop_; });
+  if (stop_)
+    return false;
+
+  const std::string tmp_path = path_ + ".tmp";
+  const int fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+
+  const size_t capacity = std::max(initial_size_, live * 2);
+  uint8_t *old_map = map_;
+  const size_t old_capacity = capacity_;
+  const int old_fd = fd_;
+  const size_t old_tail = tail_;
+
+  map_ = nullptr;
+  if (!map_file(fd, capacity))
+  {
+    ::close(fd);
+    ::unlink(tmp_path.c_str());
+    map_ = old_map;
+    capacity_ = old_capacity;
+    fd_ = old_fd;
+    return false;
+  }
+
+  tail_ = 0;
+  for (const auto &entry : pending_)
+  {
+    std::string payload = entry.second.endpoint;
+    payload.push_back('\0');
+    payload.append(entry.second.body);
+    write_record(lock, Type::REQUEST, entry.first, payload);
+  }
+
+  // the new file is complete on the disk before it replaces the old one
+  if (::msync(map_, tail_, MS_SYNC) != 0 || ::rename(tmp_path.c_str(), path_.c_str()) != 0)
+  {
+    unmap();
+    ::unlink(tmp_path.c_str());
+    map_ = old_map;
+    capacity_ = old_capacity;
+    fd_ = old_fd;
+    tail_ = old_tail;
+    return false;
+  }
+
+  // the rename is only durable once the directory is on the disk, the new file is used anyway
+  sync_dir();
+
+  ::munmap(old_map, old_capacity);
+  ::close(old_fd);
+  committed_ = tail_;
+  epoch_++;
+  committed_cv_.notify_all();
+  return true;
+}
+
+size_t Outbox::pending(void)
+{
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return pending_.size();
+}
+
+void Outbox::flusher(void)
+{
+  const size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (!stop_)
+  {
+    dirty_.wait(lock, [this]() { return stop_ || tail_ > committed_; });
+    if (stop_)
+      break;
+
+    // the records appended within the window go with this commit
+    lock.unlock();
+    std::this_thread::sleep_for(commit_window_);
+    lock.lock();
+
+    const size_t begin = committed_ / page_size * page_size;
+    const size_t end = tail_;
+    uint8_t *map = map_;
+    syncing_ = true;
+
+    lock.unlock();
+    const bool synced = ::msync(map + begin, end - begin, MS_SYNC) == 0;
+    lock.lock();
+
+    syncing_ = false;
+    if (synced)
+      committed_ = std::max(committed_, end);
+    else
+      drop_uncommitted();
+    committed_cv_.notify_all();
+  }
+
+  committed_cv_.notify_all();
+}
+
+void Outbox::drop_uncommitted(void)
+{
+  // the requests are forgotten, their append() returns 0, a completion dropped
+  // here only sends its request once more
+  for (size_t offset = committed_; offset < tail_;)
+  {
+    Header header;
+    std::memcpy(&header, map_ + offset, sizeof(header));
+
+    const uint8_t *body = map_ + offset + sizeof(header);
+    uint64_t id;
+    std::memcpy(&id, body + 1, sizeof(id));
+    if (static_cast<Type>(body[0]) == Type::REQUEST)
+      pending_.erase(id);
+
+    offset += sizeof(header) + header.size;
+  }
+
+  // the next sync writes the zeros over whatever reached the disk
+  std::memset(map_ + committed_, 0, tail_ - committed_);
+  tail_ = committed_;
+}
+
+bool Outbox::sync_dir(void)
+{
+  const size_t slash = path_.rfind('/');
+  const std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path_.substr(0, slash);
+
+  const int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  const bool synced = ::fsync(fd) == 0;
+  ::close(fd);
+  return synced;
+}
+
+bool Outbox::write_record(std::unique_lock<std::mutex> &lock, Type type, uint64_t id, const std::string &payload)
+{
+  const size_t body_size = BODY_SIZE + payload.size();
+  if (!reserve(lock, sizeof(Header) + body_size))
+    return false;
+
+  uint8_t *body = map_ + tail_ + sizeof(Header);
+  body[0] = static_cast<uint8_t>(type);
+  std::memcpy(body + 1, &id, sizeof(id));
+  std::memcpy(body + BODY_SIZE, payload.data(), payload.size());
+
+  Header header;
+  header.size = static_cast<uint32_t>(body_size);
+  header.checksum = checksum(body, body_size);
+  std::memcpy(map_ + tail_, &header, sizeof(header));
+
+  tail_ += sizeof(Header) + body_size;
+  return true;
+}
+
+bool Outbox::reserve(std::unique_lock<std::mutex> &lock, size_t size)
+{
+  // one more header of zeros ends the log
+  if (tail_ + size + sizeof(Header) <= capacity_)
+    return true;
+
+  // the file doubles, the map is replaced once the flusher is out of it
+  committed_cv_.wait(lock, [this]() { return !syncing_; });
+  if (tail_ + size + sizeof(Header) <= capacity_)
+    return true;
+
+  size_t capacity = capacity_ * 2;
+  while (tail_ + size + sizeof(Header) > capacity)
+    capacity *= 2;
+
+  if (::ftruncate(fd_, capacity) != 0)
+    return false;
+
+  void *map = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED)
+    return false;
+
+  ::munmap(map_, capacity_);
+  map_ = static_cast<uint8_t *>(map);
+  capacity_ = capacity;
+  return true;
+}
+
+bool Outbox::map_file(int fd, size_t capacity)
+{
+  if (::ftruncate(fd, capacity) != 0)
+    return false;
+
+  void *map = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    return false;
+
+  fd_ = fd;
+  map_ = static_cast<uint8_t *>(map);
+  capacity_ = capacity;
+  return true;
+}
+
+void Outbox::unmap(void)
+{
+  if (map_)
+    ::munmap(map_, capacity_);
+  if (fd_ >= 0)
+    ::close(fd_);
+
+  map_ = nullptr;
+  fd_ = -1;
+  capacity_ = 0;
+}
+
+uint32_t Outbox::checksum(const uint8_t *data, size_t size)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
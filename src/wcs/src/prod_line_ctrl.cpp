@@ -2,6 +2,7 @@
 
 ProdLineCtrl::ProdLineCtrl(const rclcpp::NodeOptions& options)
 : Node("prod_line_ctrl", options), 
+  http_req_seq_(0),
   svr_started_(std::atomic<bool>{false}),
   jinli_ser_state_(false)
 {
@@ -9,21 +10,108 @@ ProdLineCtrl::ProdLineCtrl(const rclcpp::NodeOptions& options)
   this->declare_parameter<int>("hkclr_port", 0);
   this->declare_parameter<std::string>("jinli_ip", "");
   this->declare_parameter<int>("jinli_port", 0);
+  this->declare_parameter<int>("jinli_pool_size", 4);
+  this->declare_parameter<int>("jinli_connection_timeout_ms", 200);
+  this->declare_parameter<int>("jinli_read_timeout_ms", 5000);
+  this->declare_parameter<int>("jinli_acquire_timeout_ms", 1000);
   this->declare_parameter<int>("no_of_dis_station", 0);
   this->declare_parameter<int>("no_of_pkg_mac", 0);
+  this->declare_parameter<int>("mtrl_box_info_workers", 4);
+  this->declare_parameter<int>("jinli_retry_workers", 2);
+  this->declare_parameter<int>("jinli_retry_per_endpoint", 2);
+  this->declare_parameter<int>("jinli_retry_initial_ms", 200);
+  this->declare_parameter<int>("jinli_retry_max_ms", 30000);
+  this->declare_parameter<int>("jinli_retry_deadline_sec", 0);
+  this->declare_parameter<std::string>("outbox_path", "/tmp/prod_line_ctrl.outbox");
+  this->declare_parameter<int>("outbox_size_kb", 1024);
+  this->declare_parameter<int>("outbox_commit_window_ms", 5);
+  this->declare_parameter<int>("assignment_poll_min_ms", 1000);
+  this->declare_parameter<int>("assignment_poll_max_ms", 8000);
+  this->declare_parameter<int>("assignment_quiet_poll_sec", 30);
+  this->declare_parameter<int>("http_svr_threads", 9);
+  this->declare_parameter<int>("http_svr_max_queued", 64);
+  this->declare_parameter<int>("http_svc_workers", 2);
+  this->declare_parameter<int>("http_svc_max_in_flight", 8);
+  this->declare_parameter<int>("dis_req_workers", 4);
+  this->declare_parameter<int>("dis_req_max_in_flight", 8);
+  this->declare_parameter<std::string>("access_log_path", "/tmp/prod_line_ctrl_access.log");
+  this->declare_parameter<int>("access_log_capacity", 4096);
+  this->declare_parameter<int>("access_log_max_mb", 64);
+  this->declare_parameter<bool>("access_log_topic", false);
 
   this->get_parameter("hkclr_ip", httpsvr_ip_);
   this->get_parameter("hkclr_port", httpsvr_port_);
   this->get_parameter("jinli_ip", jinli_ip_);
   this->get_parameter("jinli_port", jinli_port_);
+  this->get_parameter("jinli_pool_size", httpcli_pool_size_);
+  this->get_parameter("jinli_connection_timeout_ms", httpcli_connection_timeout_ms_);
+  this->get_parameter("jinli_read_timeout_ms", httpcli_read_timeout_ms_);
+  this->get_parameter("jinli_acquire_timeout_ms", httpcli_acquire_timeout_ms_);
   this->get_parameter("no_of_dis_station", no_of_dis_stations_);
   this->get_parameter("no_of_pkg_mac", no_of_pkg_mac_);
+  this->get_parameter("mtrl_box_info_workers", mtrl_box_info_workers_);
+  this->get_parameter("http_svr_threads", http_svr_threads_);
+  this->get_parameter("http_svr_max_queued", http_svr_max_queued_);
 
   RCLCPP_INFO(this->get_logger(), "jinli HTTP server: %s:%d", jinli_ip_.c_str(), jinli_port_);
   RCLCPP_INFO(this->get_logger(), "hkclr HTTP server: %s:%d", httpsvr_ip_.c_str(), httpsvr_port_);
   RCLCPP_INFO(this->get_logger(), "Number of Dispenser Station: %ld", no_of_dis_stations_);
   RCLCPP_INFO(this->get_logger(), "Number of Packaging Machine: %ld", no_of_pkg_mac_);
 
+  // a client of the pool is left to the orders and the HTTP handlers while the boxes are refreshed
+  const int max_mtrl_box_info_workers = std::max(httpcli_pool_size_ - 1, 1);
+  if (mtrl_box_info_workers_ > max_mtrl_box_info_workers)
+  {
+    RCLCPP_WARN(this->get_logger(), "mtrl_box_info_workers is limited to %d by jinli_pool_size", max_mtrl_box_info_workers);
+    mtrl_box_info_workers_ = max_mtrl_box_info_workers;
+  }
+  mtrl_box_info_workers_ = std::max(mtrl_box_info_workers_, 1);
+
+  // every service call blocks an HTTP thread for up to SERVICE_CALL_TIMEOUT, one
+  // more thread than the calls at once keeps /health answered meanwhile
+  const int http_svc_max_in_flight = this->get_parameter("http_svc_max_in_flight").as_int();
+  if (http_svr_threads_ <= http_svc_max_in_flight)
+  {
+    RCLCPP_WARN(this->get_logger(), "http_svr_threads is raised to %d by http_svc_max_in_flight", http_svc_max_in_flight + 1);
+    http_svr_threads_ = http_svc_max_in_flight + 1;
+  }
+
+  RetryScheduler::Config retry_config;
+  retry_config.workers = this->get_parameter("jinli_retry_workers").as_int();
+  retry_config.max_in_flight = this->get_parameter("jinli_retry_per_endpoint").as_int();
+  retry_config.initial_backoff = std::chrono::milliseconds(this->get_parameter("jinli_retry_initial_ms").as_int());
+  retry_config.max_backoff = std::chrono::milliseconds(this->get_parameter("jinli_retry_max_ms").as_int());
+  retry_config.deadline = std::chrono::seconds(this->get_parameter("jinli_retry_deadline_sec").as_int());
+  // the circuit is open while the health check of hc_cb fails
+  jinli_retry_ = std::make_unique<RetryScheduler>(retry_config, [this]() {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return jinli_ser_state_;
+  });
+
+  outbox_ = std::make_unique<Outbox>(
+    this->get_parameter("outbox_path").as_string(),
+    this->get_parameter("outbox_size_kb").as_int() * 1024,
+    std::chrono::milliseconds(this->get_parameter("outbox_commit_window_ms").as_int()));
+
+  AssignmentWaiters::Config assignment_config;
+  assignment_config.min_poll = std::chrono::milliseconds(this->get_parameter("assignment_poll_min_ms").as_int());
+  assignment_config.max_poll = std::chrono::milliseconds(this->get_parameter("assignment_poll_max_ms").as_int());
+  assignment_config.quiet_poll = std::chrono::seconds(this->get_parameter("assignment_quiet_poll_sec").as_int());
+  assignment_waiters_ = std::make_unique<AssignmentWaiters>(assignment_config);
+
+  svc_executor_ = std::make_unique<BoundedExecutor>(
+    this->get_parameter("http_svc_workers").as_int(), 
+    http_svc_max_in_flight);
+  dis_executor_ = std::make_unique<BoundedExecutor>(
+    this->get_parameter("dis_req_workers").as_int(), 
+    this->get_parameter("dis_req_max_in_flight").as_int());
+  // the timer thread is a worker of the refresh too
+  mtrl_box_executor_ = std::make_unique<BoundedExecutor>(mtrl_box_info_workers_ - 1, mtrl_box_info_workers_ - 1);
+
+  std::vector<Outbox::Entry> outbox_pending;
+  if (!outbox_->open(outbox_pending))
+    RCLCPP_ERROR(this->get_logger(), "Cannot open the outbox %s, the requests to jinli are not kept over a restart", outbox_->path().c_str());
+
   hc_pub_ = this->create_publisher<Heartbeat>("jinli_heartbeat", 10);
   dis_err_pub_ = this->create_publisher<DispensingError>("dispensing_error", 10);
   scan_pub_ = this->create_publisher<ScannerTrigger>("scanner_trigger", 10);
@@ -31,6 +119,23 @@ ProdLineCtrl::ProdLineCtrl(const rclcpp::NodeOptions& options)
   mtrl_box_amt_pub_ = this->create_publisher<ContainerInfo>("container_info", 10);
   mtrl_box_status_pub_ = this->create_publisher<MaterialBoxStatus>("material_box_status", 10);
 
+  AccessLog::Config access_log_config;
+  access_log_config.path = this->get_parameter("access_log_path").as_string();
+  access_log_config.capacity = this->get_parameter("access_log_capacity").as_int();
+  access_log_config.max_bytes = this->get_parameter("access_log_max_mb").as_int() * 1024 * 1024;
+
+  AccessLog::Sink access_log_sink;
+  if (this->get_parameter("access_log_topic").as_bool())
+  {
+    access_log_pub_ = this->create_publisher<String>("http_access_log", 10);
+    access_log_sink = [this](const std::string &lines) {
+      String msg;
+      msg.data = lines;
+      access_log_pub_->publish(msg);
+    };
+  }
+  access_log_ = std::make_unique<AccessLog>(access_log_config, access_log_sink);
+
   pkg_mac_status_sub_ = this->create_subscription<PackagingMachineStatus>(
     "packaging_machine_status", 
     10, 
@@ -50,7 +155,9 @@ ProdLineCtrl::ProdLineCtrl(const rclcpp::NodeOptions& options)
 
   hc_timer_ = this->create_wall_timer(1s, std::bind(&ProdLineCtrl::hc_cb, this), hc_timer_cbg_);
   mtrl_box_amt_timer_ = this->create_wall_timer(1s, std::bind(&ProdLineCtrl::mtrl_box_amt_container_cb, this), container_timer_cbg_);
-  mtrl_box_info_timer_ = this->create_wall_timer(3s, std::bind(&ProdLineCtrl::mtrl_box_info_cb, this), mtrl_box_info_timer_cbg_);
+  mtrl_box_info_timer_ = this->create_wall_timer(MTRL_BOX_INFO_PERIOD, std::bind(&ProdLineCtrl::mtrl_box_info_cb, this), mtrl_box_info_timer_cbg_);
+  httpcli_stats_timer_ = this->create_wall_timer(60s, std::bind(&ProdLineCtrl::httpcli_stats_cb, this), hc_timer_cbg_);
+  outbox_compact_timer_ = this->create_wall_timer(OUTBOX_COMPACT_PERIOD, std::bind(&ProdLineCtrl::outbox_compact_cb, this), hc_timer_cbg_);
 
   printing_info_cli_ = this->create_client<PrintingOrder>(
     "printing_order",
@@ -121,6 +228,8 @@ ProdLineCtrl::ProdLineCtrl(const rclcpp::NodeOptions& options)
     rclcpp::shutdown();
   }
 
+  replay_outbox(outbox_pending);
+
   RCLCPP_INFO(this->get_logger(), "Production Line Control is up");
 }
 
@@ -135,6 +244,17 @@ ProdLineCtrl::~ProdLineCtrl()
   {
     httpsvr_thread_.join();
   }
+  // the records of the last requests are written out
+  access_log_.reset();
+
+  // no handler submits any more, the dispensing still running sends its results to jinli_retry_
+  svc_executor_.reset();
+  dis_executor_.reset();
+  mtrl_box_executor_.reset();
+
+  // the retries use the HTTP client, they are stopped next, the outbox keeps what they did not send
+  jinli_retry_.reset();
+  outbox_.reset();
 }
 
 void ProdLineCtrl::hc_cb(void)
@@ -150,6 +270,29 @@ void ProdLineCtrl::hc_cb(void)
   jinli_ser_state_ = msg.state;
 }
 
+void ProdLineCtrl::httpcli_stats_cb(void)
+{
+  for (const auto &pool : {httpcli_pool_, health_cli_pool_})
+  {
+    if (!pool)
+      continue;
+
+    for (const auto &endpoint : pool->take_stats())
+    {
+      const auto &stats = endpoint.second;
+      RCLCPP_INFO(this->get_logger(), "%s: %lu requests, %lu failed, mean %.1f ms, max %.1f ms, waited %.1f ms", 
+        endpoint.first.c_str(), stats.requests, stats.failures, 
+        stats.total_ms / stats.requests, stats.max_ms, stats.waited_ms / stats.requests);
+    }
+  }
+}
+
+void ProdLineCtrl::outbox_compact_cb(void)
+{
+  if (outbox_ && outbox_->compact())
+    RCLCPP_INFO(this->get_logger(), "Compacted the outbox, %lu requests pending", outbox_->pending());
+}
+
 void ProdLineCtrl::mtrl_box_amt_container_cb(void)
 {
   if (!jinli_ser_state_)
@@ -174,6 +317,8 @@ void ProdLineCtrl::mtrl_box_info_cb(void)
   if (!jinli_ser_state_)
     return;
 
+  const auto start = std::chrono::steady_clock::now();
+
   nlohmann::json res_json;
   if (!get_mtrl_box_info(res_json)) 
   {
@@ -183,44 +328,141 @@ void ProdLineCtrl::mtrl_box_info_cb(void)
   RCLCPP_DEBUG(this->get_logger(), "\n%s", res_json.dump().c_str());
   
   const std::string no_order = "0";
+  std::vector<const nlohmann::json *> mtrl_boxes;
+  std::unordered_set<uint32_t> active_ids;
   for (const auto &mtrl_box : res_json["materialBoxs"])
   {
     if (!no_order.compare(mtrl_box["orderId"].get<std::string>()))
       continue;
-    
-    MaterialBoxStatus msg;
-    for (size_t i = 0; i < msg.material_box.slots.size(); i++) 
-    {
-      nlohmann::json mtrl_box_cell_res_json;
 
-      const httplib::Params params = {
-        { "MaterialBoxId", std::to_string(mtrl_box["id"].get<int>()) },
-        { "cellId", std::to_string(map_index(i) + 1) }
-      };
+    mtrl_boxes.push_back(&mtrl_box);
+    active_ids.insert(mtrl_box["id"].get<uint32_t>());
+  }
+
+  // a few boxes are fetched at a time, each worker on its own pooled connection
+  std::vector<MaterialBoxStatus> msgs(mtrl_boxes.size());
+  std::vector<uint8_t> fetched(mtrl_boxes.size(), 0);
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < mtrl_boxes.size(); i = next++)
+      fetched[i] = get_mtrl_box_status(*mtrl_boxes[i], msgs[i]);
+  };
+
+  const size_t no_of_workers = std::min<size_t>(mtrl_box_info_workers_, mtrl_boxes.size());
+  std::vector<std::future<void>> workers;
+  for (size_t i = 1; i < no_of_workers; i++)
+  {
+    auto done = std::make_shared<std::promise<void>>();
+    auto future = done->get_future();
 
-      if (!get_cell_info_by_id_and_cell_id(params, mtrl_box_cell_res_json))
+    // the boxes left are fetched by this thread if the executor is busy
+    const bool submitted = mtrl_box_executor_->try_submit([&worker, done](BoundedExecutor::Ticket) {
+      try
+      {
+        worker();
+      }
+      catch (...)
       {
-        RCLCPP_ERROR(this->get_logger(), "%s had unknown error", __FUNCTION__);
-        continue;
       }
+      done->set_value();
+    });
+    if (!submitted)
+      break;
+    workers.push_back(std::move(future));
+  }
+  worker();
+  for (auto &future : workers)
+    future.wait();
+
+  // only the boxes which changed since the last refresh are published
+  std::vector<size_t> changed;
+  {
+    const std::lock_guard<std::mutex> lock(mtrl_box_cache_mutex_);
+    for (size_t i = 0; i < msgs.size(); i++)
+    {
+      if (!fetched[i])
+        continue;
+
+      const uint64_t hash = hash_mtrl_box_status(msgs[i]);
+      auto cached = mtrl_box_cache_.find(msgs[i].id);
+      if (cached != mtrl_box_cache_.end() && cached->second.hash == hash)
+        continue;
+
+      msgs[i].header.stamp = this->get_clock()->now();
+      mtrl_box_cache_[msgs[i].id] = MtrlBoxCacheEntry{hash, msgs[i]};
+      changed.push_back(i);
+    }
+
+    // a box without an order is not refreshed anymore, a failed one keeps its last status
+    for (auto it = mtrl_box_cache_.begin(); it != mtrl_box_cache_.end();)
+    {
+      if (active_ids.count(it->first) == 0)
+        it = mtrl_box_cache_.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  for (const size_t i : changed)
+    mtrl_box_status_pub_->publish(msgs[i]);
+  RCLCPP_DEBUG(this->get_logger(), "%ld of %ld material boxes changed", changed.size(), mtrl_boxes.size());
+
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  if (elapsed > MTRL_BOX_INFO_PERIOD)
+  {
+    // the next refresh is a whole period from now, the missed ticks are dropped
+    mtrl_box_info_timer_->reset();
+    RCLCPP_WARN(this->get_logger(), "Refreshing %ld material boxes took %ld ms, the next tick is skipped", 
+      mtrl_boxes.size(), std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+  }
+}
+
+bool ProdLineCtrl::get_mtrl_box_status(const nlohmann::json &mtrl_box, MaterialBoxStatus &msg)
+{
+  try
+  {
+    json_codec::CellsInfo cells_info;
+    const httplib::Params params = {
+      { "MaterialBoxId", std::to_string(mtrl_box["id"].get<int>()) }
+    };
+
+    // all cells of the box in one request
+    if (!get_cells_info_by_id(params, cells_info))
+    {
+      RCLCPP_ERROR(this->get_logger(), "%s had unknown error", __FUNCTION__);
+      return false;
+    }
+
+    // the cells of jinli are numbered from 1, the slots are ordered by map_index
+    std::array<size_t, std::tuple_size<decltype(msg.material_box.slots)>::value> slot_of_cell;
+    for (size_t i = 0; i < slot_of_cell.size(); i++)
+      slot_of_cell[map_index(i)] = i;
+
+    size_t position = 0;
+    for (const auto &cell : cells_info.cells)
+    {
+      const size_t cell_id = cell.cell_id != 0 ? cell.cell_id : position + 1;
+      position++;
+      if (cell_id > slot_of_cell.size())
+        continue;
 
-      for (const auto &drug : mtrl_box_cell_res_json["cell"]["drugs"])
+      auto &slot = msg.material_box.slots[slot_of_cell[cell_id - 1]];
+      for (const auto &drug : cell.drugs)
       {
-        if (drug["isCompleted"].get<int>() != 0)
+        if (drug.is_completed)
         {
           DispensingDetail dis_detail_msg;
-          for (const auto &location : drug["locations"]) // The length of locations must be 1
+          for (const auto &location : drug.locations) // The length of locations must be 1
           {
-            dis_detail_msg.location.dispenser_station = location["dispenserStation"].get<int>();
-            dis_detail_msg.location.dispenser_unit = location["dispenserUnit"].get<int>();
+            dis_detail_msg.location.dispenser_station = location.dispenser_station;
+            dis_detail_msg.location.dispenser_unit = location.dispenser_unit;
           }
-          dis_detail_msg.amount = drug["amount"].get<int>();
-          msg.material_box.slots[i].dispensing_detail.push_back(dis_detail_msg);
+          dis_detail_msg.amount = drug.amount;
+          slot.dispensing_detail.push_back(dis_detail_msg);
         }
       }
     }
-    
-    msg.header.stamp = this->get_clock()->now();
+
     msg.id = mtrl_box["id"];
     msg.location = mtrl_box["location"];
 
@@ -231,15 +473,43 @@ void ProdLineCtrl::mtrl_box_info_cb(void)
       msg.status = MaterialBoxStatus::STATUS_PROCESSING;
     else
       msg.status = MaterialBoxStatus::STATUS_ERROR;
+  }
+  catch (const std::exception &e)
+  {
+    RCLCPP_ERROR(this->get_logger(), "%s: %s", __FUNCTION__, e.what());
+    return false;
+  }
+
+  return true;
+}
 
-    mtrl_box_status_pub_->publish(msg);
+uint64_t ProdLineCtrl::hash_mtrl_box_status(const MaterialBoxStatus &msg)
+{
+  // the stamp is left out, it is only set when the status changes
+  MaterialBoxStatus content = msg;
+  content.header.stamp = builtin_interfaces::msg::Time();
+
+  rclcpp::Serialization<MaterialBoxStatus> serializer;
+  rclcpp::SerializedMessage serialized;
+  serializer.serialize_message(&content, &serialized);
+
+  const auto &buffer = serialized.get_rcl_serialized_message();
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < buffer.buffer_length; i++)
+  {
+    hash ^= buffer.buffer[i];
+    hash *= 1099511628211ull;
   }
+  return hash;
 }
 
 void ProdLineCtrl::pkg_mac_status_cb(const PackagingMachineStatus::SharedPtr msg)
 {
-  const std::lock_guard<std::mutex> lock(mutex_);
-  pkg_mac_status_[msg->packaging_machine_id] = *msg;
+  if (!pkg_mac_status_.update(msg->packaging_machine_id, *msg) && 
+      msg->packaging_machine_id >= pkg_mac_status_.capacity())
+  {
+    RCLCPP_ERROR(this->get_logger(), "Packaging Machine ID %d is out of the status table", msg->packaging_machine_id);
+  }
 }
 
 void ProdLineCtrl::unbind_mtrl_id_cb(const UnbindRequest::SharedPtr msg)
@@ -277,7 +547,11 @@ void ProdLineCtrl::dis_result_srv_handler(std::map<uint8_t, std::shared_ptr<Disp
   for (auto &tuple : futures_tuple)
   {
     RCLCPP_DEBUG(this->get_logger(), "started to wait a future");
-    std::get<2>(tuple).wait(); // wait forever until the future is done
+    // no limit for a dispensing, only a shutdown ends the wait
+    while (rclcpp::ok() && std::get<2>(tuple).wait_for(1s) != std::future_status::ready)
+      continue;
+    if (!rclcpp::ok())
+      return;
     std::get<1>(tuple) = true;
   }
 
@@ -289,51 +563,108 @@ void ProdLineCtrl::dis_result_srv_handler(std::map<uint8_t, std::shared_ptr<Disp
       { "dispenserStation", std::get<0>(tuple) },
       { "isCompleted", std::get<1>(tuple) ? 1 : 0 }
     };
-    nlohmann::json result_res_json;
 
-    auto req_copy = result_req_json;
-    auto res_copy = result_res_json;
-
-    // std::thread(std::bind(&ProdLineCtrl::dis_result_until_success, this, result_req_json, result_req_json)).detach();
-    auto func = std::bind(&ProdLineCtrl::dis_result, this, _1, _2);
-    std::thread result_thread(
-      [this, req_copy, res_copy, func]() mutable {
-        this->perform_until_success(req_copy, res_copy, func);
+    // the result is retried in the background until the jinli server takes it
+    send_outbound(0, dis_result_url, result_req_json.dump(), 
+      [this, result_req_json](bool success, const nlohmann::json &) {
+        if (!success)
+          RCLCPP_ERROR(this->get_logger(), "Gave up the dispense result: %s", result_req_json.dump().c_str());
       });
-    result_thread.detach();
   }
   
   RCLCPP_DEBUG(this->get_logger(), "%s is done.", __FUNCTION__);
 }
 
-void ProdLineCtrl::perform_until_success(
-  const nlohmann::json &req_json, 
-  nlohmann::json &res_json, 
-  std::function<bool(const nlohmann::json&, nlohmann::json&)> func) 
+bool ProdLineCtrl::new_order_until_success(const std::string &req_body, nlohmann::json &res_json)
 {
-  while (rclcpp::ok() && !func(req_json, res_json)) 
-  {
-    RCLCPP_ERROR(this->get_logger(), "HTTP request failed, waiting for retry...");
-    res_json.clear();
-    std::this_thread::sleep_for(100ms);
-  }
+  auto res = std::make_shared<nlohmann::json>();
+  auto sent = std::make_shared<std::promise<bool>>();
+  auto sent_future = sent->get_future();
+
+  send_outbound(0, new_order_url, req_body, 
+    [res, sent](bool success, const nlohmann::json &res_json) {
+      *res = res_json;
+      sent->set_value(success);
+    });
+
+  // only the thread of this order waits, the attempts run on the retry workers
+  const bool success = sent_future.get();
+  res_json = std::move(*res);
+  return success;
 }
 
-void ProdLineCtrl::new_order_until_success(const nlohmann::json &req_json, nlohmann::json &res_json)
+void ProdLineCtrl::send_outbound(
+  uint64_t outbox_id,
+  const std::string &endpoint, 
+  const std::string &req_body, 
+  std::function<void(bool, const nlohmann::json &)> done)
 {
-  while (rclcpp::ok() && !new_order(req_json, res_json))
+  // the request is on the disk before its first attempt
+  if (outbox_id == 0 && outbox_)
   {
-    res_json.clear();
-    std::this_thread::sleep_for(100ms);
+    outbox_id = outbox_->append(endpoint, req_body);
+    if (outbox_id == 0)
+      RCLCPP_WARN(this->get_logger(), "%s is not stored in the outbox, it is lost if the node stops", endpoint.c_str());
   }
+
+  auto res = std::make_shared<nlohmann::json>();
+  jinli_retry_->submit(endpoint, 
+    [this, endpoint, req_body, res]() {
+      res->clear();
+      return post_outbound(endpoint, req_body, *res);
+    }, 
+    [this, outbox_id, res, done](RetryScheduler::Outcome outcome) {
+      // the waiter has its answer once the request is sent or given up, a replay
+      // would repeat it, only the requests cut by a shutdown stay for the next run
+      if (outcome != RetryScheduler::Outcome::STOPPED && outbox_id != 0 && outbox_)
+        outbox_->complete(outbox_id);
+      if (done)
+        done(outcome == RetryScheduler::Outcome::SENT, *res);
+    });
+}
+
+bool ProdLineCtrl::post_outbound(const std::string &endpoint, const std::string &req_body, nlohmann::json &res_json)
+{
+  if (endpoint == new_order_url)
+    return new_order(req_body, res_json);
+  if (endpoint == dis_result_url)
+    return dis_result(req_body, res_json);
+
+  RCLCPP_ERROR(this->get_logger(), "No request is sent to %s", endpoint.c_str());
+  return false;
 }
 
-void ProdLineCtrl::dis_result_until_success(const nlohmann::json &req_json, nlohmann::json &res_json)
+void ProdLineCtrl::replay_outbox(const std::vector<Outbox::Entry> &pending)
 {
-  while (rclcpp::ok() && !dis_result(req_json, res_json))
+  for (const auto &entry : pending)
   {
-    res_json.clear();
-    std::this_thread::sleep_for(100ms);
+    if (entry.endpoint != new_order_url && entry.endpoint != dis_result_url)
+    {
+      RCLCPP_ERROR(this->get_logger(), "Dropped an unknown request of the outbox: %s %s", entry.endpoint.c_str(), entry.body.c_str());
+      outbox_->complete(entry.id);
+      continue;
+    }
+
+    // jinli creates an order for every newOrder it takes, the last run may have
+    // sent it already, so it is left to the operator instead of being sent again
+    if (entry.endpoint == new_order_url)
+    {
+      RCLCPP_ERROR(this->get_logger(), "An order of the last run may not have reached jinli, check it by hand: %s", entry.body.c_str());
+      outbox_->complete(entry.id);
+      continue;
+    }
+
+    RCLCPP_WARN(this->get_logger(), "Resending %s of the last run: %s", entry.endpoint.c_str(), entry.body.c_str());
+
+    // a dispense result is only a state, sending it twice does no harm
+    const std::string endpoint = entry.endpoint;
+    send_outbound(entry.id, entry.endpoint, entry.body, 
+      [this, endpoint](bool success, const nlohmann::json &res_json) {
+        if (success)
+          RCLCPP_INFO(this->get_logger(), "%s of the last run is sent: %s", endpoint.c_str(), res_json.dump().c_str());
+        else
+          RCLCPP_ERROR(this->get_logger(), "Gave up %s of the last run", endpoint.c_str());
+      });
   }
 }
 
@@ -373,100 +704,73 @@ void ProdLineCtrl::order_execute(const std::shared_ptr<GaolHandlerNewOrder> goal
   auto result = std::make_shared<NewOrder::Result>();
   RCLCPP_INFO(this->get_logger(), "Executing goal");
   
-  nlohmann::json req_json, res_json;
-  nlohmann::json req_json_temp;
-  for (size_t i = 0; i < goal->request.material_box.slots.size(); i++) 
-  {
-    auto &slots_i = goal->request.material_box.slots[i];
-    nlohmann::json _cell;
-
-    for (const auto &drugs_j : slots_i.drugs)
-    {
-      nlohmann::json _drug;
-      _drug["amount"] = drugs_j.amount;
-      _drug["drugId"] = drugs_j.drug_id;
+  // written once in the order of jinli, its cell map_index(i) is the slot i
+  const auto &slots = goal->request.material_box.slots;
+  std::vector<size_t> cell_order(slots.size());
+  for (size_t i = 0; i < slots.size(); i++)
+    cell_order[map_index(i)] = i;
 
-      for (const auto &location_j : drugs_j.locations)
-      {
-        nlohmann::json location = {
-          {"dispenserStation", location_j.dispenser_station},
-          {"dispenserUnit", location_j.dispenser_unit}
-        };
-
-        _drug["locations"].push_back(location);
-      }
-      RCLCPP_INFO(this->get_logger(), "a drug is added to a cell");
-      _cell["drugs"].push_back(_drug);
-    }
-
-    req_json_temp["cells"].push_back(_cell);
-    RCLCPP_INFO(this->get_logger(), "a cell is added to req_json_temp, i: %ld", i);
-  }
-  RCLCPP_INFO(this->get_logger(), "req_json_temp:");
-  RCLCPP_INFO(this->get_logger(), "\n%s", req_json_temp.dump().c_str());
-
-  req_json["cells"] = nlohmann::json::array();
-  for (size_t i = 0; i < req_json_temp["cells"].size(); i++)
-  {
-    req_json["cells"].push_back(nullptr); 
-  }
-
-  for (size_t i = 0; i < req_json_temp["cells"].size(); i++) 
-  {
-    req_json["cells"][map_index(i)] = req_json_temp["cells"][i];
-  }
-  req_json_temp.clear();
+  std::string req_body;
+  nlohmann::json res_json;
+  json_codec::encode_new_order(slots, cell_order, req_body);
 
   running = true;
   goal_handle->publish_feedback(feedback);
   RCLCPP_INFO(this->get_logger(), "A new order json is created. Set running to %s", running ? "true" : "false");
-  RCLCPP_INFO(this->get_logger(), "req_json:");
-  RCLCPP_INFO(this->get_logger(), "\n%s", req_json.dump().c_str());
+  RCLCPP_INFO(this->get_logger(), "req_body:");
+  RCLCPP_INFO(this->get_logger(), "\n%s", req_body.c_str());
 
-  auto func = std::bind(&ProdLineCtrl::new_order, this, _1, _2);
-  perform_until_success(req_json, res_json, func);
+  if (!new_order_until_success(req_body, res_json))
+  {
+    result->response.success = false;
+    result->response.message = "The new order is not taken by the jinli server";
+    RCLCPP_ERROR(this->get_logger(), "%s", result->response.message.c_str());
+    if (rclcpp::ok())
+      goal_handle->abort(result);
+    return;
+  }
 
   RCLCPP_INFO(this->get_logger(), "A new order is sent, waiting for material box id...");
 
+  // jinli may give the id as a number, the query and the key take its text
+  const std::string order_id = order_id_key(res_json["orderId"]);
   const httplib::Params params = {
-    {"orderId", res_json["orderId"]}
+    {"orderId", order_id}
   };
 
-  uint32_t retries = 0;
-  const uint32_t MAX_RETRY = 600; // FIXME: this unit is seconds
-  rclcpp::Rate loop_rate(1s); 
-
-  for (; retries < MAX_RETRY && rclcpp::ok(); ++retries) 
+  // the assignment callback wakes the order, get_order_by_id is the fallback
+  uint32_t polls = 0;
+  const uint32_t id = assignment_waiters_->wait(
+    order_id, 
+    MTRL_BOX_ASSIGNMENT_TIMEOUT, 
+    [this, &params, &polls, &goal_handle, &feedback]() -> uint32_t {
+      RCLCPP_INFO(this->get_logger(), "Polling for the material box id (%u times)...", ++polls);
+      goal_handle->publish_feedback(feedback);
+
+      nlohmann::json order_by_id_res_json;
+      if (!get_order_by_id(params, order_by_id_res_json))
+        return 0;
+
+      const auto &mtrl_box_id = order_by_id_res_json["materialBoxId"];
+      const uint32_t id = mtrl_box_id.is_number() ? mtrl_box_id.get<uint32_t>() : 0;
+      if (id == 0)
+        RCLCPP_DEBUG(this->get_logger(), "Received a material box id is 0");
+      return id;
+    }, 
+    []() { return rclcpp::ok(); });
+
+  if (id != 0)
   {
-    RCLCPP_INFO(this->get_logger(), "Waiting for the material box id (%d times)...", retries + 1);
-    nlohmann::json order_by_id_res_json;
-
-    if (get_order_by_id(params, order_by_id_res_json))
-    {
-      int id = order_by_id_res_json["materialBoxId"].get<int>();
-      if (id != 0)
-      {
-        result->response.material_box_id = id;
-        result->response.success = true;
-        const std::lock_guard<std::mutex> lock(mutex_);
-        orders_[id] = std::move(goal->request);
-        break;
-      }
-      else
-      {
-        RCLCPP_ERROR(this->get_logger(), "Received a material box id is 0");
-      }
-    }
-
-    goal_handle->publish_feedback(feedback);
-    loop_rate.sleep();
+    result->response.material_box_id = id;
+    result->response.success = true;
+    const std::lock_guard<std::mutex> lock(mutex_);
+    orders_[id] = std::move(goal->request);
   }
-
-  if (retries >= MAX_RETRY)
+  else
   {
     result->response.success = false;
     result->response.message = "The material box is waited too long";
-    RCLCPP_ERROR(this->get_logger(), "retries (%d) >= MAX_RETRY", retries);
+    RCLCPP_ERROR(this->get_logger(), "No material box is assigned after %u polls", polls);
   }
 
   if (rclcpp::ok()) 
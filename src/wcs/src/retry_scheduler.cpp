@@ -0,0 +1,174 @@
+#include "wcs/retry_scheduler.hpp"
+
+#include <algorithm>
+
+RetryScheduler::RetryScheduler(const Config &config, CircuitClosed circuit_closed)
+: config_(config),
+  circuit_closed_(std::move(circuit_closed)),
+  stop_(false),
+  seq_(0),
+  rng_(std::random_device{}())
+{
+  for (size_t i = 0; i < std::max<size_t>(config_.workers, 1); i++)
+    workers_.emplace_back(&RetryScheduler::worker, this);
+}
+
+RetryScheduler::~RetryScheduler()
+{
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+
+  for (auto &worker : workers_)
+  {
+    if (worker.joinable())
+      worker.join();
+  }
+
+  // whoever waits for a request is told it is stopped
+  std::vector<Done> given_up;
+  while (!tasks_.empty())
+  {
+    given_up.push_back(tasks_.top().done);
+    tasks_.pop();
+  }
+  for (auto &blocked : blocked_)
+  {
+    for (auto &task : blocked.second)
+      given_up.push_back(task.done);
+  }
+
+  for (auto &done : given_up)
+  {
+    if (done)
+      done(Outcome::STOPPED);
+  }
+}
+
+void RetryScheduler::submit(const std::string &endpoint, Attempt attempt, Done done)
+{
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    const auto now = Clock::now();
+    tasks_.push(Task{seq_++, endpoint, std::move(attempt), std::move(done), 0, now, now, config_.initial_backoff});
+  }
+  cv_.notify_one();
+}
+
+size_t RetryScheduler::pending(void)
+{
+  const std::lock_guard<std::mutex> lock(mutex_);
+  size_t pending = tasks_.size();
+  for (const auto &blocked : blocked_)
+    pending += blocked.second.size();
+  for (const auto &in_flight : in_flight_)
+    pending += in_flight.second;
+  return pending;
+}
+
+void RetryScheduler::worker(void)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (!stop_)
+  {
+    if (tasks_.empty())
+    {
+      cv_.wait(lock);
+      continue;
+    }
+
+    if (tasks_.top().due > Clock::now())
+    {
+      cv_.wait_until(lock, tasks_.top().due);
+      continue;
+    }
+
+    Task task = tasks_.top();
+    tasks_.pop();
+
+    size_t &in_flight = in_flight_[task.endpoint];
+    if (in_flight >= std::max<size_t>(config_.max_in_flight, 1))
+    {
+      blocked_[task.endpoint].push_back(std::move(task));
+      continue;
+    }
+    in_flight++;
+
+    lock.unlock();
+
+    bool success = false;
+    const bool circuit_closed = !circuit_closed_ || circuit_closed_();
+    if (circuit_closed)
+    {
+      try
+      {
+        success = task.attempt();
+      }
+      catch (...)
+      {
+        success = false;
+      }
+    }
+
+    lock.lock();
+
+    // the next task of the endpoint can go now
+    in_flight_[task.endpoint]--;
+    auto blocked = blocked_.find(task.endpoint);
+    if (blocked != blocked_.end())
+    {
+      if (!blocked->second.empty())
+      {
+        Task next = std::move(blocked->second.front());
+        blocked->second.pop_front();
+        next.due = Clock::now();
+        tasks_.push(std::move(next));
+        cv_.notify_one();
+      }
+      if (blocked->second.empty())
+        blocked_.erase(blocked);
+    }
+
+    if (success)
+    {
+      lock.unlock();
+      if (task.done)
+        task.done(Outcome::SENT);
+      lock.lock();
+      continue;
+    }
+
+    const auto now = Clock::now();
+    if (config_.deadline.count() > 0 && now - task.submitted_at >= config_.deadline)
+    {
+      lock.unlock();
+      if (task.done)
+        task.done(Outcome::GIVEN_UP);
+      lock.lock();
+      continue;
+    }
+
+    // an open circuit is not the fault of the request, its backoff stays
+    if (circuit_closed)
+      task.due = now + next_delay(task);
+    else
+      task.due = now + config_.circuit_wait;
+
+    tasks_.push(std::move(task));
+  }
+}
+
+std::chrono::milliseconds RetryScheduler::next_delay(Task &task)
+{
+  task.attempts++;
+
+  std::uniform_real_distribution<double> random(0.0, config_.jitter);
+  const auto delay = std::chrono::milliseconds(
+    static_cast<int64_t>(task.backoff.count() * (1.0 - random(rng_))));
+
+  task.backoff = std::min(task.backoff * 2, config_.max_backoff);
+  return delay;
+}
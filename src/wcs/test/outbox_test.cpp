@@ -0,0 +1,219 @@
+#include "wcs/outbox.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+class OutboxTest : public ::testing::Test
+{
+protected:
+  static constexpr size_t INITIAL_SIZE = 4096;
+  // header, type and id of a record
+  static constexpr size_t RECORD_SIZE = 8 + 1 + 8;
+
+  std::string dir_;
+  std::string path_;
+
+  void SetUp(void) override
+  {
+    char dir[] = "/tmp/outbox_test.XXXXXX";
+    ASSERT_NE(::mkdtemp(dir), nullptr);
+    dir_ = dir;
+    path_ = dir_ + "/outbox.log";
+  }
+
+  void TearDown(void) override
+  {
+    std::remove(path_.c_str());
+    std::remove((path_ + ".tmp").c_str());
+    ::rmdir(dir_.c_str());
+  }
+
+  std::vector<Outbox::Entry> reopen(void)
+  {
+    Outbox outbox(path_, INITIAL_SIZE, 1ms);
+    std::vector<Outbox::Entry> pending;
+    EXPECT_TRUE(outbox.open(pending));
+    return pending;
+  }
+
+  size_t file_size(void)
+  {
+    struct stat st;
+    return ::stat(path_.c_str(), &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+  }
+};
+
+TEST_F(OutboxTest, ReplaysPendingRequests)
+{
+  {
+    Outbox outbox(path_, INITIAL_SIZE, 1ms);
+    std::vector<Outbox::Entry> pending;
+    ASSERT_TRUE(outbox.open(pending));
+    EXPECT_TRUE(pending.empty());
+
+    const uint64_t first = outbox.append("/new_order", "{\"a\":1}");
+    const uint64_t second = outbox.append("/dis_result", "{\"b\":2}");
+    const uint64_t third = outbox.append("/new_order", "");
+    ASSERT_NE(first, 0u);
+    ASSERT_NE(second, 0u);
+    ASSERT_NE(third, 0u);
+
+    outbox.complete(second);
+    EXPECT_EQ(outbox.pending(), 2u);
+  }
+
+  const auto pending = reopen();
+  ASSERT_EQ(pending.size(), 2u);
+  EXPECT_EQ(pending[0].endpoint, "/new_order");
+  EXPECT_EQ(pending[0].body, "{\"a\":1}");
+  EXPECT_EQ(pending[1].endpoint, "/new_order");
+  EXPECT_EQ(pending[1].body, "");
+}
+
+TEST_F(OutboxTest, IdsGoOnAfterReplay)
+{
+  uint64_t last;
+  {
+    Outbox outbox(path_, INITIAL_SIZE, 1ms);
+    std::vector<Outbox::Entry> pending;
+    ASSERT_TRUE(outbox.open(pending));
+    last = outbox.append("/new_order", "1");
+    outbox.complete(last);
+  }
+
+  Outbox outbox(path_, INITIAL_SIZE, 1ms);
+  std::vector<Outbox::Entry> pending;
+  ASSERT_TRUE(outbox.open(pending));
+  EXPECT_TRUE(pending.empty());
+  EXPECT_GT(outbox.append("/new_order", "2"), last);
+}
+
+TEST_F(OutboxTest, StopsAtTornRecord)
+{
+  {
+    Outbox outbox(path_, INITIAL_SIZE, 1ms);
+    std::vector<Outbox::Entry> pending;
+    ASSERT_TRUE(outbox.open(pending));
+    ASSERT_NE(outbox.append("/a", "11111"), 0u);
+    ASSERT_NE(outbox.append("/b", "22222"), 0u);
+  }
+
+  // the last byte of the second record, as if the crash came in the middle of it
+  const size_t record = RECORD_SIZE + 3 + 5;
+  FILE *file = std::fopen(path_.c_str(), "r+b");
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(std::fseek(file, 2 * record - 1, SEEK_SET), 0);
+  std::fputc('X', file);
+  std::fclose(file);
+
+  {
+    Outbox outbox(path_, INITIAL_SIZE, 1ms);
+    std::vector<Outbox::Entry> pending;
+    ASSERT_TRUE(outbox.open(pending));
+    ASSERT_EQ(pending.size(), 1u);
+    EXPECT_EQ(pending[0].endpoint, "/a");
+    EXPECT_EQ(pending[0].body, "11111");
+
+    // the torn record is overwritten, not followed
+    ASSERT_NE(outbox.append("/c", "3"), 0u);
+  }
+
+  const auto pending = reopen();
+  ASSERT_EQ(pending.size(), 2u);
+  EXPECT_EQ(pending[0].endpoint, "/a");
+  EXPECT_EQ(pending[1].endpoint, "/c");
+  EXPECT_EQ(pending[1].body, "3");
+}
+
+TEST_F(OutboxTest, GrowsPastInitialSize)
+{
+  const std::string body(1000, 'x');
+  std::vector<uint64_t> ids;
+  {
+    Outbox outbox(path_, INITIAL_SIZE, 1ms);
+    std::vector<Outbox::Entry> pending;
+    ASSERT_TRUE(outbox.open(pending));
+
+    // appended from a few threads so that the file grows while the flusher syncs
+    std::vector<std::thread> threads;
+    std::vector<std::vector<uint64_t>> appended(4);
+    for (size_t t = 0; t < appended.size(); t++)
+    {
+      threads.emplace_back([&outbox, &body, &appended, t]() {
+        for (int i = 0; i < 10; i++)
+          appended[t].push_back(outbox.append("/dis_result", body));
+      });
+    }
+    for (auto &thread : threads)
+      thread.join();
+
+    for (const auto &thread_ids : appended)
+    {
+      for (const uint64_t id : thread_ids)
+      {
+        ASSERT_NE(id, 0u);
+        ids.push_back(id);
+      }
+    }
+    EXPECT_EQ(outbox.pending(), 40u);
+  }
+
+  EXPECT_GT(file_size(), INITIAL_SIZE * 8);
+
+  const auto pending = reopen();
+  ASSERT_EQ(pending.size(), ids.size());
+  for (const auto &entry : pending)
+  {
+    EXPECT_EQ(entry.endpoint, "/dis_result");
+    EXPECT_EQ(entry.body, body);
+  }
+}
+
+TEST_F(OutboxTest, CompactsDeadRecords)
+{
+  const std::string body(200, 'y');
+  {
+    Outbox outbox(path_, INITIAL_SIZE, 1ms);
+    std::vector<Outbox::Entry> pending;
+    ASSERT_TRUE(outbox.open(pending));
+
+    // nothing is dead yet, the file is kept
+    std::vector<uint64_t> ids;
+    for (int i = 0; i < 40; i++)
+      ids.push_back(outbox.append("/dis_result", body));
+    EXPECT_FALSE(outbox.compact());
+
+    for (size_t i = 2; i < ids.size(); i++)
+      outbox.complete(ids[i]);
+
+    const size_t before = file_size();
+    ASSERT_TRUE(outbox.compact());
+    EXPECT_LT(file_size(), before);
+    EXPECT_EQ(outbox.pending(), 2u);
+
+    // the records go on in the new file
+    const uint64_t id = outbox.append("/new_order", "{\"x\":1}");
+    EXPECT_GT(id, ids.back());
+    outbox.complete(ids[0]);
+  }
+
+  const auto pending = reopen();
+  ASSERT_EQ(pending.size(), 2u);
+  EXPECT_EQ(pending[0].endpoint, "/dis_result");
+  EXPECT_EQ(pending[0].body, body);
+  EXPECT_EQ(pending[1].endpoint, "/new_order");
+  EXPECT_EQ(pending[1].body, "{\"x\":1}");
+
+  struct stat st;
+  EXPECT_NE(::stat((path_ + ".tmp").c_str(), &st), 0);
+}